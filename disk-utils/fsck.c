@@ -61,6 +61,7 @@
 
 #define CLOSE_EXIT_CODE		FSCK_EX_ERROR
 #include "closestream.h"
+#include "carefulputc.h"
 
 #ifndef DEFAULT_FSTYPE
 # define DEFAULT_FSTYPE	"ext2"
@@ -71,6 +72,12 @@
 
 #define FSCK_RUNTIME_DIRNAME	"/run/fsck"
 
+/* max depth of dm/md stacks followed by the /sys slaves */
+#define FSCK_MAX_STACK_DEPTH	16
+
+/* the check of a sector on rotational disk is more expensive than on SSD */
+#define FSCK_COST_ROTATIONAL	4
+
 static const char *ignored_types[] = {
 	"ignore",
 	"iso9660",
@@ -95,9 +102,14 @@ struct fsck_fs_data
 {
 	const char	*device;
 	dev_t		disk;
-	unsigned int	stacked:1,
-			done:1,
-			eval_device:1;
+
+	dev_t		*disks;		/* whole disks below the device */
+	size_t		ndisks;
+	unsigned long long cost;	/* estimated cost of the check */
+
+	unsigned int	done:1,
+			eval_device:1,
+			eval_topology:1;
 };
 
 /*
@@ -145,6 +157,7 @@ static int progress_fd;
 static int force_all_parallel;
 static int report_stats;
 static FILE *report_stats_file;
+static FILE *summary_file;
 
 static int num_running;
 static int max_running;
@@ -162,8 +175,6 @@ static char *fsck_path;
 static struct libmnt_table *fstab, *mtab;
 static struct libmnt_cache *mntcache;
 
-static int count_slaves(dev_t disk);
-
 static int string_to_int(const char *s)
 {
 	long l;
@@ -276,21 +287,11 @@ static dev_t fs_get_disk(struct libmnt_fs *fs, int check)
 	data = fs_create_data(fs);
 
 	if (!stat(device, &st) &&
-	    !blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &data->disk)) {
-
-		if (data->disk)
-			data->stacked = count_slaves(data->disk) > 0 ? 1 : 0;
+	    !blkid_devno_to_wholedisk(st.st_rdev, NULL, 0, &data->disk))
 		return data->disk;
-	}
 	return 0;
 }
 
-static int fs_is_stacked(struct libmnt_fs *fs)
-{
-	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
-	return data ? data->stacked : 0;
-}
-
 static int fs_is_done(struct libmnt_fs *fs)
 {
 	struct fsck_fs_data *data = mnt_fs_get_userdata(fs);
@@ -335,6 +336,151 @@ static int is_irrotational_disk(dev_t disk)
 	return rc == 1 ? !x : 0;
 }
 
+/* reads "major:minor" from sysfs @path */
+static dev_t read_devno(const char *path)
+{
+	unsigned int maj, min;
+	FILE *f;
+	int rc;
+
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		return 0;
+	rc = fscanf(f, "%u:%u", &maj, &min);
+	fclose(f);
+
+	return rc == 2 ? makedev(maj, min) : 0;
+}
+
+static unsigned long long get_device_sectors(dev_t devno)
+{
+	char path[PATH_MAX];
+	unsigned long long sz = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/size",
+			major(devno), minor(devno));
+
+	f = fopen(path, "r" UL_CLOEXECSTR);
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &sz) != 1)
+		sz = 0;
+	fclose(f);
+	return sz;
+}
+
+static void fs_add_disk(struct fsck_fs_data *data, dev_t disk)
+{
+	size_t i;
+
+	for (i = 0; i < data->ndisks; i++) {
+		if (data->disks[i] == disk)
+			return;
+	}
+	data->disks = xrealloc(data->disks, (data->ndisks + 1) * sizeof(dev_t));
+	data->disks[data->ndisks++] = disk;
+}
+
+/*
+ * Follows /sys/dev/block/<devno>/slaves (dm, md, ...) down to the
+ * devices without slaves and adds their whole disks to @data.
+ */
+static void fs_add_slaves(struct fsck_fs_data *data, dev_t devno, int depth)
+{
+	DIR *dir = NULL;
+	struct dirent *dp;
+	char dirname[PATH_MAX];
+	int count = 0;
+	dev_t disk;
+
+	snprintf(dirname, sizeof(dirname),
+			"/sys/dev/block/%u:%u/slaves/",
+			major(devno), minor(devno));
+
+	if (depth < FSCK_MAX_STACK_DEPTH)
+		dir = opendir(dirname);
+	while (dir && (dp = readdir(dir)) != NULL) {
+		char path[PATH_MAX];
+		dev_t slave;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK)
+			continue;
+#endif
+		if (dp->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/slaves/%s/dev",
+				major(devno), minor(devno), dp->d_name);
+		slave = read_devno(path);
+		if (!slave)
+			continue;
+		fs_add_slaves(data, slave, depth + 1);
+		count++;
+	}
+	if (dir)
+		closedir(dir);
+
+	if (count)
+		return;
+	if (blkid_devno_to_wholedisk(devno, NULL, 0, &disk) || !disk)
+		disk = devno;
+	fs_add_disk(data, disk);
+}
+
+/*
+ * Returns fs data with the whole disks used by the filesystem and with
+ * the estimated cost of the check. The disks are unknown (ndisks is zero)
+ * for non-block devices.
+ */
+static struct fsck_fs_data *fs_get_topology(struct libmnt_fs *fs)
+{
+	struct fsck_fs_data *data = fs_create_data(fs);
+	const char *device;
+	struct stat st;
+	size_t i;
+
+	if (data->eval_topology)
+		return data;
+	data->eval_topology = 1;
+
+	if (mnt_fs_is_netfs(fs) || mnt_fs_is_pseudofs(fs))
+		return data;
+
+	device = fs_get_device(fs);
+	if (!device || stat(device, &st) != 0 || !S_ISBLK(st.st_mode))
+		return data;
+
+	fs_add_slaves(data, st.st_rdev, 0);
+
+	data->cost = get_device_sectors(st.st_rdev);
+	for (i = 0; i < data->ndisks; i++) {
+		if (!is_irrotational_disk(data->disks[i])) {
+			data->cost *= FSCK_COST_ROTATIONAL;
+			break;
+		}
+	}
+	return data;
+}
+
+/* returns TRUE if the filesystems share any disk or if the disks are unknown */
+static int fs_share_disks(struct fsck_fs_data *a, struct fsck_fs_data *b)
+{
+	size_t i, j;
+
+	if (!a->ndisks || !b->ndisks)
+		return 1;
+
+	for (i = 0; i < a->ndisks; i++) {
+		for (j = 0; j < b->ndisks; j++) {
+			if (a->disks[i] == b->disks[j])
+				return 1;
+		}
+	}
+	return 0;
+}
+
 static void lock_disk(struct fsck_instance *inst)
 {
 	dev_t disk = fs_get_disk(inst->fs, 1);
@@ -622,6 +768,48 @@ static void print_stats(struct fsck_instance *inst)
 			(long)inst->rusage.ru_stime.tv_usec);
 }
 
+/*
+ * Print one JSON object (line) for the finished fsck instance to the
+ * --summary file.
+ */
+static void print_summary(struct fsck_instance *inst)
+{
+	struct fsck_fs_data *data;
+	struct timeval delta;
+	const char *tgt;
+
+	if (!inst || !summary_file || noexecute)
+		return;
+
+	data = fs_get_topology(inst->fs);
+	tgt = mnt_fs_get_target(inst->fs);
+
+	timersub(&inst->end_time, &inst->start_time, &delta);
+
+	fputs("{\"device\": ", summary_file);
+	fputs_quoted_json(fs_get_device(inst->fs), summary_file);
+	fputs(", \"target\": ", summary_file);
+	if (tgt)
+		fputs_quoted_json(tgt, summary_file);
+	else
+		fputs("null", summary_file);
+	fputs(", \"type\": ", summary_file);
+	fputs_quoted_json(inst->type, summary_file);
+	fprintf(summary_file, ", \"passno\": %d, \"disks\": %zu, \"cost\": %llu"
+			      ", \"status\": %d, \"maxrss\": %ld"
+			      ", \"real\": %ld.%06ld, \"user\": %ld.%06ld, \"sys\": %ld.%06ld}\n",
+		mnt_fs_get_passno(inst->fs),
+		data->ndisks, data->cost,
+		inst->exit_status,
+		inst->rusage.ru_maxrss,
+		(long)delta.tv_sec, (long)delta.tv_usec,
+		(long)inst->rusage.ru_utime.tv_sec,
+		(long)inst->rusage.ru_utime.tv_usec,
+		(long)inst->rusage.ru_stime.tv_sec,
+		(long)inst->rusage.ru_stime.tv_usec);
+	fflush(summary_file);
+}
+
 /*
  * Execute a particular fsck program, and link it into the list of
  * child processes we are waiting for.
@@ -850,6 +1038,7 @@ ret_inst:
 		instance_list = inst->next;
 
 	print_stats(inst);
+	print_summary(inst);
 
 	if (verbose > 1)
 		printf(_("Finished with %s (exit status %d)\n"),
@@ -1172,74 +1361,54 @@ static int ignore(struct libmnt_fs *fs)
 	return 0;
 }
 
-static int count_slaves(dev_t disk)
-{
-	DIR *dir;
-	struct dirent *dp;
-	char dirname[PATH_MAX];
-	int count = 0;
-
-	snprintf(dirname, sizeof(dirname),
-			"/sys/dev/block/%u:%u/slaves/",
-			major(disk), minor(disk));
-
-	if (!(dir = opendir(dirname)))
-		return -1;
-
-	while ((dp = readdir(dir)) != NULL) {
-#ifdef _DIRENT_HAVE_D_TYPE
-		if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK)
-			continue;
-#endif
-		if (dp->d_name[0] == '.' &&
-		    ((dp->d_name[1] == 0) ||
-		     ((dp->d_name[1] == '.') && (dp->d_name[2] == 0))))
-			continue;
-
-		count++;
-	}
-
-	closedir(dir);
-	return count;
-}
-
 /*
- * Returns TRUE if a partition on the same disk is already being
- * checked.
+ * Returns TRUE if a filesystem on the same disk (or on a disk used by the
+ * same dm/md stack) is already being checked.
  */
 static int disk_already_active(struct libmnt_fs *fs)
 {
 	struct fsck_instance *inst;
-	dev_t disk;
+	struct fsck_fs_data *data;
 
 	if (force_all_parallel)
 		return 0;
 
-	if (instance_list && fs_is_stacked(instance_list->fs))
-		/* any instance for a stacked device is already running */
-		return 1;
-
-	disk = fs_get_disk(fs, 1);
+	data = fs_get_topology(fs);
 
 	/*
-	 * If we don't know the base device, assume that the device is
-	 * already active if there are any fsck instances running.
-	 *
-	 * Don't check a stacked device with any other disk too.
+	 * If we don't know the disks, assume that the device is already
+	 * active if there are any fsck instances running.
 	 */
-	if (!disk || fs_is_stacked(fs))
+	if (!data->ndisks)
 		return (instance_list != NULL);
 
 	for (inst = instance_list; inst; inst = inst->next) {
-		dev_t idisk = fs_get_disk(inst->fs, 0);
-
-		if (!idisk || disk == idisk)
+		if (fs_share_disks(data, fs_get_topology(inst->fs)))
 			return 1;
 	}
 
 	return 0;
 }
 
+/*
+ * The most expensive checks first, fstab order for the same cost.
+ */
+struct fsck_job {
+	struct libmnt_fs	*fs;
+	size_t			idx;
+};
+
+static int cmp_fsck_jobs(const void *a, const void *b)
+{
+	const struct fsck_job *x = a, *y = b;
+	unsigned long long xc = fs_get_topology(x->fs)->cost,
+			   yc = fs_get_topology(y->fs)->cost;
+
+	if (xc != yc)
+		return xc > yc ? -1 : 1;
+	return x->idx < y->idx ? -1 : x->idx > y->idx ? 1 : 0;
+}
+
 /* Check all file systems, using the /etc/fstab table. */
 static int check_all(void)
 {
@@ -1247,6 +1416,8 @@ static int check_all(void)
 	int passno = 1;
 	int pass_done;
 	int status = FSCK_EX_OK;
+	struct fsck_job *jobs = NULL;
+	size_t i, njobs = 0;
 
 	struct libmnt_fs *fs;
 	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
@@ -1304,13 +1475,39 @@ static int check_all(void)
 		}
 	}
 
+	/*
+	 * Order the remaining filesystems by the estimated cost of the check,
+	 * so the longest checks are started first on the independent disks.
+	 */
+	mnt_reset_iter(itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		if (fs_is_done(fs))
+			continue;
+		jobs = xrealloc(jobs, (njobs + 1) * sizeof(struct fsck_job));
+		jobs[njobs].fs = fs;
+		jobs[njobs].idx = njobs;
+		njobs++;
+	}
+	if (njobs > 1 && !serialize)
+		qsort(jobs, njobs, sizeof(struct fsck_job), cmp_fsck_jobs);
+
+	if (verbose > 1) {
+		for (i = 0; i < njobs; i++) {
+			struct fsck_fs_data *data = fs_get_topology(jobs[i].fs);
+
+			printf(_("%s: pass %d, cost %llu, %zu disk(s)\n"),
+				fs_get_device(jobs[i].fs),
+				mnt_fs_get_passno(jobs[i].fs),
+				data->cost, data->ndisks);
+		}
+	}
+
 	while (not_done_yet) {
 		not_done_yet = 0;
 		pass_done = 1;
 
-		mnt_reset_iter(itr, MNT_ITER_FORWARD);
-
-		while(mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		for (i = 0; i < njobs; i++) {
+			fs = jobs[i].fs;
 
 			if (cancel_requested)
 				break;
@@ -1377,6 +1574,7 @@ static int check_all(void)
 
 	status |= wait_many(FLAG_WAIT_ATLEAST_ONE);
 	mnt_free_iter(itr);
+	free(jobs);
 	return status;
 }
 
@@ -1405,6 +1603,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -t <type>  specify filesystem types to be checked;\n"
 		"            <type> is allowed to be a comma-separated list\n"), out);
 	fputs(_(" -V         explain what is being done\n"), out);
+	fputs(_("     --summary <file>\n"
+		"            write JSON timing of each checked filesystem to <file>\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf( " -?, --help     %s\n", USAGE_OPTSTR_HELP);
@@ -1454,6 +1654,17 @@ static void parse_argv(int argc, char *argv[])
 			printf(UTIL_LINUX_VERSION);
 			exit(FSCK_EX_OK);
 		}
+		if (!opts_for_fsck && (!strcmp(arg, "--summary") ||
+				       !strncmp(arg, "--summary=", 10))) {
+			tmp = arg[9] == '=' ? arg + 10 : argv[++i];
+			if (!tmp || !*tmp)
+				errx(FSCK_EX_USAGE,
+					_("option '%s' requires an argument"), "--summary");
+			summary_file = fopen(tmp, "w" UL_CLOEXECSTR);
+			if (!summary_file)
+				err(FSCK_EX_ERROR, _("cannot open %s"), tmp);
+			continue;
+		}
 
 		if ((arg[0] == '/' && !opts_for_fsck) || strchr(arg, '=')) {
 			if (num_devices >= MAX_DEVICES)
@@ -35,6 +35,7 @@
 #include <errno.h>
 #include <string.h>
 #include <getopt.h>
+#include <sys/wait.h>
 #include <zconf.h>
 
 /* We don't use our include/crc32.h, but crc32 from zlib!
@@ -50,6 +51,7 @@
 #include "nls.h"
 #include "exitcodes.h"
 #include "strutils.h"
+#include "all-io.h"
 
 #define CLOSE_EXIT_CODE	 MKFS_EX_ERROR
 #include "closestream.h"
@@ -81,6 +83,7 @@ static int opt_holes = 0;
 static int opt_pad = 0;
 static char *opt_image = NULL;
 static char *opt_name = NULL;
+static unsigned int opt_jobs = 1;
 
 static int warn_dev = 0;
 static int warn_gid = 0;
@@ -122,11 +125,31 @@ struct entry {
 #define CRAMFS_GID_WIDTH 8
 #define CRAMFS_OFFSET_WIDTH 26
 
+/*
+ * With -j the data are compressed by worker processes. The blocks are split
+ * to jobs of up to CRAMFS_JOB_BLOCKS blocks and the n-th job is compressed by
+ * the (n % opt_jobs)-th worker.  The parent reads the jobs in the order of
+ * the image, so the image is the same as without -j.
+ */
+#define CRAMFS_JOB_BLOCKS 32
+
+struct compress_job {
+	struct entry *entry;
+	unsigned int first;	    /* first block of the job */
+	unsigned int nblocks;
+};
+
+static struct compress_job *jobs;
+static size_t njobs, cur_job;
+static unsigned int cur_block;	    /* block in the current job */
+static pid_t *worker_pids;
+static int *worker_fds;
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	printf(
 		_("usage: %s [-h] [-v] [-b blksize] [-e edition] [-N endian] [-i file] "
-		  "[-n name] dirname outfile\n"
+		  "[-j jobs] [-n name] dirname outfile\n"
 		  " -v         be verbose\n"
 		  " -E         make all warnings errors "
 		    "(non-zero exit status)\n"
@@ -134,6 +157,7 @@ static void __attribute__((__noreturn__)) usage(void)
 		  " -e edition set edition number (part of fsid)\n"
 		  " -N endian  set cramfs endianness (big|little|host), default host\n"
 		  " -i file    insert a file image into the filesystem\n"
+		  " -j jobs    compress the data by <jobs> processes\n"
 		  " -n name    set name of cramfs filesystem\n"
 		  " -p         pad by %d bytes for boot code\n"
 		  " -s         sort directory entries (old option, ignored)\n"
@@ -242,38 +266,111 @@ identical_file(struct entry *e1, struct entry *e2){
  */
 #define MAX_INPUT_NAMELEN 255
 
-static int find_identical_file(struct entry *orig, struct entry *new, loff_t *fslen_ub)
+/* regular files and symlinks with data, in the order of the tree */
+static void collect_data_entries(struct entry *e, struct entry ***list,
+				 size_t *nlist, size_t *listsz)
 {
-	if (orig == new)
-		return 1;
-	if (!orig)
-		return 0;
-	if (orig->size == new->size && orig->path) {
-		if (!orig->flags)
-			mdfile(orig);
-		if (!new->flags)
-			mdfile(new);
-
-		if ((orig->flags & CRAMFS_EFLAG_MD5) &&
-		    (new->flags & CRAMFS_EFLAG_MD5) &&
-		    !memcmp(orig->md5sum, new->md5sum, UL_MD5LENGTH) &&
-		    identical_file(orig, new)) {
-			new->same = orig;
-			*fslen_ub -= new->size;
-			return 1;
+	for (; e; e = e->next) {
+		if (e->size && e->path) {
+			if (*nlist == *listsz) {
+				*listsz = *listsz ? *listsz * 2 : 256;
+				*list = xrealloc(*list, *listsz * sizeof(struct entry *));
+			}
+			(*list)[(*nlist)++] = e;
 		}
+		collect_data_entries(e->child, list, nlist, listsz);
+	}
+}
+
+/* sorts by size and keeps the tree order for the same sizes */
+static int cmp_entry_size(const void *a, const void *b)
+{
+	const struct entry *e1 = *(struct entry * const *) a;
+	const struct entry *e2 = *(struct entry * const *) b;
+
+	if (e1->size != e2->size)
+		return e1->size < e2->size ? -1 : 1;
+	return e1->dir_offset < e2->dir_offset ? -1 :
+	       e1->dir_offset > e2->dir_offset ? 1 : 0;
+}
+
+/* sorts by size and md5 digest and keeps the tree order for the same data */
+static int cmp_entry_md5(const void *a, const void *b)
+{
+	const struct entry *e1 = *(struct entry * const *) a;
+	const struct entry *e2 = *(struct entry * const *) b;
+	int rc;
+
+	if (e1->size != e2->size)
+		return e1->size < e2->size ? -1 : 1;
+	if ((e1->flags & CRAMFS_EFLAG_MD5) != (e2->flags & CRAMFS_EFLAG_MD5))
+		return (e1->flags & CRAMFS_EFLAG_MD5) ? 1 : -1;
+	if (e1->flags & CRAMFS_EFLAG_MD5) {
+		rc = memcmp(e1->md5sum, e2->md5sum, UL_MD5LENGTH);
+		if (rc)
+			return rc;
 	}
-	return find_identical_file(orig->child, new, fslen_ub) ||
-		   find_identical_file(orig->next, new, fslen_ub);
+	return e1->dir_offset < e2->dir_offset ? -1 :
+	       e1->dir_offset > e2->dir_offset ? 1 : 0;
 }
 
-static void eliminate_doubles(struct entry *root, struct entry *orig, loff_t *fslen_ub) {
-	if (orig) {
-		if (orig->size && orig->path)
-			find_identical_file(root,orig, fslen_ub);
-		eliminate_doubles(root,orig->child, fslen_ub);
-		eliminate_doubles(root,orig->next, fslen_ub);
+/*
+ * Links every file to the first identical file in the tree order. The files
+ * are sorted by size and md5sums are computed only for the files with the
+ * same size, so the files with identical data are next to each other.
+ *
+ * The dir_offset is not used yet, it temporarily keeps the tree order.
+ */
+static void eliminate_doubles(struct entry *root, loff_t *fslen_ub)
+{
+	struct entry **list = NULL;
+	size_t nlist = 0, listsz = 0, i, j, k;
+
+	collect_data_entries(root->child, &list, &nlist, &listsz);
+	for (i = 0; i < nlist; i++)
+		list[i]->dir_offset = i;
+
+	qsort(list, nlist, sizeof(struct entry *), cmp_entry_size);
+
+	for (i = 0; i < nlist; i = j) {
+		for (j = i + 1; j < nlist && list[j]->size == list[i]->size; j++)
+			;
+		if (j - i == 1)
+			continue;
+		for (k = i; k < j; k++)
+			mdfile(list[k]);
+	}
+
+	qsort(list, nlist, sizeof(struct entry *), cmp_entry_md5);
+
+	for (i = 0; i < nlist; i = j) {
+		struct entry *e = list[i];
+
+		for (j = i + 1; j < nlist && list[j]->size == e->size &&
+			    (e->flags & CRAMFS_EFLAG_MD5) &&
+			    (list[j]->flags & CRAMFS_EFLAG_MD5) &&
+			    !memcmp(list[j]->md5sum, e->md5sum, UL_MD5LENGTH); j++)
+			;
+
+		/* md5 digests are equal, compare the data to be sure */
+		for (k = i + 1; k < j; k++) {
+			size_t l;
+
+			for (l = i; l < k; l++) {
+				if (list[l]->same)
+					continue;
+				if (identical_file(list[l], list[k])) {
+					list[k]->same = list[l];
+					*fslen_ub -= list[k]->size;
+					break;
+				}
+			}
+		}
 	}
+
+	for (i = 0; i < nlist; i++)
+		list[i]->dir_offset = 0;
+	free(list);
 }
 
 /*
@@ -552,6 +649,211 @@ static int is_zero(unsigned char const *begin, unsigned len)
 		return 0;
 }
 
+/* Returns the compressed size of the block or 0 for a hole. */
+static uLongf compress_block(Bytef *dest, Bytef const *src, uLongf input)
+{
+	uLongf len = 2 * blksize;
+
+	if (is_zero(src, input))
+		return 0;
+	compress(dest, &len, src, input);
+	return len;
+}
+
+/*
+ * The worker sends the status of the job (0 or -1 if the file cannot be read)
+ * and then the length and the compressed data of every block of the job.
+ */
+static void __attribute__((__noreturn__))
+compress_worker(size_t first, int fd)
+{
+	Bytef *buf = xmalloc(2 * blksize);
+	size_t i;
+
+	for (i = first; i < njobs; i += opt_jobs) {
+		struct compress_job *job = &jobs[i];
+		struct entry *e = job->entry;
+		unsigned int b, size;
+		int32_t status = 0;
+		char *start;
+		Bytef *p;
+
+		start = do_mmap(e->path, e->size, e->mode);
+		if (!start)
+			status = -1;
+		if (write_all(fd, &status, sizeof(status)))
+			_exit(MKFS_EX_ERROR);
+		if (!start)
+			continue;
+
+		p = (Bytef *) start + (size_t) job->first * blksize;
+		size = e->size - job->first * blksize;
+
+		for (b = 0; b < job->nblocks; b++) {
+			uLongf input = min(size, blksize);
+			uint32_t len = compress_block(buf, p, input);
+
+			if (write_all(fd, &len, sizeof(len)) ||
+			    write_all(fd, buf, len))
+				_exit(MKFS_EX_ERROR);
+			p += input;
+			size -= input;
+		}
+		do_munmap(start, e->size, e->mode);
+	}
+	_exit(MKFS_EX_OK);
+}
+
+static void add_compress_jobs(struct entry *entry, size_t *jobssz)
+{
+	struct entry *e;
+
+	for (e = entry; e; e = e->next) {
+		if (e->path) {
+			unsigned int blocks, first;
+
+			if (e->same || !e->size)
+				continue;
+
+			blocks = (e->size - 1) / blksize + 1;
+			for (first = 0; first < blocks; first += CRAMFS_JOB_BLOCKS) {
+				if (njobs == *jobssz) {
+					*jobssz = *jobssz ? *jobssz * 2 : 256;
+					jobs = xrealloc(jobs, *jobssz * sizeof(*jobs));
+				}
+				jobs[njobs].entry = e;
+				jobs[njobs].first = first;
+				jobs[njobs].nblocks = min(blocks - first,
+						(unsigned int) CRAMFS_JOB_BLOCKS);
+				njobs++;
+			}
+		} else if (e->child)
+			add_compress_jobs(e->child, jobssz);
+	}
+}
+
+/* splits the data of the entries in the same order as write_data() does */
+static void start_compress_workers(struct entry *root)
+{
+	size_t jobssz = 0, i;
+
+	add_compress_jobs(root, &jobssz);
+	if (njobs < opt_jobs)
+		opt_jobs = njobs;
+	if (opt_jobs <= 1) {
+		opt_jobs = 1;
+		return;
+	}
+
+	worker_pids = xcalloc(opt_jobs, sizeof(pid_t));
+	worker_fds = xcalloc(opt_jobs, sizeof(int));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < opt_jobs; i++) {
+		int pfd[2];
+
+		if (pipe(pfd) != 0)
+			err(MKFS_EX_ERROR, _("cannot create pipe"));
+#ifdef F_SETPIPE_SZ
+		/* let the worker go ahead of the parent, errors are harmless */
+		fcntl(pfd[1], F_SETPIPE_SZ, 1024 * 1024);
+#endif
+		worker_pids[i] = fork();
+		if (worker_pids[i] < 0)
+			err(MKFS_EX_ERROR, _("fork failed"));
+		if (worker_pids[i] == 0) {
+			size_t j;
+
+			for (j = 0; j < i; j++)
+				close(worker_fds[j]);
+			close(pfd[0]);
+			compress_worker(i, pfd[1]);
+		}
+		close(pfd[1]);
+		worker_fds[i] = pfd[0];
+	}
+}
+
+static void wait_compress_workers(void)
+{
+	size_t i;
+	int status;
+
+	if (opt_jobs <= 1)
+		return;
+
+	for (i = 0; i < opt_jobs; i++) {
+		close(worker_fds[i]);
+		if (waitpid(worker_pids[i], &status, 0) < 0 || !WIFEXITED(status)
+		    || WEXITSTATUS(status) != MKFS_EX_OK)
+			errx(MKFS_EX_ERROR, _("compression process failed"));
+	}
+	free(worker_pids);
+	free(worker_fds);
+	free(jobs);
+}
+
+static void read_from_worker(void *buf, size_t len)
+{
+	int fd = worker_fds[cur_job % opt_jobs];
+
+	if (read_all(fd, buf, len) != (ssize_t) len)
+		errx(MKFS_EX_ERROR, _("compression process failed"));
+}
+
+/* Reads the status of the current job. */
+static int begin_job(void)
+{
+	int32_t status;
+
+	if (cur_job >= njobs)
+		errx(MKFS_EX_ERROR, _("compression process failed"));
+	read_from_worker(&status, sizeof(status));
+	cur_block = 0;
+	if (status)
+		warn_skip = 1;
+	return status;
+}
+
+/* Reads the next compressed block of the current file to @dest. */
+static uLongf read_compressed_block(Bytef *dest)
+{
+	uint32_t len;
+
+	if (cur_block == jobs[cur_job].nblocks) {
+		cur_job++;
+		if (begin_job() != 0)
+			errx(MKFS_EX_ERROR, _("cannot read %s"),
+			     jobs[cur_job].entry->path);
+	}
+	read_from_worker(&len, sizeof(len));
+	if (len > blksize * 2)
+		errx(MKFS_EX_ERROR, _("compression process failed"));
+	if (len)
+		read_from_worker(dest, len);
+	cur_block++;
+	return len;
+}
+
+/* The file cannot be read, drops the rest of its jobs. */
+static void skip_jobs(void)
+{
+	struct entry *e = jobs[cur_job].entry;
+	Bytef *buf = NULL;
+
+	while (++cur_job < njobs && jobs[cur_job].entry == e) {
+		if (begin_job() != 0)
+			continue;
+		if (!buf)
+			buf = xmalloc(2 * blksize);
+		while (cur_block < jobs[cur_job].nblocks)
+			read_compressed_block(buf);
+	}
+	free(buf);
+}
+
 /*
  * One 4-byte pointer per block and then the actual blocked
  * output. The first block does not need an offset pointer,
@@ -572,9 +874,17 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 	Bytef *p;
 
 	/* get uncompressed data */
-	start = do_mmap(path, size, mode);
-	if (start == NULL)
-		return offset;
+	if (opt_jobs > 1) {
+		start = NULL;
+		if (begin_job() != 0) {
+			skip_jobs();
+			return offset;
+		}
+	} else {
+		start = do_mmap(path, size, mode);
+		if (start == NULL)
+			return offset;
+	}
 	p = (Bytef *) start;
 
 	original_size = size;
@@ -585,16 +895,18 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 	total_blocks += blocks;
 
 	do {
-		uLongf len = 2 * blksize;
+		uLongf len;
 		uLongf input = size;
 		if (input > blksize)
 			input = blksize;
 		size -= input;
-		if (!is_zero (p, input)) {
-			compress((Bytef *)(base + curr), &len, p, input);
-			curr += len;
+		if (opt_jobs > 1)
+			len = read_compressed_block((Bytef *)(base + curr));
+		else {
+			len = compress_block((Bytef *)(base + curr), p, input);
+			p += input;
 		}
-		p += input;
+		curr += len;
 
 		if (len > blksize*2) {
 			/* (I don't think this can happen with zlib.) */
@@ -608,7 +920,10 @@ do_compress(char *base, unsigned int offset, unsigned char const *name,
 		offset += 4;
 	} while (size);
 
-	do_munmap(start, original_size, mode);
+	if (opt_jobs > 1)
+		cur_job++;
+	else
+		do_munmap(start, original_size, mode);
 
 	curr = (curr + 3) & ~3;
 	new_size = curr - original_offset;
@@ -728,7 +1043,7 @@ int main(int argc, char **argv)
 	strutils_set_exitcode(MKFS_EX_USAGE);
 
 	/* command line options */
-	while ((c = getopt(argc, argv, "hb:Ee:i:n:N:psVvz")) != EOF) {
+	while ((c = getopt(argc, argv, "hb:Ee:i:j:n:N:psVvz")) != EOF) {
 		switch (c) {
 		case 'h':
 			usage();
@@ -759,6 +1074,11 @@ int main(int argc, char **argv)
 			image_length = st.st_size; /* may be padded later */
 			fslen_ub += (image_length + 3); /* 3 is for padding */
 			break;
+		case 'j':
+			opt_jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!opt_jobs)
+				errx(MKFS_EX_USAGE, _("invalid jobs argument"));
+			break;
 		case 'n':
 			opt_name = optarg;
 			break;
@@ -807,7 +1127,7 @@ int main(int argc, char **argv)
 	root_entry->size = parse_directory(root_entry, dirname, &root_entry->child, &fslen_ub);
 
 	/* find duplicate files */
-	eliminate_doubles(root_entry,root_entry, &fslen_ub);
+	eliminate_doubles(root_entry, &fslen_ub);
 
 	/* always allocate a multiple of blksize bytes because that's
 	   what we're going to write later on */
@@ -859,7 +1179,9 @@ int main(int argc, char **argv)
 	if (verbose)
 		printf(_("Directory data: %zd bytes\n"), offset);
 
+	start_compress_workers(root_entry);
 	offset = write_data(root_entry, rom_image, offset);
+	wait_compress_workers();
 
 	/* We always write a multiple of blksize bytes, so that
 	   losetup works. */
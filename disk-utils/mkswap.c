@@ -16,6 +16,8 @@
 #include <limits.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <getopt.h>
 #include <assert.h>
@@ -35,6 +37,7 @@
 #include "c.h"
 #include "closestream.h"
 #include "ismounted.h"
+#include "monotonic.h"
 
 #ifdef HAVE_LIBUUID
 # include <uuid.h>
@@ -46,6 +49,9 @@
 
 #define MIN_GOODPAGES	10
 
+/* --check reads the device by extents of this size */
+#define CHECK_EXTENT_SIZE	(4 * 1024 * 1024)
+
 #define SELINUX_SWAPFILE_TYPE	"swapfile_t"
 
 struct mkswap_control {
@@ -58,6 +64,7 @@ struct mkswap_control {
 
 	unsigned long long	npages;		/* number of pages */
 	unsigned long		nbadpages;	/* number of bad pages */
+	size_t			njobs;		/* --jobs */
 
 	int			user_pagesize;	/* --pagesize */
 	int			pagesize;	/* final pagesize used for the header */
@@ -155,6 +162,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fprintf(out, _(
 		"\nOptions:\n"
 		" -c, --check               check bad blocks before creating the swap area\n"
+		" -j, --jobs NUM            check the device by NUM processes in parallel\n"
 		" -f, --force               allow swap size area be larger than device\n"
 		" -p, --pagesize SIZE       specify page size in bytes\n"
 		" -L, --label LABEL         specify label\n"
@@ -179,31 +187,249 @@ static void page_bad(struct mkswap_control *ctl, unsigned int page)
 	ctl->nbadpages++;
 }
 
+/*
+ * --check state, every worker process has its own copy
+ */
+struct check_control {
+	struct mkswap_control	*ctl;
+
+	int			fd;		/* device opened for reading */
+	char			*buf;		/* aligned CHECK_EXTENT_SIZE buffer */
+	unsigned long long	extent;		/* extent size in pages */
+	int			msgfd;		/* pipe to the parent or -1 */
+
+	unsigned long long	done;		/* already checked pages */
+	struct timeval		start;		/* begin of the check */
+	struct timeval		last;		/* last progress report */
+
+	unsigned int		progress:1,	/* report progress to terminal */
+				direct:1;	/* fd opened with O_DIRECT */
+};
+
+/* message from a worker process to the parent */
+struct check_msg {
+	unsigned long long	page;		/* first checked page */
+	unsigned long long	npages;		/* number of checked pages */
+	int			bad;		/* the page is unreadable */
+};
+
+static double time_diff(const struct timeval *a, const struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1E6;
+}
+
+static char *check_throughput(const struct check_control *cc, double sec)
+{
+	uint64_t bytes = cc->done * cc->ctl->pagesize;
+
+	if (sec > 0)
+		bytes /= sec;
+	return size_to_human_string(SIZE_SUFFIX_1LETTER, bytes);
+}
+
+static void check_progress(struct check_control *cc)
+{
+	struct timeval now;
+	char *speed;
+
+	gettime_monotonic(&now);
+	if (time_diff(&now, &cc->last) < 1 && cc->done < cc->ctl->npages)
+		return;
+	cc->last = now;
+
+	speed = check_throughput(cc, time_diff(&now, &cc->start));
+	printf(_("\rchecking bad pages: %3llu%% (%s/s)"),
+		cc->done * 100 / cc->ctl->npages, speed);
+	fflush(stdout);
+	free(speed);
+}
+
+static void check_account(struct check_control *cc, const struct check_msg *msg)
+{
+	if (msg->bad)
+		page_bad(cc->ctl, msg->page);
+	cc->done += msg->npages;
+	if (cc->progress)
+		check_progress(cc);
+}
+
+static void check_report(struct check_control *cc, unsigned long long page,
+			 unsigned long long npages, int bad)
+{
+	struct check_msg msg = { .page = page, .npages = npages, .bad = bad };
+
+	if (cc->msgfd < 0)
+		check_account(cc, &msg);
+	else if (write_all(cc->msgfd, &msg, sizeof(msg)))
+		err(EXIT_FAILURE, _("write failed"));
+}
+
+/*
+ * O_DIRECT reads may fail with EINVAL (alignment or filesystem limits), it's
+ * not a media error. Reopens the device for buffered reads.
+ */
+static void check_reopen_buffered(struct check_control *cc)
+{
+	struct mkswap_control *ctl = cc->ctl;
+
+	close(cc->fd);
+	cc->fd = open(ctl->devname, O_RDONLY | O_CLOEXEC);
+	if (cc->fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->devname);
+	cc->direct = 0;
+}
+
+/*
+ * Reads @npages pages from @page. The extent is split to halves on error,
+ * until the unreadable pages are found.
+ */
+static void check_extent(struct check_control *cc, unsigned long long page,
+			 unsigned long long npages)
+{
+	size_t pagesize = cc->ctl->pagesize;
+	size_t sz = npages * pagesize;
+	unsigned long long half;
+	ssize_t rc;
+
+	rc = pread(cc->fd, cc->buf, sz, page * pagesize);
+	if (rc < 0 && errno == EINVAL && cc->direct) {
+		check_reopen_buffered(cc);
+		rc = pread(cc->fd, cc->buf, sz, page * pagesize);
+	}
+	if (rc == (ssize_t) sz) {
+		check_report(cc, page, npages, 0);
+		return;
+	}
+	if (npages == 1) {
+		check_report(cc, page, 1, 1);
+		return;
+	}
+	half = npages / 2;
+	check_extent(cc, page, half);
+	check_extent(cc, page + half, npages - half);
+}
+
+static void check_range(struct check_control *cc, unsigned long long first,
+			unsigned long long last)
+{
+	unsigned long long page;
+
+	for (page = first; page < last; page += cc->extent)
+		check_extent(cc, page, min(cc->extent, last - page));
+}
+
+static void check_open(struct check_control *cc)
+{
+	struct mkswap_control *ctl = cc->ctl;
+	size_t align = max((size_t) ctl->pagesize, (size_t) 4096);
+
+	/* O_DIRECT to read the media rather than the page cache */
+	cc->fd = open(ctl->devname, O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if (cc->fd >= 0)
+		cc->direct = 1;
+	else
+		cc->fd = open(ctl->devname, O_RDONLY | O_CLOEXEC);
+	if (cc->fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->devname);
+
+	cc->extent = max(CHECK_EXTENT_SIZE / ctl->pagesize, 1);
+	if (posix_memalign((void **) &cc->buf, align,
+			   cc->extent * ctl->pagesize))
+		err(EXIT_FAILURE, _("failed to allocate check buffer"));
+}
+
+static void check_parallel(struct check_control *cc)
+{
+	struct mkswap_control *ctl = cc->ctl;
+	unsigned long long chunk, first = 0;
+	struct check_msg msg;
+	int pipefd[2], status, rc = 0;
+	size_t i, nworkers = 0;
+	pid_t pid;
+
+	if (pipe(pipefd) != 0)
+		err(EXIT_FAILURE, _("cannot create pipe"));
+
+	/* split the device to ranges aligned to the extent size */
+	chunk = (ctl->npages + ctl->njobs - 1) / ctl->njobs;
+	chunk = (chunk + cc->extent - 1) / cc->extent * cc->extent;
+
+	fflush(stdout);
+	for (i = 0; i < ctl->njobs && first < ctl->npages; i++) {
+		unsigned long long last = min(first + chunk, ctl->npages);
+
+		pid = fork();
+		if (pid < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (pid == 0) {
+			close(pipefd[0]);
+			cc->msgfd = pipefd[1];
+			check_range(cc, first, last);
+			_exit(EXIT_SUCCESS);
+		}
+		nworkers++;
+		first = last;
+	}
+	close(pipefd[1]);
+
+	/* the messages are smaller than PIPE_BUF, so the writes are atomic */
+	while (read_all(pipefd[0], (char *) &msg, sizeof(msg)) == sizeof(msg))
+		check_account(cc, &msg);
+	close(pipefd[0]);
+
+	for (i = 0; i < nworkers; i++) {
+		if (wait(&status) < 0)
+			err(EXIT_FAILURE, _("waitpid failed"));
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = 1;
+	}
+	if (rc)
+		errx(EXIT_FAILURE, _("bad pages check failed"));
+}
+
+static int cmp_pages(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a,
+		     y = *(const unsigned int *) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
 static void check_blocks(struct mkswap_control *ctl)
 {
-	unsigned int current_page = 0;
-	int do_seek = 1;
-	char *buffer;
+	struct check_control cc = { .ctl = ctl, .msgfd = -1 };
+	struct timeval now;
+	char *speed;
 
 	assert(ctl);
 	assert(ctl->fd > -1);
 
-	buffer = xmalloc(ctl->pagesize);
-	while (current_page < ctl->npages) {
-		ssize_t rc;
+	check_open(&cc);
+	cc.progress = isatty(STDOUT_FILENO) ? 1 : 0;
+	gettime_monotonic(&cc.start);
+	cc.last = cc.start;
 
-		if (do_seek && lseek(ctl->fd, current_page * ctl->pagesize, SEEK_SET) !=
-		    current_page * ctl->pagesize)
-			errx(EXIT_FAILURE, _("seek failed in check_blocks"));
+	if (ctl->njobs > 1)
+		check_parallel(&cc);
+	else
+		check_range(&cc, 0, ctl->npages);
+
+	gettime_monotonic(&now);
+	if (cc.progress)
+		fputc('\n', stdout);
+
+	/* the workers report the bad pages in random order */
+	qsort(ctl->hdr->badpages, ctl->nbadpages, sizeof(unsigned int), cmp_pages);
 
-		rc = read(ctl->fd, buffer, ctl->pagesize);
-		do_seek = (rc < 0 || rc != ctl->pagesize);
-		if (do_seek)
-			page_bad(ctl, current_page);
-		current_page++;
-	}
 	printf(P_("%lu bad page\n", "%lu bad pages\n", ctl->nbadpages), ctl->nbadpages);
-	free(buffer);
+
+	speed = check_throughput(&cc, time_diff(&now, &cc.start));
+	printf(_("checked %llu pages in %.3f seconds (%s/s)\n"),
+		cc.done, time_diff(&now, &cc.start), speed);
+	free(speed);
+
+	free(cc.buf);
+	close(cc.fd);
 }
 
 /* return size in pages */
@@ -355,6 +581,7 @@ int main(int argc, char **argv)
 #endif
 	static const struct option longopts[] = {
 		{ "check",       no_argument,       NULL, 'c' },
+		{ "jobs",        required_argument, NULL, 'j' },
 		{ "force",       no_argument,       NULL, 'f' },
 		{ "pagesize",    required_argument, NULL, 'p' },
 		{ "label",       required_argument, NULL, 'L' },
@@ -370,11 +597,16 @@ int main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while((c = getopt_long(argc, argv, "cfp:L:v:U:Vh", longopts, NULL)) != -1) {
+	while((c = getopt_long(argc, argv, "cfj:p:L:v:U:Vh", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'c':
 			ctl.check = 1;
 			break;
+		case 'j':
+			ctl.njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.njobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'f':
 			ctl.force = 1;
 			break;
@@ -417,6 +649,9 @@ int main(int argc, char **argv)
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	if (ctl.njobs && !ctl.check)
+		errx(EXIT_FAILURE, _("--jobs requires --check"));
+
 #ifdef HAVE_LIBUUID
 	if(opt_uuid) {
 		if (uuid_parse(opt_uuid, uuid_dat) != 0)
@@ -253,6 +253,10 @@ extern struct blkid_config *blkid_read_config(const char *filename)
 			__ul_attribute__((warn_unused_result));
 extern void blkid_free_config(struct blkid_config *conf);
 
+/* evaluate.c, blkid_evaluate_tag() data kept in the cache */
+struct blkid_struct_evaluate;
+extern void blkid_free_evaluate(struct blkid_struct_evaluate *ev);
+
 /*
  * Minimum number of seconds between device probes, even when reading
  * from the cache.  This is to avoid re-probing all devices which were
@@ -282,6 +286,7 @@ struct blkid_struct_cache
 	unsigned int		bic_flags;	/* Status flags of the cache */
 	char			*bic_filename;	/* filename of cache */
 	blkid_probe		probe;		/* low-level probing stuff */
+	struct blkid_struct_evaluate *bic_evaluate; /* blkid_evaluate_tag() index */
 };
 
 #define BLKID_BIC_FL_PROBED	0x0002	/* We probed /proc/partition devices */
@@ -161,6 +161,7 @@ void blkid_put_cache(blkid_cache cache)
 	}
 
 	blkid_free_probe(cache->probe);
+	blkid_free_evaluate(cache->bic_evaluate);
 
 	free(cache->bic_filename);
 	free(cache);
@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <sys/types.h>
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
@@ -25,6 +26,7 @@
 #include "pathnames.h"
 #include "canonicalize.h"
 #include "closestream.h"
+#include "env.h"
 
 #include "blkidP.h"
 
@@ -45,6 +47,12 @@
  * The blkid_evaluate_tag() also automatically informs udevd when an obsolete
  * /dev/disk/by-* symlink is detected.
  *
+ * If the @cache argument is not NULL, the /dev/disk/by-* directories are read
+ * only once per cache and the result is kept in the cache together with the
+ * already resolved device names. The index is re-read when the directory
+ * modification time is changed, so the evaluation of many tags (for example
+ * by "mount -a") costs one stat() per tag for the already known devices.
+ *
  * If you are not sure how translate LABEL or UUID to the device name use this
  * API.
  */
@@ -132,47 +140,232 @@ int blkid_send_uevent(const char *devname, const char *action)
 	return rc;
 }
 
-static char *evaluate_by_udev(const char *token, const char *value, int uevent)
+static const struct udev_dir {
+	const char	*token;		/* LABEL, UUID, ... */
+	const char	*dir;		/* /dev/disk/by-* */
+} udev_dirs[] = {
+	{ "UUID",	_PATH_DEV_BYUUID },
+	{ "LABEL",	_PATH_DEV_BYLABEL },
+	{ "PARTUUID",	_PATH_DEV_BYPARTUUID },
+	{ "PARTLABEL",	_PATH_DEV_BYPARTLABEL }
+};
+
+/*
+ * Index of the /dev/disk/by-* directories, kept in the blkid cache
+ */
+struct udev_link {
+	char		*name;		/* encoded tag value (link name) */
+	char		*path;		/* canonicalized device name or NULL */
+};
+
+struct udev_index {
+	int		loaded;		/* links[] read from the directory */
+	dev_t		dir_dev;	/* dir identity and modification time */
+	ino_t		dir_ino;
+	struct timespec	dir_mtime;
+
+	struct udev_link *links;	/* sorted by name */
+	size_t		nlinks;
+};
+
+struct blkid_struct_evaluate {
+	struct udev_index	udev[ARRAY_SIZE(udev_dirs)];
+
+	struct blkid_config	*conf;		/* the config file is read only once */
+	char			*conf_file;	/* ... and again when modified */
+	struct timespec		conf_mtime;
+};
+
+static void reset_udev_index(struct udev_index *idx)
+{
+	size_t i;
+
+	for (i = 0; i < idx->nlinks; i++) {
+		free(idx->links[i].name);
+		free(idx->links[i].path);
+	}
+	free(idx->links);
+	idx->links = NULL;
+	idx->nlinks = 0;
+	idx->loaded = 0;
+}
+
+static int cmp_udev_links(const void *a, const void *b)
+{
+	return strcmp(((const struct udev_link *) a)->name,
+		      ((const struct udev_link *) b)->name);
+}
+
+static void get_mtime(const struct stat *st, struct timespec *ts)
+{
+	ts->tv_sec = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+	ts->tv_nsec = st->st_mtim.tv_nsec;
+#else
+	ts->tv_nsec = 0;
+#endif
+}
+
+static int load_udev_index(struct udev_index *idx, const char *dirname,
+			   const struct stat *st)
+{
+	DIR *dir;
+	struct dirent *d;
+	size_t nallocs = 0;
+
+	reset_udev_index(idx);
+
+	dir = opendir(dirname);
+	if (!dir)
+		return -errno;
+
+	while ((d = readdir(dir))) {
+		struct udev_link *l;
+
+		if (d->d_name[0] == '.')
+			continue;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (d->d_type != DT_LNK && d->d_type != DT_UNKNOWN)
+			continue;
+#endif
+		if (idx->nlinks == nallocs) {
+			struct udev_link *tmp;
+
+			nallocs = nallocs ? nallocs * 2 : 64;
+			tmp = realloc(idx->links, nallocs * sizeof(*tmp));
+			if (!tmp)
+				goto nomem;
+			idx->links = tmp;
+		}
+		l = &idx->links[idx->nlinks];
+		l->path = NULL;
+		l->name = strdup(d->d_name);
+		if (!l->name)
+			goto nomem;
+		idx->nlinks++;
+	}
+	closedir(dir);
+
+	if (idx->nlinks)
+		qsort(idx->links, idx->nlinks, sizeof(struct udev_link),
+				cmp_udev_links);
+
+	idx->dir_dev = st->st_dev;
+	idx->dir_ino = st->st_ino;
+	get_mtime(st, &idx->dir_mtime);
+	idx->loaded = 1;
+
+	DBG(EVALUATE, ul_debug("%s: indexed %zu links", dirname, idx->nlinks));
+	return 0;
+nomem:
+	closedir(dir);
+	reset_udev_index(idx);
+	return -ENOMEM;
+}
+
+/*
+ * Returns the index of the udev_dirs[] directory @n. The index is (re)loaded
+ * if the directory has been modified since the last call.
+ */
+static struct udev_index *get_udev_index(struct blkid_struct_evaluate *ev,
+					 size_t n)
+{
+	struct udev_index *idx = &ev->udev[n];
+	struct timespec mtime;
+	struct stat st;
+
+	if (stat(udev_dirs[n].dir, &st) != 0) {
+		reset_udev_index(idx);		/* no udev links at all */
+		return idx;
+	}
+
+	get_mtime(&st, &mtime);
+	if (idx->loaded
+	    && idx->dir_dev == st.st_dev
+	    && idx->dir_ino == st.st_ino
+	    && idx->dir_mtime.tv_sec == mtime.tv_sec
+	    && idx->dir_mtime.tv_nsec == mtime.tv_nsec)
+		return idx;
+
+	if (load_udev_index(idx, udev_dirs[n].dir, &st) != 0)
+		DBG(EVALUATE, ul_debug("%s: failed to read directory",
+					udev_dirs[n].dir));
+	return idx;
+}
+
+static struct udev_link *lookup_udev_link(struct udev_index *idx, const char *name)
+{
+	struct udev_link key = { .name = (char *) name };
+
+	if (!idx->nlinks)
+		return NULL;
+	return bsearch(&key, idx->links, idx->nlinks,
+			sizeof(struct udev_link), cmp_udev_links);
+}
+
+/*
+ * The index in @ev is optional, without the index the udev link is
+ * evaluated directly.
+ */
+static char *evaluate_by_udev(const char *token, const char *value, int uevent,
+			      struct blkid_struct_evaluate *ev)
 {
 	char dev[PATH_MAX];
 	char *path = NULL;
-	size_t len;
+	size_t len, n;
+	struct udev_link *link = NULL;
 	struct stat st;
 
 	DBG(EVALUATE, ul_debug("evaluating by udev %s=%s", token, value));
 
-	if (!strcmp(token, "UUID"))
-		strcpy(dev, _PATH_DEV_BYUUID "/");
-	else if (!strcmp(token, "LABEL"))
-		strcpy(dev, _PATH_DEV_BYLABEL "/");
-	else if (!strcmp(token, "PARTLABEL"))
-		strcpy(dev, _PATH_DEV_BYPARTLABEL "/");
-	else if (!strcmp(token, "PARTUUID"))
-		strcpy(dev, _PATH_DEV_BYPARTUUID "/");
-	else {
+	for (n = 0; n < ARRAY_SIZE(udev_dirs); n++) {
+		if (strcmp(token, udev_dirs[n].token) == 0)
+			break;
+	}
+	if (n == ARRAY_SIZE(udev_dirs)) {
 		DBG(EVALUATE, ul_debug("unsupported token %s", token));
 		return NULL;	/* unsupported tag */
 	}
 
-	len = strlen(dev);
+	len = snprintf(dev, sizeof(dev), "%s/", udev_dirs[n].dir);
 	if (blkid_encode_string(value, &dev[len], sizeof(dev) - len) != 0)
 		return NULL;
 
 	DBG(EVALUATE, ul_debug("expected udev link: %s", dev));
 
-	if (stat(dev, &st))
-		goto failed;	/* link or device does not exist */
+	if (ev) {
+		link = lookup_udev_link(get_udev_index(ev, n), &dev[len]);
+		if (!link)
+			goto failed;	/* link does not exist */
+	}
 
-	if (!S_ISBLK(st.st_mode))
-		return NULL;
+	if (link && link->path)
+		DBG(EVALUATE, ul_debug("%s: using indexed %s", dev, link->path));
+	else {
+		if (stat(dev, &st))
+			goto failed;	/* link or device does not exist */
+		if (!S_ISBLK(st.st_mode))
+			return NULL;
+	}
 
-	path = canonicalize_path(dev);
+	if (link) {
+		if (!link->path)
+			link->path = canonicalize_path(dev);
+		if (link->path)
+			path = strdup(link->path);
+	} else
+		path = canonicalize_path(dev);
 	if (!path)
 		return NULL;
 
 #ifdef CONFIG_BLKID_VERIFY_UDEV
-	if (verify_tag(path, token, value))
+	if (verify_tag(path, token, value)) {
+		if (link) {
+			free(link->path);
+			link->path = NULL;
+		}
 		goto failed;
+	}
 #endif
 	return path;
 
@@ -211,6 +404,61 @@ static char *evaluate_by_scan(const char *token, const char *value,
 	return res;
 }
 
+void blkid_free_evaluate(struct blkid_struct_evaluate *ev)
+{
+	size_t i;
+
+	if (!ev)
+		return;
+	for (i = 0; i < ARRAY_SIZE(ev->udev); i++)
+		reset_udev_index(&ev->udev[i]);
+	blkid_free_config(ev->conf);
+	free(ev->conf_file);
+	free(ev);
+}
+
+/*
+ * Returns the evaluation data of the @cache, the cache is allocated if
+ * necessary. Returns NULL on error.
+ */
+static struct blkid_struct_evaluate *get_evaluate(blkid_cache *cache)
+{
+	if (!*cache && blkid_get_cache(cache, NULL) != 0)
+		return NULL;
+	if (!(*cache)->bic_evaluate)
+		(*cache)->bic_evaluate = calloc(1, sizeof(struct blkid_struct_evaluate));
+	return (*cache)->bic_evaluate;
+}
+
+/*
+ * Returns the config of @ev, the config file is read again if modified.
+ */
+static struct blkid_config *get_evaluate_config(struct blkid_struct_evaluate *ev)
+{
+	const char *filename = safe_getenv("BLKID_CONF");
+	struct timespec mtime = { 0, 0 };
+	struct stat st;
+
+	if (!filename)
+		filename = BLKID_CONFIG_FILE;
+	if (stat(filename, &st) == 0)
+		get_mtime(&st, &mtime);
+
+	if (ev->conf
+	    && strcmp(ev->conf_file, filename) == 0
+	    && ev->conf_mtime.tv_sec == mtime.tv_sec
+	    && ev->conf_mtime.tv_nsec == mtime.tv_nsec)
+		return ev->conf;
+
+	blkid_free_config(ev->conf);
+	free(ev->conf_file);
+
+	ev->conf_file = strdup(filename);
+	ev->conf = ev->conf_file ? blkid_read_config(filename) : NULL;
+	ev->conf_mtime = mtime;
+	return ev->conf;
+}
+
 /**
  * blkid_evaluate_tag:
  * @token: token name (e.g "LABEL" or "UUID") or unparsed tag (e.g. "LABEL=foo")
@@ -221,6 +469,7 @@ static char *evaluate_by_scan(const char *token, const char *value,
  */
 char *blkid_evaluate_tag(const char *token, const char *value, blkid_cache *cache)
 {
+	struct blkid_struct_evaluate *ev = NULL;
 	struct blkid_config *conf = NULL;
 	char *t = NULL, *v = NULL;
 	char *ret = NULL;
@@ -246,13 +495,15 @@ char *blkid_evaluate_tag(const char *token, const char *value, blkid_cache *cach
 		value = v;
 	}
 
-	conf = blkid_read_config(NULL);
+	if (cache)
+		ev = get_evaluate(cache);
+	conf = ev ? get_evaluate_config(ev) : blkid_read_config(NULL);
 	if (!conf)
 		goto out;
 
 	for (i = 0; i < conf->nevals; i++) {
 		if (conf->eval[i] == BLKID_EVAL_UDEV)
-			ret = evaluate_by_udev(token, value, conf->uevent);
+			ret = evaluate_by_udev(token, value, conf->uevent, ev);
 		else if (conf->eval[i] == BLKID_EVAL_SCAN)
 			ret = evaluate_by_scan(token, value, cache, conf);
 		if (ret)
@@ -261,7 +512,8 @@ char *blkid_evaluate_tag(const char *token, const char *value, blkid_cache *cach
 
 	DBG(EVALUATE, ul_debug("%s=%s evaluated as %s", token, value, ret));
 out:
-	blkid_free_config(conf);
+	if (!ev)
+		blkid_free_config(conf);
 	free(t);
 	free(v);
 	return ret;
@@ -2147,6 +2147,7 @@ int mnt_context_apply_fstab(struct libmnt_context *cxt)
 
 		/* remove "bind" from fstab (or no-op if not present) */
 		mnt_optstr_remove_option(&cxt->fs->optstr, "bind");
+		__mnt_fs_reset_optvec(cxt->fs);
 	}
 	return rc;
 }
@@ -335,6 +335,7 @@ static int fix_optstr(struct libmnt_context *cxt)
 	/* refresh merged optstr */
 	free(fs->optstr);
 	fs->optstr = NULL;
+	__mnt_fs_reset_optvec(fs);
 	fs->optstr = mnt_fs_strdup_options(fs);
 done:
 	cxt->flags |= MNT_FL_MOUNTOPTS_FIXED;
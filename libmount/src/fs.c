@@ -89,6 +89,7 @@ void mnt_reset_fs(struct libmnt_fs *fs)
 	free(fs->attrs);
 	free(fs->opt_fields);
 	free(fs->comment);
+	mnt_free_optvec(fs->optvec);
 
 	memset(fs, 0, sizeof(*fs));
 	INIT_LIST_HEAD(&fs->ents);
@@ -183,7 +184,8 @@ struct libmnt_fs *mnt_copy_fs(struct libmnt_fs *dest,
 		dest = mnt_new_fs();
 		if (!dest)
 			return NULL;
-	}
+	} else
+		__mnt_fs_reset_optvec(dest);
 
 	dest->id         = src->id;
 	dest->parent     = src->parent;
@@ -809,6 +811,7 @@ int mnt_fs_set_options(struct libmnt_fs *fs, const char *optstr)
 	free(fs->vfs_optstr);
 	free(fs->user_optstr);
 	free(fs->optstr);
+	__mnt_fs_reset_optvec(fs);
 
 	fs->fs_optstr = f;
 	fs->vfs_optstr = v;
@@ -852,6 +855,7 @@ int mnt_fs_append_options(struct libmnt_fs *fs, const char *optstr)
 		rc = mnt_optstr_append_option(&fs->user_optstr, u, NULL);
 	if (!rc)
 		rc = mnt_optstr_append_option(&fs->optstr, optstr, NULL);
+	__mnt_fs_reset_optvec(fs);
 
 	free(v);
 	free(f);
@@ -894,6 +898,7 @@ int mnt_fs_prepend_options(struct libmnt_fs *fs, const char *optstr)
 		rc = mnt_optstr_prepend_option(&fs->user_optstr, u, NULL);
 	if (!rc)
 		rc = mnt_optstr_prepend_option(&fs->optstr, optstr, NULL);
+	__mnt_fs_reset_optvec(fs);
 
 	free(v);
 	free(f);
@@ -1457,9 +1462,27 @@ int mnt_fs_match_fstype(struct libmnt_fs *fs, const char *types)
  */
 int mnt_fs_match_options(struct libmnt_fs *fs, const char *options)
 {
+	/* the options are parsed only once for all the patterns */
+	if (fs && fs->optstr && options) {
+		if (fs->optvec && fs->optvec->optstr != fs->optstr)
+			__mnt_fs_reset_optvec(fs);
+		if (!fs->optvec)
+			fs->optvec = mnt_new_optvec(fs->optstr);
+		if (fs->optvec)
+			return mnt_optvec_match(fs->optvec, options);
+	}
 	return mnt_match_options(mnt_fs_get_options(fs), options);
 }
 
+/*
+ * Drops the parsed options, has to be called when fs->optstr is modified.
+ */
+void __mnt_fs_reset_optvec(struct libmnt_fs *fs)
+{
+	mnt_free_optvec(fs->optvec);
+	fs->optvec = NULL;
+}
+
 /**
  * mnt_fs_print_debug
  * @fs: fstab/mtab/mountinfo entry
@@ -205,6 +205,8 @@ struct libmnt_fs {
 
 	char		*comment;	/* fstab comment */
 
+	struct libmnt_optvec *optvec;	/* parsed optstr, see mnt_fs_match_options() */
+
 	void		*userdata;	/* library independent data */
 };
 
@@ -221,6 +223,28 @@ struct libmnt_fs {
 				   || mnt_fs_is_netfs(_f) \
 				   || mnt_fs_is_swaparea(_f)))
 
+/*
+ * Parsed options string. The string is parsed on demand and the entries point
+ * to the original string, so the vector has to be reset when the string is
+ * modified.
+ */
+struct libmnt_optent {
+	const char	*name;
+	size_t		namesz;
+	const char	*value;
+	size_t		valsz;
+	unsigned int	hash;		/* hash of the name */
+};
+
+struct libmnt_optvec {
+	const char		*optstr;	/* parsed string (not a copy!) */
+	char			*next;		/* not parsed yet, NULL at the end */
+	struct libmnt_optent	*ents;
+	size_t			nents;
+	size_t			nalloc;
+	int			rc;		/* parse error or zero */
+};
+
 /*
  * mtab/fstab/mountinfo file
  */
@@ -365,6 +389,7 @@ struct libmnt_context
 extern int mnt_lock_use_simplelock(struct libmnt_lock *ml, int enable);
 
 /* optmap.c */
+extern unsigned int mnt_optname_hash(const char *name, size_t namelen);
 extern const struct libmnt_optmap *mnt_optmap_get_entry(
 			     struct libmnt_optmap const **maps,
                              int nmaps,
@@ -379,6 +404,12 @@ extern int mnt_optstr_fix_uid(char **optstr, char *value, size_t valsz, char **n
 extern int mnt_optstr_fix_secontext(char **optstr, char *value, size_t valsz, char **next);
 extern int mnt_optstr_fix_user(char **optstr);
 
+extern struct libmnt_optvec *mnt_new_optvec(const char *optstr);
+extern void mnt_free_optvec(struct libmnt_optvec *vec);
+extern int mnt_optvec_get_option(struct libmnt_optvec *vec, const char *name,
+			size_t namesz, char **value, size_t *valsz);
+extern int mnt_optvec_match(struct libmnt_optvec *vec, const char *pattern);
+
 /* fs.c */
 extern struct libmnt_fs *mnt_copy_mtab_fs(const struct libmnt_fs *fs)
 			__attribute__((nonnull));
@@ -386,6 +417,8 @@ extern int __mnt_fs_set_source_ptr(struct libmnt_fs *fs, char *source)
 			__attribute__((nonnull(1)));
 extern int __mnt_fs_set_fstype_ptr(struct libmnt_fs *fs, char *fstype)
 			__attribute__((nonnull(1)));
+extern void __mnt_fs_reset_optvec(struct libmnt_fs *fs)
+			__attribute__((nonnull));
 
 /* context.c */
 extern int mnt_context_mtab_writable(struct libmnt_context *cxt);
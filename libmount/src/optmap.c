@@ -200,6 +200,134 @@ const struct libmnt_optmap *mnt_get_builtin_optmap(int id)
 	return NULL;
 }
 
+/*
+ * Hash tables for the built-in maps. The table contains indexes (+1) of the
+ * first entries for all option names (without "=" and "[=]" suffixes). The
+ * MNT_PREFIX entries are not hashed.
+ */
+#define OPTMAP_HASH_SIZE	256
+
+struct optmap_hash {
+	const struct libmnt_optmap	*map;
+	unsigned short			first_prefix;	/* index of the first prefix entry + 1 */
+	unsigned short			slots[OPTMAP_HASH_SIZE];
+};
+
+static struct optmap_hash *builtin_hashes[2];
+
+/* used for the parsed options in optstr.c too */
+unsigned int mnt_optname_hash(const char *name, size_t namelen)
+{
+	unsigned int h = 2166136261U;		/* FNV-1a */
+	size_t i;
+
+	for (i = 0; i < namelen; i++) {
+		h ^= (unsigned char) name[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static size_t optmap_entry_namelen(const struct libmnt_optmap *ent)
+{
+	return strcspn(ent->name, "=[");
+}
+
+static struct optmap_hash *new_optmap_hash(const struct libmnt_optmap *map)
+{
+	struct optmap_hash *oh = calloc(1, sizeof(*oh));
+	const struct libmnt_optmap *ent;
+
+	if (!oh)
+		return NULL;
+	oh->map = map;
+
+	for (ent = map; ent->name; ent++) {
+		size_t idx = ent - map, len;
+		unsigned int h;
+
+		if (ent->mask & MNT_PREFIX) {
+			if (!oh->first_prefix)
+				oh->first_prefix = idx + 1;
+			continue;
+		}
+		len = optmap_entry_namelen(ent);
+		h = mnt_optname_hash(ent->name, len);
+
+		while (oh->slots[h % OPTMAP_HASH_SIZE]) {
+			const struct libmnt_optmap *x =
+					map + oh->slots[h % OPTMAP_HASH_SIZE] - 1;
+
+			if (optmap_entry_namelen(x) == len
+			    && strncmp(x->name, ent->name, len) == 0)
+				break;		/* keep the first entry */
+			h++;
+		}
+		if (!oh->slots[h % OPTMAP_HASH_SIZE])
+			oh->slots[h % OPTMAP_HASH_SIZE] = idx + 1;
+	}
+	return oh;
+}
+
+/*
+ * Returns the hash for the built-in @map or NULL.
+ */
+static struct optmap_hash *get_optmap_hash(const struct libmnt_optmap *map)
+{
+	struct optmap_hash **hp, *oh;
+
+	if (map == linux_flags_map)
+		hp = &builtin_hashes[0];
+	else if (map == userspace_opts_map)
+		hp = &builtin_hashes[1];
+	else
+		return NULL;
+
+	if (*hp)
+		return *hp;
+
+	oh = new_optmap_hash(map);
+	if (!oh)
+		return NULL;
+	/* the maps are static, let's be paranoid about threads */
+	if (!__sync_bool_compare_and_swap(hp, NULL, oh)) {
+		free(oh);
+		oh = *hp;
+	}
+	return oh;
+}
+
+static const struct libmnt_optmap *optmap_hash_get_entry(
+				struct optmap_hash *oh,
+				const char *name,
+				size_t namelen)
+{
+	const struct libmnt_optmap *ent = NULL, *pr;
+	unsigned int h = mnt_optname_hash(name, namelen);
+	unsigned short idx;
+
+	while ((idx = oh->slots[h % OPTMAP_HASH_SIZE])) {
+		const struct libmnt_optmap *x = oh->map + idx - 1;
+
+		if (optmap_entry_namelen(x) == namelen
+		    && strncmp(x->name, name, namelen) == 0) {
+			ent = x;
+			break;
+		}
+		h++;
+	}
+
+	/* prefix entries before the found entry win */
+	if (oh->first_prefix) {
+		for (pr = oh->map + oh->first_prefix - 1;
+		     pr->name && (!ent || pr < ent); pr++) {
+			if ((pr->mask & MNT_PREFIX) && startswith(name, pr->name))
+				return pr;
+		}
+	}
+	return ent;
+}
+
 /*
  * Looks up the @name in @maps and returns a map and in @mapent
  * returns the map entry
@@ -224,8 +352,21 @@ const struct libmnt_optmap *mnt_optmap_get_entry(
 	for (i = 0; i < nmaps; i++) {
 		const struct libmnt_optmap *map = maps[i];
 		const struct libmnt_optmap *ent;
+		struct optmap_hash *oh;
 		const char *p;
 
+		/* the names with "=" or "[" are not in the hash */
+		if (!memchr(name, '=', namelen) && !memchr(name, '[', namelen)
+		    && (oh = get_optmap_hash(map))) {
+			ent = optmap_hash_get_entry(oh, name, namelen);
+			if (ent) {
+				if (mapent)
+					*mapent = ent;
+				return map;
+			}
+			continue;
+		}
+
 		for (ent = map; ent && ent->name; ent++) {
 			if (ent->mask & MNT_PREFIX) {
 				if (startswith(name, ent->name)) {
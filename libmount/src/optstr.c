@@ -1080,51 +1080,139 @@ int mnt_optstr_fix_user(char **optstr)
 	return rc;
 }
 
-/**
- * mnt_match_options:
- * @optstr: options string
- * @pattern: comma delimited list of options
- *
- * The "no" could be used for individual items in the @options list. The "no"
- * prefix does not have a global meaning.
- *
- * Unlike fs type matching, nonetdev,user and nonetdev,nouser have
- * DIFFERENT meanings; each option is matched explicitly as specified.
- *
- * The "no" prefix interpretation could be disabled by the "+" prefix, for example
- * "+noauto" matches if @optstr literally contains the "noauto" string.
- *
- * "xxx,yyy,zzz" : "nozzz"	-> False
- *
- * "xxx,yyy,zzz" : "xxx,noeee"	-> True
- *
- * "bar,zzz"     : "nofoo"      -> True		(does not contain "foo")
- *
- * "nofoo,bar"   : "nofoo"      -> True		(does not contain "foo")
- *
- * "nofoo,bar"   : "+nofoo"     -> True		(contains "nofoo")
- *
- * "bar,zzz"     : "+nofoo"     -> False	(does not contain "nofoo")
- *
+/*
+ * Parsed options
  *
- * Returns: 1 if pattern is matching, else 0. This function also returns 0
- *          if @pattern is NULL and @optstr is non-NULL.
+ * The vector is used when the same options string is searched many times
+ * (e.g. mnt_fs_match_options() for all entries in a table). The strings are
+ * still the primary representation of the options; the vector is
+ * a read-only index to the string and it does not copy the data.
  */
-int mnt_match_options(const char *optstr, const char *pattern)
+static void optvec_init(struct libmnt_optvec *vec, const char *optstr)
 {
-	char *name, *pat = (char *) pattern;
-	char *buf, *patval;
-	size_t namesz = 0, patvalsz = 0;
-	int match = 1;
+	memset(vec, 0, sizeof(*vec));
+	vec->optstr = optstr;
+	vec->next = (char *) optstr;
+	if (!optstr)
+		vec->rc = -EINVAL;
+}
 
-	if (!pattern && !optstr)
+/*
+ * Parses the next option from the string to the vector. Returns 0 on
+ * success, 1 at the end of the string or negative number on error.
+ */
+static int optvec_parse_next(struct libmnt_optvec *vec)
+{
+	struct libmnt_optent *ent;
+	char *name, *value;
+	size_t namesz, valsz;
+	int rc;
+
+	if (!vec->next)
 		return 1;
-	if (!pattern)
-		return 0;
 
-	buf = malloc(strlen(pattern) + 1);
-	if (!buf)
-		return 0;
+	rc = mnt_optstr_parse_next(&vec->next, &name, &namesz, &value, &valsz);
+	if (rc) {
+		/* the options before the error are still usable */
+		vec->rc = rc < 0 ? rc : 0;
+		vec->next = NULL;
+		return rc;
+	}
+
+	if (vec->nents == vec->nalloc) {
+		size_t n = vec->nalloc ? vec->nalloc * 2 : 16;
+		struct libmnt_optent *tmp = realloc(vec->ents, n * sizeof(*tmp));
+
+		if (!tmp) {
+			vec->rc = -ENOMEM;
+			vec->next = NULL;
+			return -ENOMEM;
+		}
+		vec->ents = tmp;
+		vec->nalloc = n;
+	}
+	ent = &vec->ents[vec->nents++];
+	ent->name = name;
+	ent->namesz = namesz;
+	ent->value = value;
+	ent->valsz = valsz;
+	ent->hash = mnt_optname_hash(name, namesz);
+	return 0;
+}
+
+/*
+ * Returns a new vector for @optstr or NULL in case of error. The @optstr
+ * has to be valid (and not modified) while the vector is used. The string
+ * is parsed on demand.
+ */
+struct libmnt_optvec *mnt_new_optvec(const char *optstr)
+{
+	struct libmnt_optvec *vec = malloc(sizeof(*vec));
+
+	if (vec)
+		optvec_init(vec, optstr);
+	return vec;
+}
+
+void mnt_free_optvec(struct libmnt_optvec *vec)
+{
+	if (!vec)
+		return;
+	free(vec->ents);
+	free(vec);
+}
+
+static int optvec_ent_is(struct libmnt_optent *ent, const char *name,
+			 size_t namesz, unsigned int hash)
+{
+	return ent->hash == hash && ent->namesz == namesz
+		&& memcmp(ent->name, name, namesz) == 0;
+}
+
+/*
+ * The same as mnt_optstr_get_option(), but the @name does not have to be
+ * terminated.
+ */
+int mnt_optvec_get_option(struct libmnt_optvec *vec, const char *name,
+			  size_t namesz, char **value, size_t *valsz)
+{
+	unsigned int hash = mnt_optname_hash(name, namesz);
+	struct libmnt_optent *ent = NULL;
+	size_t i;
+
+	for (i = 0; i < vec->nents; i++) {
+		if (optvec_ent_is(&vec->ents[i], name, namesz, hash)) {
+			ent = &vec->ents[i];
+			break;
+		}
+	}
+
+	/* continue in the string */
+	while (!ent) {
+		if (optvec_parse_next(vec) != 0)
+			break;
+		if (optvec_ent_is(&vec->ents[vec->nents - 1], name, namesz, hash))
+			ent = &vec->ents[vec->nents - 1];
+	}
+
+	if (!ent)
+		return vec->rc ? vec->rc : 1;
+	if (value)
+		*value = (char *) ent->value;
+	if (valsz)
+		*valsz = ent->valsz;
+	return 0;
+}
+
+/*
+ * The same as mnt_match_options(), @pattern has to be non-NULL.
+ */
+int mnt_optvec_match(struct libmnt_optvec *vec, const char *pattern)
+{
+	char *name, *pat = (char *) pattern;
+	char *patval;
+	size_t namesz = 0, patvalsz = 0;
+	int match = 1;
 
 	/* walk on pattern string
 	 */
@@ -1139,9 +1227,7 @@ int mnt_match_options(const char *optstr, const char *pattern)
 		else if ((no = (startswith(name, "no") != NULL)))
 			name += 2, namesz -= 2;
 
-		xstrncpy(buf, name, namesz + 1);
-
-		rc = mnt_optstr_get_option(optstr, buf, &val, &sz);
+		rc = mnt_optvec_get_option(vec, name, namesz, &val, &sz);
 
 		/* check also value (if the pattern is "foo=value") */
 		if (rc == 0 && patvalsz > 0 &&
@@ -1162,7 +1248,53 @@ int mnt_match_options(const char *optstr, const char *pattern)
 
 	}
 
-	free(buf);
+	return match;
+}
+
+/**
+ * mnt_match_options:
+ * @optstr: options string
+ * @pattern: comma delimited list of options
+ *
+ * The "no" could be used for individual items in the @options list. The "no"
+ * prefix does not have a global meaning.
+ *
+ * Unlike fs type matching, nonetdev,user and nonetdev,nouser have
+ * DIFFERENT meanings; each option is matched explicitly as specified.
+ *
+ * The "no" prefix interpretation could be disabled by the "+" prefix, for example
+ * "+noauto" matches if @optstr literally contains the "noauto" string.
+ *
+ * "xxx,yyy,zzz" : "nozzz"	-> False
+ *
+ * "xxx,yyy,zzz" : "xxx,noeee"	-> True
+ *
+ * "bar,zzz"     : "nofoo"      -> True		(does not contain "foo")
+ *
+ * "nofoo,bar"   : "nofoo"      -> True		(does not contain "foo")
+ *
+ * "nofoo,bar"   : "+nofoo"     -> True		(contains "nofoo")
+ *
+ * "bar,zzz"     : "+nofoo"     -> False	(does not contain "nofoo")
+ *
+ *
+ * Returns: 1 if pattern is matching, else 0. This function also returns 0
+ *          if @pattern is NULL and @optstr is non-NULL.
+ */
+int mnt_match_options(const char *optstr, const char *pattern)
+{
+	struct libmnt_optvec vec;
+	int match;
+
+	if (!pattern && !optstr)
+		return 1;
+	if (!pattern)
+		return 0;
+
+	optvec_init(&vec, optstr);
+	match = mnt_optvec_match(&vec, pattern);
+	free(vec.ents);
+
 	return match;
 }
 
@@ -1210,6 +1342,15 @@ static int test_prepend(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+static int test_match(struct libmnt_test *ts, int argc, char *argv[])
+{
+	if (argc != 3)
+		return -EINVAL;
+
+	printf("match: %d\n", mnt_match_options(argv[1], argv[2]));
+	return 0;
+}
+
 static int test_split(struct libmnt_test *ts, int argc, char *argv[])
 {
 	char *optstr, *user = NULL, *fs = NULL, *vfs = NULL;
@@ -1424,6 +1565,7 @@ int main(int argc, char *argv[])
 		{ "--flags",  test_flags,  "<optstr>                   convert options to MS_* flags" },
 		{ "--apply",  test_apply,  "--{linux,user} <optstr> <mask>    apply mask to optstr" },
 		{ "--fix",    test_fix,    "<optstr>                   fix uid=, gid=, user, and context=" },
+		{ "--match",  test_match,  "<optstr> <pattern>         match options by pattern" },
 
 		{ NULL }
 	};
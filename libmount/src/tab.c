@@ -1672,6 +1672,7 @@ done:
 
 #ifdef TEST_PROGRAM
 #include "pathnames.h"
+#include "monotonic.h"
 
 static int parser_errcb(struct libmnt_table *tb, const char *filename, int line)
 {
@@ -1966,6 +1967,69 @@ done:
 }
 
 
+static double test_elapsed(struct timeval *start)
+{
+	struct timeval now;
+
+	gettime_monotonic(&now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1E6;
+}
+
+/* benchmark -- compare mnt_fs_match_options() with mnt_match_options() */
+static int test_match_options(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	struct timeval start;
+	size_t i, loops = 1, nents = 0, nmatches = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "try --help\n");
+		return -EINVAL;
+	}
+	if (argc == 4)
+		loops = strtoul(argv[3], NULL, 10);
+
+	tb = create_table(argv[1], FALSE);
+	if (!tb)
+		return -1;
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr) {
+		mnt_unref_table(tb);
+		return -ENOMEM;
+	}
+
+	gettime_monotonic(&start);
+	for (i = 0; i < loops; i++) {
+		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+			if (mnt_match_options(mnt_fs_get_options(fs), argv[2]))
+				nmatches++;
+			nents++;
+		}
+	}
+	printf("mnt_match_options():    %zu of %zu matches, %.3f s\n",
+			nmatches, nents, test_elapsed(&start));
+
+	nents = nmatches = 0;
+	gettime_monotonic(&start);
+	for (i = 0; i < loops; i++) {
+		mnt_reset_iter(itr, MNT_ITER_FORWARD);
+		while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+			if (mnt_fs_match_options(fs, argv[2]))
+				nmatches++;
+			nents++;
+		}
+	}
+	printf("mnt_fs_match_options(): %zu of %zu matches, %.3f s\n",
+			nmatches, nents, test_elapsed(&start));
+
+	mnt_free_iter(itr);
+	mnt_unref_table(tb);
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct libmnt_test tss[] = {
@@ -1977,6 +2041,7 @@ int main(int argc, char *argv[])
 	{ "--find-mountpoint", test_find_mountpoint, "<path>" },
 	{ "--copy-fs",       test_copy_fs, "<file>  copy root FS from the file" },
 	{ "--is-mounted",    test_is_mounted, "<fstab> check what from fstab is already mounted" },
+	{ "--match-options", test_match_options, "<file> <pattern> [<loops>]  benchmark options matching" },
 	{ NULL }
 	};
 
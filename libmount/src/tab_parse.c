@@ -460,6 +460,14 @@ next_line:
 		if (!s) {
 			/* Missing final newline?  Otherwise an extremely */
 			/* long line - assume file was corrupted */
+			if (feof(pa->f) && tb->fmt == MNT_FMT_UTAB) {
+				/* utab entry is appended without lock
+				 * held by readers, ignore incomplete line */
+				DBG(TAB, ul_debugobj(tb,
+					"%s: ignore unterminated last line",
+					pa->filename));
+				return -EINVAL;
+			}
 			if (feof(pa->f)) {
 				DBG(TAB, ul_debugobj(tb,
 					"%s: no final newline",	pa->filename));
@@ -25,6 +25,8 @@
 #include "mountP.h"
 #include "mangle.h"
 #include "pathnames.h"
+#include "strutils.h"
+#include "all-io.h"
 
 struct libmnt_update {
 	char		*target;
@@ -815,6 +817,237 @@ static int update_modify_options(struct libmnt_update *upd, struct libmnt_lock *
 	return rc;
 }
 
+/*
+ * The utab file is not rewritten on mount and umount. The new entry is
+ * appended to the file by one write() and the removed entry is commented out
+ * in place (the first character of the line is overwritten by '#'); the
+ * comment lines are ignored by all utab parsers, so the file format is the
+ * same for all libmount versions. The file is compacted (rewritten) when the
+ * removed entries are larger than the valid entries.
+ *
+ * The readers do not use utab.lock, the updates are ordered to be safe for
+ * them:
+ *
+ *  - an entry being appended is the unterminated last line and it is
+ *    ignored by the parser until the write is complete,
+ *  - umount overwrites one byte, the entry is valid or removed,
+ *  - move and remount have to replace the entry, so the file is rewritten
+ *    (tmp file + rename) and a reader never sees both entries.
+ *
+ * Note that umount still reads the whole file to find the entry.
+ */
+#define MNT_UTAB_COMPACT_MIN	(8 * 1024)
+
+/* returns the unmangled TARGET= value of the utab line */
+static char *utab_line_target(const char *s)
+{
+	while (s && *s) {
+		s = skip_blank(s);
+		if (!strncmp(s, "TARGET=", 7))
+			return unmangle(s + 7, NULL);
+		s = strchr(s, ' ');
+	}
+	return NULL;
+}
+
+/*
+ * Reads utab file @f and returns offset and size of the last valid entry for
+ * @target in @offset and @size. The size of the valid and removed (commented out) entries is
+ * returned in @live and @dead. Returns 0 if found, 1 if not found, and <0 on
+ * error.
+ */
+static int utab_find_line(FILE *f, const char *target, off_t *offset,
+			  off_t *size, off_t *live, off_t *dead)
+{
+	char *buf = NULL;
+	size_t bufsz = 0;
+	ssize_t sz;
+	off_t off = 0;
+	int rc = 1;
+
+	*live = *dead = 0;
+
+	while ((sz = getline(&buf, &bufsz, f)) > 0) {
+		const char *p = skip_blank(buf);
+		char *tgt;
+
+		if (*p == '#' || *p == '\n' || !*p || buf[sz - 1] != '\n') {
+			*dead += sz;		/* removed or incomplete */
+			off += sz;
+			continue;
+		}
+		*live += sz;
+
+		tgt = utab_line_target(p);
+		if (tgt && streq_paths(tgt, target)) {
+			*offset = off;
+			*size = sz;
+			rc = 0;
+		}
+		free(tgt);
+		off += sz;
+	}
+	if (ferror(f))
+		rc = -errno;
+	free(buf);
+	return rc;
+}
+
+/*
+ * Compacts the utab file, removes the commented out (and incomplete) entries.
+ */
+static int utab_compact(struct libmnt_update *upd)
+{
+	struct libmnt_table *tb;
+	int rc;
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: compact", upd->filename));
+
+	tb = __mnt_new_table_from_file(upd->filename, MNT_FMT_UTAB, 1);
+	if (!tb)
+		return errno ? -errno : -ENOMEM;
+
+	rc = update_table(upd, tb);
+	mnt_unref_table(tb);
+	return rc;
+}
+
+/* returns 1 if the last line of the file is not terminated */
+static int utab_is_unterminated(int fd)
+{
+	struct stat st;
+	char c;
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+		return 0;
+	return pread(fd, &c, 1, st.st_size - 1) == 1 && c != '\n';
+}
+
+/*
+ * Appends the new entry to the utab file, see MNT_UTAB_COMPACT_MIN comment.
+ */
+static int update_utab_append(struct libmnt_update *upd, struct libmnt_lock *lc)
+{
+	FILE *f;
+	char *buf = NULL;
+	size_t bufsz = 0;
+	int rc = 0, fd = -1;
+	struct stat st;
+
+	assert(upd);
+	assert(upd->fs);
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: append entry", upd->filename));
+
+	f = open_memstream(&buf, &bufsz);
+	if (!f)
+		return -errno;
+	rc = fprintf_utab_fs(f, upd->fs);
+	if (fclose(f) != 0 && !rc)
+		rc = -errno;
+	if (rc)
+		goto done;
+
+	if (lc)
+		rc = mnt_lock_file(lc);
+	if (rc) {
+		rc = -MNT_ERR_LOCK;
+		goto done;
+	}
+
+	fd = open(upd->filename, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+			S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd < 0) {
+		rc = -errno;
+		goto unlock;
+	}
+	if (utab_is_unterminated(fd)) {
+		/* interrupted update, don't append to the incomplete line */
+		close(fd);
+		rc = utab_compact(upd);
+		if (!rc) {
+			fd = open(upd->filename, O_WRONLY | O_APPEND | O_CLOEXEC);
+			if (fd < 0)
+				rc = -errno;
+		}
+	} else if (fstat(fd, &st) == 0 && st.st_size == 0)
+		/* new file, don't depend on umask */
+		rc = fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH) ? -errno : 0;
+
+	/* one write(), the line is complete or ignored by readers */
+	if (!rc && write_all(fd, buf, bufsz) != 0)
+		rc = -errno;
+	if (fd >= 0)
+		close(fd);
+unlock:
+	if (lc)
+		mnt_unlock_file(lc);
+done:
+	free(buf);
+	DBG(UPDATE, ul_debugobj(upd, "%s: append entry done [rc=%d]",
+				upd->filename, rc));
+	return rc;
+}
+
+/*
+ * Comments out the utab entry, see MNT_UTAB_COMPACT_MIN comment.
+ */
+static int update_utab_remove(struct libmnt_update *upd, struct libmnt_lock *lc)
+{
+	off_t offset = 0, size = 0, live = 0, dead = 0;
+	FILE *f = NULL;
+	int rc = 0, fd;
+
+	assert(upd);
+	assert(upd->target);
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: remove entry", upd->filename));
+
+	if (lc)
+		rc = mnt_lock_file(lc);
+	if (rc)
+		return -MNT_ERR_LOCK;
+
+	fd = open(upd->filename, O_RDWR | O_CLOEXEC);
+	if (fd >= 0) {
+		f = fdopen(fd, "r" UL_CLOEXECSTR);
+		if (!f)
+			close(fd);
+	}
+	if (!f) {
+		if (errno != ENOENT)
+			rc = -errno;
+		goto done;			/* no utab, nothing to remove */
+	}
+
+	rc = utab_find_line(f, upd->target, &offset, &size, &live, &dead);
+	if (rc == 1) {
+		rc = 0;				/* not found, nothing to remove */
+		goto done;
+	}
+	if (rc)
+		goto done;
+
+	if (pwrite(fd, "#", 1, offset) != 1) {
+		rc = -errno;
+		goto done;
+	}
+	live -= size;
+	dead += size;
+
+	if (dead > max(live, (off_t) MNT_UTAB_COMPACT_MIN))
+		rc = utab_compact(upd);
+done:
+	if (f)
+		fclose(f);
+	if (lc)
+		mnt_unlock_file(lc);
+
+	DBG(UPDATE, ul_debugobj(upd, "%s: remove entry done [rc=%d]",
+				upd->filename, rc));
+	return rc;
+}
+
 /**
  * mnt_update_table:
  * @upd: update
@@ -851,12 +1084,16 @@ int mnt_update_table(struct libmnt_update *upd, struct libmnt_lock *lc)
 	if (lc && upd->userspace_only)
 		mnt_lock_use_simplelock(lc, TRUE);	/* use flock */
 
-	if (!upd->fs && upd->target)
+	if (upd->userspace_only && !upd->fs && upd->target)
+		rc = update_utab_remove(upd, lc);	/* umount */
+	else if (!upd->fs && upd->target)
 		rc = update_remove_entry(upd, lc);	/* umount */
 	else if (upd->mountflags & MS_MOVE)
 		rc = update_modify_target(upd, lc);	/* move */
 	else if (upd->mountflags & MS_REMOUNT)
 		rc = update_modify_options(upd, lc);	/* remount */
+	else if (upd->fs && upd->userspace_only)
+		rc = update_utab_append(upd, lc);	/* mount */
 	else if (upd->fs)
 		rc = update_add_entry(upd, lc);	/* mount */
 
@@ -1019,6 +1256,27 @@ static int test_remount(struct libmnt_test *ts, int argc, char *argv[])
 	return rc;
 }
 
+static int test_dump_utab(struct libmnt_test *ts, int argc, char *argv[])
+{
+	struct libmnt_table *tb;
+	struct libmnt_iter itr;
+	struct libmnt_fs *fs;
+
+	if (argc < 2)
+		return -1;
+
+	tb = __mnt_new_table_from_file(argv[1], MNT_FMT_UTAB, 0);
+	if (!tb)
+		return -1;
+
+	mnt_reset_iter(&itr, MNT_ITER_FORWARD);
+	while (mnt_table_next_fs(tb, &itr, &fs) == 0)
+		fprintf_utab_fs(stdout, fs);
+
+	mnt_unref_table(tb);
+	return 0;
+}
+
 static int test_replace(struct libmnt_test *ts, int argc, char *argv[])
 {
 	struct libmnt_fs *fs = mnt_new_fs();
@@ -1050,6 +1308,7 @@ int main(int argc, char *argv[])
 	{ "--remove", test_remove,  "<target>                      MS_REMOUNT mtab change" },
 	{ "--move",   test_move,    "<old_target>  <target>        MS_MOVE mtab change" },
 	{ "--remount",test_remount, "<target>  <options>           MS_REMOUNT mtab change" },
+	{ "--dump-utab", test_dump_utab, "<file>                     print valid utab entries" },
 	{ "--replace",test_replace, "<src> <target>                Add a line to LIBMOUNT_FSTAB and replace the original file" },
 	{ NULL }
 	};
@@ -26,6 +26,7 @@
  */
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 #include <time.h>
 #include <stdio.h>
@@ -52,6 +53,7 @@
 #include "strutils.h"
 #include "timeutils.h"
 #include "monotonic.h"
+#include "all-io.h"
 
 #ifndef SHUTDOWN_TIME
 # define SHUTDOWN_TIME 254
@@ -77,7 +79,8 @@ struct last_control {
 		     showhost :1, /* Show hostname */
 		     altlist :1,  /* Hostname at the end */
 		     usedns :1,	  /* Use DNS to lookup the hostname */
-		     useip :1;    /* Print IP address in number format */
+		     useip :1,    /* Print IP address in number format */
+		     bisect :1;   /* Binary search for --since/--until */
 
 	unsigned int name_len;	/* Number of login name characters to print */
 	unsigned int domain_len; /* Number of domain name characters to print */
@@ -92,6 +95,18 @@ struct last_control {
 	unsigned int time_fmt;	/* time format */
 };
 
+/* The whole file in memory, mmap-ed or read from a pipe */
+struct last_input {
+	char *data;
+	size_t size;
+
+	size_t first;		/* offset of the first complete record */
+	size_t lo;		/* index of the first record to read */
+	size_t cur;		/* index of the last read record */
+
+	unsigned int mapped :1;
+};
+
 /* Double linked list of struct utmp's */
 struct utmplist {
 	struct utmpx ut;
@@ -258,6 +273,120 @@ static int uread(FILE *fp, struct utmpx *u,  int *quit, const char *filename)
 	return 1;
 }
 
+/*
+ *	Map (or read if it's not a regular file) the whole file to memory.
+ *	Returns 0 on success, 1 when the file cannot be mapped and should
+ *	be read by uread(), and <0 on error.
+ */
+static int load_input(struct last_input *in, int fd)
+{
+	struct stat st;
+	size_t sz = 0;
+
+	memset(in, 0, sizeof(*in));
+
+	if (fstat(fd, &st) != 0)
+		return -errno;
+
+	if (S_ISREG(st.st_mode)) {
+		if (st.st_size == 0 || (uintmax_t) st.st_size > SIZE_MAX)
+			return 1;
+		in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (in->data == MAP_FAILED) {
+			in->data = NULL;
+			return 1;	/* e.g. not enough address space */
+		}
+		in->size = st.st_size;
+		in->mapped = 1;
+	} else {
+		/* not seekable, read all */
+		ssize_t rc;
+
+		do {
+			if (in->size == sz) {
+				sz = sz ? sz * 2 : UCHUNKSIZE;
+				in->data = xrealloc(in->data, sz);
+			}
+			rc = read_all(fd, in->data + in->size, sz - in->size);
+			if (rc > 0)
+				in->size += rc;
+		} while (rc > 0 && in->size == sz);
+
+		if (rc < 0 && !in->size) {
+			free(in->data);
+			in->data = NULL;
+			return -errno;
+		}
+	}
+
+	/* like uread(), the records are aligned to the end of the file */
+	in->first = in->size % sizeof(struct utmpx);
+	in->cur = in->size / sizeof(struct utmpx);
+	return 0;
+}
+
+static void free_input(struct last_input *in)
+{
+	if (in->mapped)
+		munmap(in->data, in->size);
+	else
+		free(in->data);
+	in->data = NULL;
+}
+
+static time_t input_time(const struct last_input *in, size_t idx)
+{
+	__typeof__(((struct utmpx *) 0)->ut_tv) tv;
+
+	memcpy(&tv, in->data + in->first + idx * sizeof(struct utmpx)
+			+ offsetof(struct utmpx, ut_tv), sizeof(tv));
+	return tv.tv_sec;
+}
+
+/*
+ *	Returns index of the first record with time greater than
+ *	(or equal to if @eq is set) @tm, the file has to be sorted by time.
+ */
+static size_t input_bisect(const struct last_input *in, time_t tm, int eq)
+{
+	size_t lo = 0, hi = in->size / sizeof(struct utmpx);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		time_t x = input_time(in, mid);
+
+		if (x < tm || (!eq && x == tm))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ *	Limit the records to the --since/--until range.
+ */
+static void input_set_range(const struct last_control *ctl, struct last_input *in)
+{
+	if (ctl->until)
+		in->cur = input_bisect(in, ctl->until, 0);
+	if (ctl->since)
+		in->lo = min(input_bisect(in, ctl->since, 1), in->cur);
+}
+
+/*
+ *	Read the previous record from memory.
+ */
+static int input_read(struct last_input *in, struct utmpx *u)
+{
+	if (in->cur <= in->lo)
+		return 0;
+	in->cur--;
+	memcpy(u, in->data + in->first + in->cur * sizeof(struct utmpx),
+	       sizeof(struct utmpx));
+	return 1;
+}
+
 /*
  *	Print a short date.
  */
@@ -591,6 +720,7 @@ static void __attribute__((__noreturn__)) usage(const struct last_control *ctl)
 	fputs(_(" -x, --system         display system shutdown entries and run level changes\n"), out);
 	fputs(_("     --time-format <format>  show timestamps in the specified <format>:\n"
 		"                               notime|short|full|iso\n"), out);
+	fputs(_("     --bisect         binary search for --since and --until in sorted file\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(22));
@@ -654,6 +784,8 @@ static void process_wtmp_file(const struct last_control *ctl,
 	struct stat st;		/* To stat the [uw]tmp file */
 	int quit = 0;		/* Flag */
 	int down = 0;		/* Down flag */
+	struct last_input in;	/* The file in memory */
+	int inmem;		/* Use last_input rather than uread() */
 
 	time(&lastdown);
 	/*
@@ -673,35 +805,61 @@ static void process_wtmp_file(const struct last_control *ctl,
 	if ((fp = fopen(filename, "r")) == NULL)
 		err(EXIT_FAILURE, _("cannot open %s"), filename);
 
-	/*
-	 * Optimize the buffer size.
-	 */
-	setvbuf(fp, NULL, _IOFBF, UCHUNKSIZE);
+	inmem = load_input(&in, fileno(fp));
+	if (inmem < 0)
+		err(EXIT_FAILURE, _("cannot read %s"), filename);
+	inmem = !inmem;
 
-	/*
-	 * Read first structure to capture the time field
-	 */
-	if (uread(fp, &ut, NULL, filename) == 1)
-		begintime = ut.ut_tv.tv_sec;
-	else {
-		if (fstat(fileno(fp), &st) != 0)
-			err(EXIT_FAILURE, _("stat of %s failed"), filename);
-		begintime = st.st_ctime;
-		quit = 1;
-	}
+	if (inmem) {
+		/*
+		 * Read first structure to capture the time field
+		 */
+		if (in.size >= sizeof(struct utmpx)) {
+			memcpy(&ut, in.data, sizeof(struct utmpx));
+			begintime = ut.ut_tv.tv_sec;
+		} else {
+			if (fstat(fileno(fp), &st) != 0)
+				err(EXIT_FAILURE, _("stat of %s failed"), filename);
+			begintime = st.st_ctime;
+			quit = 1;
+		}
 
-	/*
-	 * Go to end of file minus one structure
-	 * and/or initialize utmp reading code.
-	 */
-	uread(fp, NULL, NULL, filename);
+		if (ctl->bisect)
+			input_set_range(ctl, &in);
+	} else {
+		/*
+		 * Optimize the buffer size.
+		 */
+		setvbuf(fp, NULL, _IOFBF, UCHUNKSIZE);
+
+		/*
+		 * Read first structure to capture the time field
+		 */
+		if (uread(fp, &ut, NULL, filename) == 1)
+			begintime = ut.ut_tv.tv_sec;
+		else {
+			if (fstat(fileno(fp), &st) != 0)
+				err(EXIT_FAILURE, _("stat of %s failed"), filename);
+			begintime = st.st_ctime;
+			quit = 1;
+		}
+
+		/*
+		 * Go to end of file minus one structure
+		 * and/or initialize utmp reading code.
+		 */
+		uread(fp, NULL, NULL, filename);
+	}
 
 	/*
 	 * Read struct after struct backwards from the file.
 	 */
 	while (!quit) {
 
-		if (uread(fp, &ut, &quit, filename) != 1)
+		if (inmem) {
+			if (input_read(&in, &ut) != 1)
+				break;
+		} else if (uread(fp, &ut, &quit, filename) != 1)
 			break;
 
 		if (ctl->since && ut.ut_tv.tv_sec < ctl->since)
@@ -894,6 +1052,8 @@ static void process_wtmp_file(const struct last_control *ctl,
 		free(tmp);
 	}
 
+	if (inmem)
+		free_input(&in);
 	fclose(fp);
 
 	for (p = ulist; p; p = next) {
@@ -916,7 +1076,8 @@ int main(int argc, char **argv)
 	usec_t p;
 
 	enum {
-		OPT_TIME_FORMAT = CHAR_MAX + 1
+		OPT_TIME_FORMAT = CHAR_MAX + 1,
+		OPT_BISECT
 	};
 	static const struct option long_opts[] = {
 	      { "limit",	required_argument, NULL, 'n' },
@@ -934,6 +1095,7 @@ int main(int argc, char **argv)
 	      { "fulltimes",  no_argument,       NULL, 'F' },
 	      { "fullnames",  no_argument,       NULL, 'w' },
 	      { "time-format", required_argument, NULL, OPT_TIME_FORMAT },
+	      { "bisect",     no_argument,       NULL, OPT_BISECT },
 	      { NULL, 0, NULL, 0 }
 	};
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
@@ -1016,6 +1178,9 @@ int main(int argc, char **argv)
 		case OPT_TIME_FORMAT:
 			ctl.time_fmt = which_time_format(optarg);
 			break;
+		case OPT_BISECT:
+			ctl.bisect = 1;
+			break;
 		default:
 			errtryhelp(EXIT_FAILURE);
 		}
@@ -245,9 +245,13 @@ static const struct lslogins_coldesc coldescs[] =
 struct lslogins_control {
 	struct utmpx *wtmp;
 	size_t wtmp_size;
+	void *wtmp_index;	/* last wtmp entry for each user */
 
 	struct utmpx *btmp;
 	size_t btmp_size;
+	void *btmp_index;	/* last btmp entry for each user */
+
+	void *procs;		/* number of processes for each UID */
 
 	void *usertree;
 
@@ -268,7 +272,14 @@ struct lslogins_control {
 	unsigned int selinux_enabled : 1,
 		     ulist_on : 1,
 		     noheadings : 1,
-		     notrunc : 1;
+		     notrunc : 1,
+		     procs_scanned : 1;
+};
+
+/* number of processes owned by UID, see scan_nprocs() */
+struct lslogins_nprocs {
+	uid_t uid;
+	int nprocs;
 };
 
 /* these have to remain global since there's no other reasonable way to pass
@@ -409,21 +420,52 @@ again:
 	return res;
 }
 
-static struct utmpx *get_last_wtmp(struct lslogins_control *ctl, const char *username)
+static int cmp_utmp_user(const void *a, const void *b)
 {
-	size_t n = 0;
+	return strncmp(((const struct utmpx *) a)->ut_user,
+		       ((const struct utmpx *) b)->ut_user,
+		       sizeof(((struct utmpx *) 0)->ut_user));
+}
+
+/*
+ * Creates username -> last entry index for the @ents array. The array is
+ * sorted by time, so later entries replace the former ones. This makes the
+ * lookup independent on the size of the file for each user.
+ */
+static void *create_utmp_index(struct utmpx *ents, size_t nents)
+{
+	void *index = NULL;
+	size_t n;
+
+	for (n = 0; n < nents; n++) {
+		struct utmpx **node;
+
+		node = tsearch(&ents[n], &index, cmp_utmp_user);
+		if (!node)
+			err_oom();
+		*node = &ents[n];	/* the same key, the tree is still valid */
+	}
+	return index;
+}
+
+static struct utmpx *get_last_utmp(void *index, const char *username)
+{
+	struct utmpx key, **node;
 
-	if (!username)
+	if (!username || !index)
 		return NULL;
 
-	n = ctl->wtmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->wtmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->wtmp + n;
-	} while (n--);
-	return NULL;
+	memset(key.ut_user, 0, sizeof(key.ut_user));
+	memcpy(key.ut_user, username,
+	       strnlen(username, sizeof(key.ut_user)));
 
+	node = tfind(&key, &index, cmp_utmp_user);
+	return node ? *node : NULL;
+}
+
+static struct utmpx *get_last_wtmp(struct lslogins_control *ctl, const char *username)
+{
+	return get_last_utmp(ctl->wtmp_index, username);
 }
 
 static int require_wtmp(void)
@@ -446,19 +488,7 @@ static int require_btmp(void)
 
 static struct utmpx *get_last_btmp(struct lslogins_control *ctl, const char *username)
 {
-	size_t n = 0;
-
-	if (!username)
-		return NULL;
-
-	n = ctl->btmp_size - 1;
-	do {
-		if (!strncmp(username, ctl->btmp[n].ut_user,
-		             sizeof(ctl->wtmp[0].ut_user)))
-			return ctl->btmp + n;
-	}while (n--);
-	return NULL;
-
+	return get_last_utmp(ctl->btmp_index, username);
 }
 
 static int read_utmp(char const *file, size_t *nents, struct utmpx **res)
@@ -499,6 +529,8 @@ static int parse_wtmp(struct lslogins_control *ctl, char *path)
 	rc = read_utmp(path, &ctl->wtmp_size, &ctl->wtmp);
 	if (rc < 0 && errno != EACCES)
 		err(EXIT_FAILURE, "%s", path);
+	if (!rc)
+		ctl->wtmp_index = create_utmp_index(ctl->wtmp, ctl->wtmp_size);
 	return rc;
 }
 
@@ -509,6 +541,8 @@ static int parse_btmp(struct lslogins_control *ctl, char *path)
 	rc = read_utmp(path, &ctl->btmp_size, &ctl->btmp);
 	if (rc < 0 && errno != EACCES)
 		err(EXIT_FAILURE, "%s", path);
+	if (!rc)
+		ctl->btmp_index = create_utmp_index(ctl->btmp, ctl->btmp_size);
 	return rc;
 }
 
@@ -546,19 +580,58 @@ static int get_sgroups(gid_t **list, size_t *len, struct passwd *pwd)
 	return 0;
 }
 
-static int get_nprocs(const uid_t uid)
+static int cmp_nprocs_uid(const void *a, const void *b)
+{
+	uid_t x = ((const struct lslogins_nprocs *) a)->uid;
+	uid_t z = ((const struct lslogins_nprocs *) b)->uid;
+	return x > z ? 1 : (x < z ? -1 : 0);
+}
+
+/*
+ * Counts processes for all UIDs by one /proc scan, it's cheaper than to scan
+ * /proc for each user.
+ */
+static void scan_nprocs(struct lslogins_control *ctl)
 {
-	int nprocs = 0;
 	pid_t pid;
 	struct proc_processes *proc = proc_open_processes();
 
-	proc_processes_filter_by_uid(proc, uid);
+	ctl->procs_scanned = 1;
+	if (!proc)
+		return;
+
+	while (!proc_next_pid(proc, &pid)) {
+		struct lslogins_nprocs *np, **node;
+		char name[sizeof(stringify_value(INT_MAX))];
+		struct stat st;
 
-	while (!proc_next_pid(proc, &pid))
-		++nprocs;
+		snprintf(name, sizeof(name), "%d", (int) pid);
+		if (fstatat(dirfd(proc->dir), name, &st, 0))
+			continue;
+
+		np = xcalloc(1, sizeof(*np));
+		np->uid = st.st_uid;
+
+		node = tsearch(np, &ctl->procs, cmp_nprocs_uid);
+		if (!node)
+			err_oom();
+		if (*node != np)
+			free(np);
+		(*node)->nprocs++;
+	}
 
 	proc_close_processes(proc);
-	return nprocs;
+}
+
+static int get_nprocs(struct lslogins_control *ctl, const uid_t uid)
+{
+	struct lslogins_nprocs key = { .uid = uid }, **node;
+
+	if (!ctl->procs_scanned)
+		scan_nprocs(ctl);
+
+	node = tfind(&key, &ctl->procs, cmp_nprocs_uid);
+	return node ? (*node)->nprocs : 0;
 }
 
 static int valid_pwd(const char *str)
@@ -749,7 +822,7 @@ static struct lslogins_user *get_user_info(struct lslogins_control *ctl, const c
 #endif
 			break;
 		case COL_NPROCS:
-			xasprintf(&user->nprocs, "%d", get_nprocs(pwd->pw_uid));
+			xasprintf(&user->nprocs, "%d", get_nprocs(ctl, pwd->pw_uid));
 			break;
 		default:
 			/* something went very wrong here */
@@ -838,10 +911,18 @@ static int get_ulist(struct lslogins_control *ctl, char *logins, char *groups)
 	return 0;
 }
 
+static void free_noop(void *p __attribute__((__unused__)))
+{
+}
+
 static void free_ctl(struct lslogins_control *ctl)
 {
 	size_t n = 0;
 
+	tdestroy(ctl->wtmp_index, free_noop);
+	tdestroy(ctl->btmp_index, free_noop);
+	tdestroy(ctl->procs, free);
+
 	free(ctl->wtmp);
 	free(ctl->btmp);
 
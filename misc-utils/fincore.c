@@ -21,16 +21,20 @@
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <dirent.h>
+#include <stdint.h>
 
 #include "c.h"
 #include "nls.h"
 #include "closestream.h"
 #include "xalloc.h"
 #include "strutils.h"
+#include "all-io.h"
 
 #include "libsmartcols.h"
 
@@ -39,8 +43,16 @@
    calling.
 
    Window size depends on page size.
-   e.g. 128MB on x86_64. ( = N_PAGES_IN_WINDOW * 4096 ). */
-#define N_PAGES_IN_WINDOW ((size_t)(32 * 1024))
+   e.g. 128MB on x86_64. ( = N_PAGES_IN_WINDOW * 4096 ).
+
+   On 64-bit systems the address space is cheap, so use
+   a much larger window (4GB on x86_64) to reduce the number
+   of mmap/munmap calls for huge files. */
+#define N_PAGES_IN_WINDOW	((size_t)(32 * 1024))
+#define N_PAGES_IN_WINDOW_64	((size_t)(1024 * 1024))
+
+/* Number of file parts described by the HISTOGRAM column. */
+#define N_HIST_BUCKETS		16
 
 
 struct colinfo {
@@ -54,7 +66,9 @@ enum {
 	COL_PAGES,
 	COL_SIZE,
 	COL_FILE,
-	COL_RES
+	COL_RES,
+	COL_RANGES,
+	COL_HIST
 };
 
 static struct colinfo infos[] = {
@@ -62,6 +76,8 @@ static struct colinfo infos[] = {
 	[COL_RES]    = { "RES",      5, SCOLS_FL_RIGHT, N_("file data resident in memory in bytes")}, 
 	[COL_SIZE]   = { "SIZE",     5, SCOLS_FL_RIGHT, N_("size of the file")},
 	[COL_FILE]   = { "FILE",     4, 0, N_("file name")},
+	[COL_RANGES] = { "RANGES",   0.3, SCOLS_FL_WRAP, N_("resident page ranges")},
+	[COL_HIST]   = { "HISTOGRAM", N_HIST_BUCKETS, 0, N_("residency of the file parts (. none, 0-9 tenths, # all)")},
 };
 
 static int columns[ARRAY_SIZE(infos) * 2] = {-1};
@@ -72,10 +88,35 @@ struct fincore_control {
 
 	struct libscols_table *tb;		/* output */
 
+	size_t window_pages;			/* N_PAGES_IN_WINDOW{,_64} */
+	unsigned char *vec;			/* mincore() vector for the window */
+	size_t jobs;				/* number of scanning processes */
+
 	unsigned int bytes : 1,
 		     noheadings : 1,
 		     raw : 1,
-		     json : 1;
+		     json : 1,
+		     recursive : 1,
+		     ranges : 1,		/* collect resident page ranges */
+		     hist : 1;			/* collect per-part residency */
+};
+
+/* Result of the scan of one file */
+struct fincore_state {
+	off_t file_size;
+	off_t count_incore;
+	off_t hist[N_HIST_BUCKETS];		/* resident pages per file part */
+
+	char *ranges;				/* "first-last,..." resident pages */
+	size_t ranges_len;
+	size_t ranges_sz;
+	off_t range_start;			/* first page of open range or -1 */
+};
+
+struct fincore_file {
+	char *name;
+	int rc;					/* see fincore_name() */
+	struct fincore_state st;
 };
 
 
@@ -106,10 +147,33 @@ static const struct colinfo *get_column_info(int num)
 	return &infos[ get_column_id(num) ];
 }
 
+static char *hist_to_string(const struct fincore_state *st, size_t pagesize)
+{
+	off_t npages = (st->file_size + pagesize - 1) / pagesize;
+	char *str = xmalloc(N_HIST_BUCKETS + 1), *p = str;
+	size_t i;
+
+	for (i = 0; i < N_HIST_BUCKETS; i++) {
+		uint64_t start = ((uint64_t) i * npages + N_HIST_BUCKETS - 1) / N_HIST_BUCKETS;
+		uint64_t end = ((uint64_t) (i + 1) * npages + N_HIST_BUCKETS - 1) / N_HIST_BUCKETS;
+		uint64_t sz = end - start;
+
+		if (!sz)
+			continue;		/* file smaller than N_HIST_BUCKETS pages */
+		if (!st->hist[i])
+			*p++ = '.';
+		else if ((uint64_t) st->hist[i] == sz)
+			*p++ = '#';
+		else
+			*p++ = '0' + (st->hist[i] * 10) / sz;
+	}
+	*p = '\0';
+	return str;
+}
+
 static int add_output_data(struct fincore_control *ctl,
 			   const char *name,
-			   off_t file_size,
-			   off_t count_incore)
+			   const struct fincore_state *st)
 {
 	size_t i;
 	char *tmp;
@@ -130,12 +194,12 @@ static int add_output_data(struct fincore_control *ctl,
 			rc = scols_line_set_data(ln, i, name);
 			break;
 		case COL_PAGES:
-			xasprintf(&tmp, "%jd",  (intmax_t) count_incore);
+			xasprintf(&tmp, "%jd",  (intmax_t) st->count_incore);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
 		case COL_RES:
 		{
-			uintmax_t res = (uintmax_t) count_incore * ctl->pagesize;
+			uintmax_t res = (uintmax_t) st->count_incore * ctl->pagesize;
 
 			if (ctl->bytes)
 				xasprintf(&tmp, "%ju", res);
@@ -146,11 +210,18 @@ static int add_output_data(struct fincore_control *ctl,
 		}
 		case COL_SIZE:
 			if (ctl->bytes)
-				xasprintf(&tmp, "%jd", (intmax_t) file_size);
+				xasprintf(&tmp, "%jd", (intmax_t) st->file_size);
 			else
-				tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, file_size);
+				tmp = size_to_human_string(SIZE_SUFFIX_1LETTER, st->file_size);
 			rc = scols_line_refer_data(ln, i, tmp);
 			break;
+		case COL_RANGES:
+			rc = scols_line_set_data(ln, i, st->ranges ? st->ranges : "");
+			break;
+		case COL_HIST:
+			rc = scols_line_refer_data(ln, i,
+					hist_to_string(st, ctl->pagesize));
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -162,27 +233,124 @@ static int add_output_data(struct fincore_control *ctl,
 	return 0;
 }
 
+/*
+ * Returns number of resident pages in @vec. Only the least significant bit of
+ * every byte is defined by mincore(2), so mask the other bits and sum the
+ * bytes a word at a time. The byte counters in @acc cannot overflow for 255
+ * words; compilers vectorize the inner loop.
+ */
+static off_t count_resident(const unsigned char *vec, size_t n)
+{
+	const uint64_t mask = 0x0101010101010101ULL;
+	off_t count = 0;
+	size_t i = 0;
+
+	while (i + sizeof(uint64_t) <= n) {
+		uint64_t acc = 0, w;
+		size_t k;
+
+		for (k = 0; k < 255 && i + sizeof(uint64_t) <= n;
+		     k++, i += sizeof(uint64_t)) {
+			memcpy(&w, vec + i, sizeof(w));
+			acc += w & mask;
+		}
+		/* sum bytes into 16-bit lanes, then sum the lanes */
+		acc = (acc & 0x00ff00ff00ff00ffULL) + ((acc >> 8) & 0x00ff00ff00ff00ffULL);
+		count += (acc * 0x0001000100010001ULL) >> 48;
+	}
+	for (; i < n; i++)
+		count += vec[i] & 0x1;
+
+	return count;
+}
+
+static void add_range(struct fincore_state *st, off_t first, off_t last)
+{
+	char buf[64];
+	int len;
+
+	if (first == last)
+		len = snprintf(buf, sizeof(buf), "%s%jd",
+				st->ranges_len ? "," : "", (intmax_t) first);
+	else
+		len = snprintf(buf, sizeof(buf), "%s%jd-%jd",
+				st->ranges_len ? "," : "",
+				(intmax_t) first, (intmax_t) last);
+
+	if (st->ranges_len + len + 1 > st->ranges_sz) {
+		st->ranges_sz = max(st->ranges_sz * 2, (size_t) BUFSIZ);
+		st->ranges = xrealloc(st->ranges, st->ranges_sz);
+	}
+	memcpy(st->ranges + st->ranges_len, buf, len + 1);
+	st->ranges_len += len;
+}
+
+static void update_ranges(struct fincore_state *st,
+			  const unsigned char *vec, size_t n, off_t first_page)
+{
+	const uint64_t mask = 0x0101010101010101ULL;
+	size_t i = 0;
+
+	while (i < n) {
+		/* skip whole words which do not change the range state */
+		if (i + sizeof(uint64_t) <= n) {
+			uint64_t w;
+
+			memcpy(&w, vec + i, sizeof(w));
+			w &= mask;
+			if ((st->range_start < 0 && w == 0) ||
+			    (st->range_start >= 0 && w == mask)) {
+				i += sizeof(uint64_t);
+				continue;
+			}
+		}
+		if (vec[i] & 0x1) {
+			if (st->range_start < 0)
+				st->range_start = first_page + i;
+		} else if (st->range_start >= 0) {
+			add_range(st, st->range_start, first_page + i - 1);
+			st->range_start = -1;
+		}
+		i++;
+	}
+}
+
+static void update_hist(struct fincore_control *ctl, struct fincore_state *st,
+			const unsigned char *vec, size_t n, off_t first_page)
+{
+	uint64_t npages = (st->file_size + ctl->pagesize - 1) / ctl->pagesize;
+	size_t pos = 0;
+
+	while (pos < n) {
+		uint64_t pg = first_page + pos;
+		size_t b = (pg * N_HIST_BUCKETS) / npages;
+		uint64_t end = ((b + 1) * npages + N_HIST_BUCKETS - 1) / N_HIST_BUCKETS;
+		size_t seg = min((size_t) (end - pg), n - pos);
+
+		st->hist[b] += count_resident(vec + pos, seg);
+		pos += seg;
+	}
+}
+
 static int do_mincore(struct fincore_control *ctl,
 		      void *window, const size_t len,
 		      const char *name,
-		      off_t *count_incore)
+		      off_t first_page,
+		      struct fincore_state *st)
 {
-	static unsigned char vec[N_PAGES_IN_WINDOW];
-	int n = (len / ctl->pagesize) + ((len % ctl->pagesize)? 1: 0);
+	size_t n = (len / ctl->pagesize) + ((len % ctl->pagesize)? 1: 0);
 
-	if (mincore (window, len, vec) < 0) {
+	if (mincore (window, len, ctl->vec) < 0) {
 		warn(_("failed to do mincore: %s"), name);
 		return -errno;
 	}
 
-	while (n > 0)
-	{
-		if (vec[--n] & 0x1)
-		{
-			vec[n] = 0;
-			(*count_incore)++;
-		}
-	}
+	st->count_incore += count_resident(ctl->vec, n);
+
+	if (ctl->ranges)
+		update_ranges(st, ctl->vec, n, first_page);
+	if (ctl->hist)
+		update_hist(ctl, st, ctl->vec, n, first_page);
 
 	return 0;
 }
@@ -190,18 +358,17 @@ static int do_mincore(struct fincore_control *ctl,
 static int fincore_fd (struct fincore_control *ctl,
 		       int fd,
 		       const char *name,
-		       off_t file_size,
-		       off_t *count_incore)
+		       struct fincore_state *st)
 {
-	size_t window_size = N_PAGES_IN_WINDOW * ctl->pagesize;
+	size_t window_size = ctl->window_pages * ctl->pagesize;
 	off_t file_offset, len;
 	int rc = 0;
 	int warned_once = 0;
 
-	for (file_offset = 0; file_offset < file_size; file_offset += len) {
+	for (file_offset = 0; file_offset < st->file_size; file_offset += len) {
 		void  *window = NULL;
 
-		len = file_size - file_offset;
+		len = st->file_size - file_offset;
 		if (len >= (off_t) window_size)
 			len = window_size;
 
@@ -215,11 +382,17 @@ static int fincore_fd (struct fincore_control *ctl,
 			break;
 		}
 
-		rc = do_mincore(ctl, window, len, name, count_incore);
+		rc = do_mincore(ctl, window, len, name,
+				file_offset / ctl->pagesize, st);
+		munmap (window, len);
 		if (rc)
 			break;
+	}
 
-		munmap (window, len);
+	if (!rc && st->range_start >= 0) {
+		add_range(st, st->range_start,
+			  (st->file_size - 1) / ctl->pagesize);
+		st->range_start = -1;
 	}
 
 	return rc;
@@ -230,33 +403,202 @@ static int fincore_fd (struct fincore_control *ctl,
  */
 static int fincore_name(struct fincore_control *ctl,
 			const char *name,
-			struct stat *sb,
-			off_t *count_incore)
+			struct fincore_state *st)
 {
 	int fd;
 	int rc = 0;
+	struct stat sb;
 
 	if ((fd = open (name, O_RDONLY)) < 0) {
 		warn(_("failed to open: %s"), name);
 		return -errno;
 	}
 
-	if (fstat (fd, sb) < 0) {
+	if (fstat (fd, &sb) < 0) {
 		warn(_("failed to do fstat: %s"), name);
 		close (fd);
 		return -errno;
 	}
 
-	if (S_ISDIR(sb->st_mode))
+	st->file_size = sb.st_size;
+	st->range_start = -1;
+
+	if (S_ISDIR(sb.st_mode))
 		rc = 1;			/* ignore */
 
-	else if (sb->st_size)
-		rc = fincore_fd(ctl, fd, name, sb->st_size, count_incore);
+	else if (sb.st_size)
+		rc = fincore_fd(ctl, fd, name, st);
 
 	close (fd);
 	return rc;
 }
 
+static void add_file(struct fincore_file **files, size_t *nfiles, char *name)
+{
+	if ((*nfiles % 64) == 0)
+		*files = xrealloc(*files, (*nfiles + 64) * sizeof(struct fincore_file));
+
+	memset(&(*files)[*nfiles], 0, sizeof(struct fincore_file));
+	(*files)[*nfiles].name = name;
+	(*nfiles)++;
+}
+
+/*
+ * Adds regular files from the directory tree @dirname to @files. Entries are
+ * sorted to keep the output stable, symlinks are not followed.
+ */
+static void add_directory(struct fincore_file **files, size_t *nfiles,
+			  const char *dirname)
+{
+	struct dirent **namelist;
+	int i, n;
+
+	n = scandir(dirname, &namelist, NULL, alphasort);
+	if (n < 0) {
+		warn(_("failed to read directory: %s"), dirname);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		const char *d = namelist[i]->d_name;
+		struct stat sb;
+		char *path;
+
+		if (strcmp(d, ".") == 0 || strcmp(d, "..") == 0) {
+			free(namelist[i]);
+			continue;
+		}
+		xasprintf(&path, "%s%s%s", dirname,
+				endswith(dirname, "/") ? "" : "/", d);
+		free(namelist[i]);
+
+		if (lstat(path, &sb) != 0) {
+			warn(_("stat of %s failed"), path);
+			free(path);
+		} else if (S_ISDIR(sb.st_mode)) {
+			add_directory(files, nfiles, path);
+			free(path);
+		} else if (S_ISREG(sb.st_mode))
+			add_file(files, nfiles, path);
+		else
+			free(path);
+	}
+	free(namelist);
+}
+
+/*
+ * Record written by the scanning processes to the pipe. The resident page
+ * ranges (ranges_len bytes) follow the record.
+ */
+struct fincore_record {
+	size_t idx;
+	int rc;
+	off_t file_size;
+	off_t count_incore;
+	off_t hist[N_HIST_BUCKETS];
+	size_t ranges_len;
+};
+
+static void __attribute__((__noreturn__))
+fincore_child(struct fincore_control *ctl, struct fincore_file *files,
+	      size_t nfiles, size_t first, int fd)
+{
+	size_t i;
+
+	for (i = first; i < nfiles; i += ctl->jobs) {
+		struct fincore_state st = { .file_size = 0 };
+		struct fincore_record rec = { .idx = i };
+
+		rec.rc = fincore_name(ctl, files[i].name, &st);
+		rec.file_size = st.file_size;
+		rec.count_incore = st.count_incore;
+		rec.ranges_len = st.ranges_len;
+		memcpy(rec.hist, st.hist, sizeof(rec.hist));
+
+		if (write_all(fd, &rec, sizeof(rec)) ||
+		    (rec.ranges_len && write_all(fd, st.ranges, rec.ranges_len)))
+			_exit(EXIT_FAILURE);
+		free(st.ranges);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+ * Scans @files by ctl->jobs processes. Every process scans every ctl->jobs-th
+ * file and sends the results back by pipe. Returns 0 on success.
+ */
+static int fincore_files_parallel(struct fincore_control *ctl,
+				  struct fincore_file *files, size_t nfiles)
+{
+	size_t i;
+	int rc = 0;
+	pid_t *pids = xcalloc(ctl->jobs, sizeof(pid_t));
+	int *fds = xcalloc(ctl->jobs, sizeof(int));
+
+	for (i = 0; i < nfiles; i++)
+		files[i].rc = -ECHILD;	/* not reported by child */
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < ctl->jobs; i++) {
+		int pfd[2];
+
+		if (pipe(pfd) != 0)
+			err(EXIT_FAILURE, _("cannot create pipe"));
+
+		pids[i] = fork();
+		if (pids[i] < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (pids[i] == 0) {
+			close(pfd[0]);
+			fincore_child(ctl, files, nfiles, i, pfd[1]);
+		}
+		close(pfd[1]);
+		fds[i] = pfd[0];
+	}
+
+	/* children block on full pipes, so it's fine to drain them in order */
+	for (i = 0; i < ctl->jobs; i++) {
+		struct fincore_record rec;
+		int status;
+
+		while (read_all(fds[i], (char *) &rec, sizeof(rec)) == sizeof(rec)) {
+			struct fincore_file *f;
+
+			if (rec.idx >= nfiles) {
+				rc = -EINVAL;
+				break;
+			}
+			f = &files[rec.idx];
+			f->rc = rec.rc;
+			f->st.file_size = rec.file_size;
+			f->st.count_incore = rec.count_incore;
+			memcpy(f->st.hist, rec.hist, sizeof(rec.hist));
+
+			if (rec.ranges_len) {
+				f->st.ranges = xmalloc(rec.ranges_len + 1);
+				if (read_all(fds[i], f->st.ranges, rec.ranges_len)
+				    != (ssize_t) rec.ranges_len) {
+					rc = -EINVAL;
+					break;
+				}
+				f->st.ranges[rec.ranges_len] = '\0';
+				f->st.ranges_len = rec.ranges_len;
+			}
+		}
+		close(fds[i]);
+
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+		    || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = -ECHILD;
+	}
+
+	free(pids);
+	free(fds);
+	return rc;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -268,8 +610,10 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -J, --json            use JSON output format\n"), out);
 	fputs(_(" -b, --bytes           print sizes in bytes rather than in human readable format\n"), out);
+	fputs(_(" -j, --jobs <num>      scan files by <num> processes\n"), out);
 	fputs(_(" -n, --noheadings      don't print headings\n"), out);
 	fputs(_(" -o, --output <list>   output columns\n"), out);
+	fputs(_(" -R, --recursive       scan directories recursively\n"), out);
 	fputs(_(" -r, --raw             use raw output format\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -288,18 +632,22 @@ static void __attribute__((__noreturn__)) usage(void)
 int main(int argc, char ** argv)
 {
 	int c;
-	size_t i;
+	size_t i, nfiles = 0;
 	int rc = EXIT_SUCCESS;
 	char *outarg = NULL;
+	struct fincore_file *files = NULL;
 
 	struct fincore_control ctl = {
-		.pagesize = getpagesize()
+		.pagesize = getpagesize(),
+		.jobs = 1
 	};
 
 	static const struct option longopts[] = {
 		{ "bytes",      no_argument, NULL, 'b' },
+		{ "jobs",       required_argument, NULL, 'j' },
 		{ "noheadings", no_argument, NULL, 'n' },
 		{ "output",     required_argument, NULL, 'o' },
+		{ "recursive",  no_argument, NULL, 'R' },
 		{ "version",    no_argument, NULL, 'V' },
 		{ "help",	no_argument, NULL, 'h' },
 		{ "json",       no_argument, NULL, 'J' },
@@ -312,11 +660,16 @@ int main(int argc, char ** argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long (argc, argv, "bno:JrVh", longopts, NULL)) != -1) {
+	while ((c = getopt_long (argc, argv, "bj:no:JRrVh", longopts, NULL)) != -1) {
 		switch (c) {
 		case 'b':
 			ctl.bytes = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'n':
 			ctl.noheadings = 1;
 			break;
@@ -326,6 +679,9 @@ int main(int argc, char ** argv)
 		case 'J':
 			ctl.json = 1;
 			break;
+		case 'R':
+			ctl.recursive = 1;
+			break;
 		case 'r':
 			ctl.raw = 1;
 			break;
@@ -355,6 +711,21 @@ int main(int argc, char ** argv)
 					 &ncolumns, column_name_to_id) < 0)
 		return EXIT_FAILURE;
 
+	for (i = 0; i < ncolumns; i++) {
+		switch (get_column_id(i)) {
+		case COL_RANGES:
+			ctl.ranges = 1;
+			break;
+		case COL_HIST:
+			ctl.hist = 1;
+			break;
+		}
+	}
+
+	ctl.window_pages = sizeof(void *) >= 8 ? N_PAGES_IN_WINDOW_64 :
+						 N_PAGES_IN_WINDOW;
+	ctl.vec = xmalloc(ctl.window_pages);
+
 	scols_init_debug(0);
 	ctl.tb = scols_new_table();
 	if (!ctl.tb)
@@ -376,11 +747,30 @@ int main(int argc, char ** argv)
 	for(; optind < argc; optind++) {
 		char *name = argv[optind];
 		struct stat sb;
-		off_t count_incore = 0;
 
-		switch (fincore_name(&ctl, name, &sb, &count_incore)) {
+		if (ctl.recursive && stat(name, &sb) == 0 && S_ISDIR(sb.st_mode))
+			add_directory(&files, &nfiles, name);
+		else
+			add_file(&files, &nfiles, xstrdup(name));
+	}
+
+	if (ctl.jobs > nfiles)
+		ctl.jobs = max(nfiles, (size_t) 1);
+
+	if (ctl.jobs > 1) {
+		if (fincore_files_parallel(&ctl, files, nfiles) != 0)
+			rc = EXIT_FAILURE;
+	} else {
+		for (i = 0; i < nfiles; i++)
+			files[i].rc = fincore_name(&ctl, files[i].name, &files[i].st);
+	}
+
+	for (i = 0; i < nfiles; i++) {
+		struct fincore_file *f = &files[i];
+
+		switch (f->rc) {
 		case 0:
-			add_output_data(&ctl, name, sb.st_size, count_incore);
+			add_output_data(&ctl, f->name, &f->st);
 			break;
 		case 1:
 			break; /* ignore */
@@ -393,5 +783,12 @@ int main(int argc, char ** argv)
 	scols_print_table(ctl.tb);
 	scols_unref_table(ctl.tb);
 
+	for (i = 0; i < nfiles; i++) {
+		free(files[i].name);
+		free(files[i].st.ranges);
+	}
+	free(files);
+	free(ctl.vec);
+
 	return rc;
 }
@@ -6,6 +6,8 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 #include <libmount.h>
 #include <blkid.h>
 #include <sys/utsname.h>
@@ -14,12 +16,14 @@
 #include "c.h"
 #include "strutils.h"
 #include "xalloc.h"
+#include "monotonic.h"
 
 #include "findmnt.h"
 
 struct verify_context {
 	struct libmnt_fs	*fs;
 	struct libmnt_table	*tb;
+	FILE			*out;
 
 	char	**fs_ary;
 	size_t	fs_num;
@@ -34,13 +38,13 @@ struct verify_context {
 static void verify_mesg(struct verify_context *vfy, char type, const char *fmt, va_list ap)
 {
 	if (!vfy->target_printed) {
-		fprintf(stdout, "%s\n", mnt_fs_get_target(vfy->fs));
+		fprintf(vfy->out, "%s\n", mnt_fs_get_target(vfy->fs));
 		vfy->target_printed = 1;
 	}
 
-	fprintf(stdout, "   [%c] ", type);
-	vfprintf(stdout, fmt, ap);
-	fputc('\n', stdout);
+	fprintf(vfy->out, "   [%c] ", type);
+	vfprintf(vfy->out, fmt, ap);
+	fputc('\n', vfy->out);
 }
 
 static int verify_warn(struct verify_context *vfy, const char *fmt, ...)
@@ -265,28 +269,44 @@ static int verify_swaparea(struct verify_context *vfy)
 	return 0;
 }
 
-static int is_supported_filesystem(struct verify_context *vfy, const char *name)
+static int cmp_filesystems(const void *a, const void *b)
 {
-	size_t n;
+	return strcmp(*((char * const *) a), *((char * const *) b));
+}
 
+/* the list is sorted by sort_filesystems() after read */
+static int is_supported_filesystem(struct verify_context *vfy, const char *name)
+{
 	if (!vfy->fs_num)
 		return 0;
 
-	for (n = 0; n < vfy->fs_num; n++ ) {
-		if (strcmp(vfy->fs_ary[n], name) == 0)
-			return 1;
-	}
+	return bsearch(&name, vfy->fs_ary, vfy->fs_num,
+		       sizeof(char *), cmp_filesystems) != NULL;
+}
 
-	return 0;
+/* sorts the list and removes duplicates */
+static void sort_filesystems(struct verify_context *vfy)
+{
+	size_t i, n = 0;
+
+	if (!vfy->fs_num)
+		return;
+
+	qsort(vfy->fs_ary, vfy->fs_num, sizeof(char *), cmp_filesystems);
+
+	for (i = 1; i < vfy->fs_num; i++) {
+		if (strcmp(vfy->fs_ary[n], vfy->fs_ary[i]) == 0)
+			free(vfy->fs_ary[i]);
+		else
+			vfy->fs_ary[++n] = vfy->fs_ary[i];
+	}
+	vfy->fs_num = n + 1;
 }
 
 static int add_filesystem(struct verify_context *vfy, const char *name)
 {
 	#define MYCHUNK	16
 
-	if (is_supported_filesystem(vfy, name))
-		return 0;
-
 	if (vfy->fs_alloc == 0 || vfy->fs_num + 1 <= vfy->fs_alloc) {
 		vfy->fs_alloc = ((vfy->fs_alloc + 1 + MYCHUNK) / MYCHUNK) * MYCHUNK;
 		vfy->fs_ary = xrealloc(vfy->fs_ary, vfy->fs_alloc * sizeof(char *));
@@ -468,10 +488,159 @@ static int verify_filesystem(struct verify_context *vfy)
 	return rc;
 }
 
-int verify_table(struct libmnt_table *tb)
+/* verifies vfy->fs, returns non-zero in case of fatal error */
+static int verify_entry(struct verify_context *vfy, int check_order)
+{
+	struct timeval start, end;
+	int rc = 0;
+
+	gettime_monotonic(&start);
+
+	vfy->target_printed = 0;
+	if (check_order)
+		rc = verify_order(vfy);
+	if (!rc)
+		rc = verify_filesystem(vfy);
+
+	gettime_monotonic(&end);
+	verify_ok(vfy, _("verified in %.3f seconds"),
+			(end.tv_sec - start.tv_sec) +
+			(end.tv_usec - start.tv_usec) / 1000000.0);
+	return rc;
+}
+
+/*
+ * --jobs result of one entry, followed by @size bytes of the output
+ */
+struct verify_result {
+	size_t	idx;
+	size_t	size;
+	int	nwarnings;
+	int	nerrors;
+	int	rc;
+};
+
+/* verifies every @njobs-th entry starting at @first, writes results to @f */
+static void verify_entries_part(struct verify_context *vfy,
+				struct libmnt_fs **ents, size_t nents,
+				size_t first, size_t njobs,
+				int check_order, FILE *f)
+{
+	size_t i;
+
+	for (i = first; i < nents; i += njobs) {
+		struct verify_result res = { .idx = i };
+		char *buf = NULL;
+
+		vfy->out = open_memstream(&buf, &res.size);
+		if (!vfy->out)
+			err(EXIT_FAILURE, _("cannot allocate output buffer"));
+
+		vfy->fs = ents[i];
+		vfy->nwarnings = vfy->nerrors = 0;
+		res.rc = verify_entry(vfy, check_order);
+		res.nwarnings = vfy->nwarnings;
+		res.nerrors = vfy->nerrors;
+
+		fclose(vfy->out);
+		if (fwrite(&res, sizeof(res), 1, f) != 1
+		    || (res.size && fwrite(buf, 1, res.size, f) != res.size))
+			err(EXIT_FAILURE, _("write failed"));
+		free(buf);
+	}
+}
+
+/*
+ * Verifies the entries by @njobs processes. The output of the entries is
+ * collected in temporary files and printed in the original order.
+ */
+static int verify_entries_parallel(struct verify_context *vfy,
+				   struct libmnt_fs **ents, size_t nents,
+				   size_t njobs, int check_order)
+{
+	struct verify_result *res;
+	char **bufs;
+	FILE **files;
+	size_t i;
+	int rc = 0;
+
+	njobs = min(njobs, nents);
+	files = xcalloc(njobs, sizeof(FILE *));
+	res = xcalloc(nents, sizeof(struct verify_result));
+	bufs = xcalloc(nents, sizeof(char *));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < njobs; i++) {
+		pid_t pid;
+
+		files[i] = tmpfile();
+		if (!files[i])
+			err(EXIT_FAILURE, _("cannot create temporary file"));
+
+		pid = fork();
+		if (pid < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (pid == 0) {
+			verify_entries_part(vfy, ents, nents, i, njobs,
+					    check_order, files[i]);
+			if (fflush(files[i]) != 0)
+				_exit(EXIT_FAILURE);
+			_exit(EXIT_SUCCESS);
+		}
+	}
+
+	for (i = 0; i < njobs; i++) {
+		int status;
+
+		if (wait(&status) < 0)
+			err(EXIT_FAILURE, _("waitpid failed"));
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = -1;
+	}
+
+	/* read results */
+	for (i = 0; i < njobs; i++) {
+		struct verify_result r;
+
+		rewind(files[i]);
+		while (fread(&r, sizeof(r), 1, files[i]) == 1 && r.idx < nents) {
+			res[r.idx] = r;
+			bufs[r.idx] = xmalloc(r.size + 1);
+			if (r.size && fread(bufs[r.idx], 1, r.size, files[i]) != r.size)
+				break;
+		}
+		fclose(files[i]);
+	}
+
+	/* print results in the original order */
+	for (i = 0; rc == 0 && i < nents; i++) {
+		if (!bufs[i]) {
+			warnx(_("%s: verification failed"), mnt_fs_get_target(ents[i]));
+			rc = -1;
+			break;
+		}
+		fwrite(bufs[i], 1, res[i].size, stdout);
+		vfy->nwarnings += res[i].nwarnings;
+		vfy->nerrors += res[i].nerrors;
+		rc = res[i].rc;
+	}
+
+	for (i = 0; i < nents; i++)
+		free(bufs[i]);
+	free(bufs);
+	free(res);
+	free(files);
+	return rc;
+}
+
+int verify_table(struct libmnt_table *tb, size_t njobs)
 {
 	struct verify_context vfy = { .nerrors = 0 };
 	struct libmnt_iter *itr;
+	struct libmnt_fs **ents = NULL, *fs;
+	size_t i, nents = 0;
 	int rc = 0;		/* overall return code (alloc errors, etc.) */
 	int check_order = is_listall_mode();
 	static int has_read_fs = 0;
@@ -483,27 +652,44 @@ int verify_table(struct libmnt_table *tb)
 	}
 
 	vfy.tb = tb;
+	vfy.out = stdout;
 
 	if (has_read_fs == 0) {
 		read_proc_filesystems(&vfy);
 		read_kernel_filesystems(&vfy);
+		sort_filesystems(&vfy);
 		has_read_fs = 1;
 	}
 
-	while (rc == 0 && (vfy.fs = get_next_fs(tb, itr))) {
-		vfy.target_printed = 0;
-		if (check_order)
-			rc = verify_order(&vfy);
-		if (!rc)
-			rc = verify_filesystem(&vfy);
+	while ((fs = get_next_fs(tb, itr))) {
+		ents = xrealloc(ents, (nents + 1) * sizeof(struct libmnt_fs *));
+		ents[nents++] = fs;
 
 		if (flags & FL_FIRSTONLY)
 			break;
 		flags |= FL_NOSWAPMATCH;
 	}
 
+	if (njobs > 1 && nents > 1) {
+		/* resolve tags only once, the cache is shared by the processes */
+		for (i = 0; i < nents; i++) {
+			const char *tag = NULL, *val = NULL;
+
+			if (!mnt_fs_get_srcpath(ents[i])
+			    && mnt_fs_get_tag(ents[i], &tag, &val) == 0)
+				ignore_result( mnt_resolve_tag(tag, val, cache) );
+		}
+		rc = verify_entries_parallel(&vfy, ents, nents, njobs, check_order);
+	} else {
+		for (i = 0; rc == 0 && i < nents; i++) {
+			vfy.fs = ents[i];
+			rc = verify_entry(&vfy, check_order);
+		}
+	}
+
 done:
 	mnt_free_iter(itr);
+	free(ents);
 
 	/* summary */
 	if (vfy.nerrors || parse_nerrors || vfy.nwarnings) {
@@ -30,6 +30,8 @@
 #endif
 #include <assert.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
 #include <sys/statvfs.h>
 #include <sys/types.h>
 #ifdef HAVE_LIBUDEV
@@ -46,6 +48,8 @@
 #include "xalloc.h"
 #include "optutils.h"
 #include "mangle.h"
+#include "carefulputc.h"
+#include "monotonic.h"
 
 #include "findmnt.h"
 
@@ -1062,8 +1066,142 @@ static int poll_match(struct libmnt_fs *fs)
 	return rc;
 }
 
+/*
+ * --poll statistics, see --poll-summary
+ */
+struct poll_stats {
+	size_t		nwakeups;	/* table re-read */
+	size_t		nevents;	/* printed changes */
+	struct timeval	start;
+	double		lat_sum;	/* seconds from wakeup to output */
+	double		lat_max;
+};
+
+static volatile sig_atomic_t poll_stop;
+
+static void poll_stop_handler(int sig __attribute__((__unused__)))
+{
+	poll_stop = 1;
+}
+
+static double timeval_diff(struct timeval *a, struct timeval *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_usec - b->tv_usec) / 1000000.0;
+}
+
+static void poll_stats_update(struct poll_stats *st, struct timeval *wakeup,
+			      size_t nevents)
+{
+	struct timeval now;
+	double lat;
+
+	gettime_monotonic(&now);
+	lat = timeval_diff(&now, wakeup);
+
+	st->nwakeups++;
+	st->nevents += nevents;
+	st->lat_sum += lat;
+	if (lat > st->lat_max)
+		st->lat_max = lat;
+}
+
+static void poll_stats_print(struct poll_stats *st)
+{
+	struct timeval now;
+	double sec;
+
+	gettime_monotonic(&now);
+	sec = timeval_diff(&now, &st->start);
+
+	fprintf(stderr, _("%zu events in %zu wakeups in %.3f seconds "
+			  "(%.2f events/s), latency avg %.3f ms, max %.3f ms\n"),
+		st->nevents, st->nwakeups, sec,
+		sec > 0 ? st->nevents / sec : 0.0,
+		st->nwakeups ? st->lat_sum * 1000 / st->nwakeups : 0.0,
+		st->lat_max * 1000);
+}
+
+/*
+ * Prints --poll changes as newline-delimited JSON, one object per change.
+ */
+static void print_json_changes(struct libscols_table *table)
+{
+	struct libscols_iter *itr = scols_new_iter(SCOLS_ITER_FORWARD);
+	struct libscols_line *ln;
+	FILE *out = scols_table_get_stream(table);
+
+	if (!itr)
+		err(EXIT_FAILURE, _("failed to allocate output iterator"));
+
+	while (scols_table_next_line(table, itr, &ln) == 0) {
+		size_t i;
+
+		fputc('{', out);
+		for (i = 0; i < ncolumns; i++) {
+			struct libscols_column *cl = scols_table_get_column(table, i);
+			const char *name = scols_cell_get_data(scols_column_get_header(cl));
+			const char *data = scols_cell_get_data(scols_line_get_cell(ln, i));
+
+			if (i)
+				fputc(',', out);
+			fputs_quoted_json_lower(name, out);
+			fputc(':', out);
+			if (data)
+				fputs_quoted_json(data, out);
+			else
+				fputs("null", out);
+		}
+		fputs("}\n", out);
+	}
+	scols_free_iter(itr);
+}
+
+/*
+ * Prints the changes from @diff, returns number of the printed changes or
+ * negative number in case of error.
+ */
+static int print_poll_changes(struct libmnt_tabdiff *diff, struct libmnt_iter *itr,
+			      struct libscols_table *table, int direction)
+{
+	struct libmnt_fs *old, *new;
+	int change, count = 0, rc = 0;
+
+	mnt_reset_iter(itr, direction);
+	while(mnt_tabdiff_next_change(
+			diff, itr, &old, &new, &change) == 0) {
+
+		if (!has_poll_action(change))
+			continue;
+		if (!poll_match(new ? new : old))
+			continue;
+		count++;
+		rc = !add_tabdiff_line(table, new, old, change);
+		if (rc)
+			return -1;
+		if (flags & FL_FIRSTONLY)
+			break;
+	}
+
+	if (count) {
+		if (flags & FL_JSON)
+			print_json_changes(table);
+		else {
+			rc = scols_table_print_range(table, NULL, NULL);
+			if (rc == 0)
+				fputc('\n', scols_table_get_stream(table));
+		}
+		fflush(stdout);
+	}
+
+	/* remove already printed lines to reduce memory usage */
+	scols_table_remove_lines(table);
+
+	return rc ? -1 : count;
+}
+
 static int poll_table(struct libmnt_table *tb, const char *tabfile,
-		  int timeout, struct libscols_table *table, int direction)
+		  int timeout, struct libscols_table *table, int direction,
+		  struct poll_stats *st)
 {
 	FILE *f = NULL;
 	int rc = -1;
@@ -1072,6 +1210,8 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 	struct libmnt_tabdiff *diff = NULL;
 	struct pollfd fds[1];
 
+	mnt_ref_table(tb);	/* swapped with tb_new below */
+
 	tb_new = mnt_new_table();
 	if (!tb_new) {
 		warn(_("failed to initialize libmount table"));
@@ -1107,16 +1247,19 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	while (1) {
 		struct libmnt_table *tmp;
-		struct libmnt_fs *old, *new;
-		int change, count;
+		struct timeval wakeup;
+		int count;
 
 		count = poll(fds, 1, timeout);
 		if (count == 0)
 			break;	/* timeout */
 		if (count < 0) {
+			if (errno == EINTR && poll_stop)
+				break;
 			warn(_("poll() failed"));
 			goto done;
 		}
+		gettime_monotonic(&wakeup);
 
 		rewind(f);
 		rc = mnt_table_parse_stream(tb_new, f, tabfile);
@@ -1125,40 +1268,233 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 		if (rc < 0)
 			goto done;
 
-		count = 0;
-		mnt_reset_iter(itr, direction);
-		while(mnt_tabdiff_next_change(
-				diff, itr, &old, &new, &change) == 0) {
-
-			if (!has_poll_action(change))
-				continue;
-			if (!poll_match(new ? new : old))
-				continue;
-			count++;
-			rc = !add_tabdiff_line(table, new, old, change);
-			if (rc)
-				goto done;
-			if (flags & FL_FIRSTONLY)
-				break;
+		count = print_poll_changes(diff, itr, table, direction);
+		if (count < 0)
+			goto done;
+		poll_stats_update(st, &wakeup, count);
+
+		/* swap tables */
+		tmp = tb;
+		tb = tb_new;
+		tb_new = tmp;
+
+		mnt_reset_table(tb_new);
+
+		if (count && (flags & FL_FIRSTONLY))
+			break;
+	}
+
+	rc = 0;
+done:
+	mnt_unref_table(tb);
+	mnt_unref_table(tb_new);
+	mnt_free_tabdiff(diff);
+	mnt_free_iter(itr);
+	if (f)
+		fclose(f);
+	return rc;
+}
+
+static int streq_or_null(const char *a, const char *b)
+{
+	if (!a || !b)
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
+static int fs_is_unchanged(struct libmnt_fs *a, struct libmnt_fs *b)
+{
+	return mnt_fs_get_id(a) == mnt_fs_get_id(b)
+		&& mnt_fs_get_parent_id(a) == mnt_fs_get_parent_id(b)
+		&& streq_or_null(mnt_fs_get_target(a), mnt_fs_get_target(b))
+		&& streq_or_null(mnt_fs_get_source(a), mnt_fs_get_source(b))
+		&& streq_or_null(mnt_fs_get_root(a), mnt_fs_get_root(b))
+		&& streq_or_null(mnt_fs_get_options(a), mnt_fs_get_options(b));
+}
+
+/* copies @n entries starting at @skip from @tb to @win */
+static int copy_window(struct libmnt_table *tb, struct libmnt_table *win,
+		       int skip, int n)
+{
+	struct libmnt_iter *itr = mnt_new_iter(MNT_ITER_FORWARD);
+	struct libmnt_fs *fs;
+	int rc = 0;
+
+	if (!itr)
+		return -ENOMEM;
+
+	while (n > 0 && mnt_table_next_fs(tb, itr, &fs) == 0) {
+		struct libmnt_fs *x;
+
+		if (skip) {
+			skip--;
+			continue;
 		}
+		x = mnt_copy_fs(NULL, fs);
+		if (!x) {
+			rc = -ENOMEM;
+			break;
+		}
+		rc = mnt_table_add_fs(win, x);
+		mnt_unref_fs(x);
+		if (rc)
+			break;
+		n--;
+	}
+	mnt_free_iter(itr);
+	return rc;
+}
 
-		if (count) {
-			rc = scols_table_print_range(table, NULL, NULL);
-			if (rc == 0)
-				fputc('\n', scols_table_get_stream(table));
-			fflush(stdout);
-			if (rc)
-				goto done;
+/*
+ * The kernel keeps the order of the mount table, the new mounts are appended
+ * and the unmounted entries removed. It means that usually only a small
+ * window in the middle of the tables differs. The common head and tail are
+ * skipped, and only the windows are compared by mnt_diff_tables().
+ */
+static int diff_tables_window(struct libmnt_tabdiff *diff,
+			      struct libmnt_table *old_tab,
+			      struct libmnt_table *new_tab,
+			      struct libmnt_table *old_win,
+			      struct libmnt_table *new_win)
+{
+	struct libmnt_iter *io, *in;
+	struct libmnt_fs *o, *n;
+	int no = mnt_table_get_nents(old_tab);
+	int nn = mnt_table_get_nents(new_tab);
+	int head = 0, tail = 0, rc = -ENOMEM;
+
+	io = mnt_new_iter(MNT_ITER_FORWARD);
+	in = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!io || !in)
+		goto done;
+
+	while (mnt_table_next_fs(old_tab, io, &o) == 0 &&
+	       mnt_table_next_fs(new_tab, in, &n) == 0 &&
+	       fs_is_unchanged(o, n))
+		head++;
+
+	mnt_reset_iter(io, MNT_ITER_BACKWARD);
+	mnt_reset_iter(in, MNT_ITER_BACKWARD);
+
+	while (head + tail < min(no, nn) &&
+	       mnt_table_next_fs(old_tab, io, &o) == 0 &&
+	       mnt_table_next_fs(new_tab, in, &n) == 0 &&
+	       fs_is_unchanged(o, n))
+		tail++;
+
+	rc = copy_window(old_tab, old_win, head, no - head - tail);
+	if (!rc)
+		rc = copy_window(new_tab, new_win, head, nn - head - tail);
+	if (!rc)
+		rc = mnt_diff_tables(diff, old_win, new_win);
+done:
+	mnt_free_iter(io);
+	mnt_free_iter(in);
+	return rc;
+}
+
+/*
+ * --poll for the mount table of the current namespace. The kernel (and for
+ * --mtab also the userspace utab) changes are monitored by libmnt_monitor,
+ * and the events received within @coalesce milliseconds are handled together.
+ */
+static int monitor_table(struct libmnt_table *tb, int tabtype,
+		  int timeout, int coalesce, struct libscols_table *table,
+		  int direction, struct poll_stats *st)
+{
+	int rc = -1;
+	struct libmnt_monitor *mn;
+	struct libmnt_iter *itr = NULL;
+	struct libmnt_table *tb_new = NULL, *old_win = NULL, *new_win = NULL;
+	struct libmnt_tabdiff *diff = NULL;
+
+	mnt_ref_table(tb);	/* swapped with tb_new below */
+
+	mn = mnt_new_monitor();
+	if (!mn) {
+		warn(_("failed to initialize libmount monitor"));
+		goto done;
+	}
+	if (mnt_monitor_enable_kernel(mn, TRUE) ||
+	    (tabtype == TABTYPE_MTAB &&
+	     mnt_monitor_enable_userspace(mn, TRUE, NULL))) {
+		warn(_("failed to initialize libmount monitor"));
+		goto done;
+	}
+
+	tb_new = mnt_new_table();
+	old_win = mnt_new_table();
+	new_win = mnt_new_table();
+	if (!tb_new || !old_win || !new_win) {
+		warn(_("failed to initialize libmount table"));
+		goto done;
+	}
+
+	itr = mnt_new_iter(direction);
+	if (!itr) {
+		warn(_("failed to initialize libmount iterator"));
+		goto done;
+	}
+
+	diff = mnt_new_tabdiff();
+	if (!diff) {
+		warn(_("failed to initialize libmount tabdiff"));
+		goto done;
+	}
+
+	/* cache is unnecessary to detect changes */
+	mnt_table_set_cache(tb, NULL);
+	mnt_table_set_parser_errcb(tb_new, parser_errcb);
+
+	while (1) {
+		struct libmnt_table *tmp;
+		struct timeval wakeup, now;
+		int count;
+
+		rc = mnt_monitor_wait(mn, timeout);
+		if (rc == 0)
+			break;	/* timeout */
+		if (rc < 0) {
+			if (rc == -EINTR && poll_stop)
+				break;
+			errno = -rc;
+			warn(_("failed to read libmount monitor events"));
+			goto done;
+		}
+		gettime_monotonic(&wakeup);
+		mnt_monitor_event_cleanup(mn);
+
+		/* coalesce the next events, but don't wait forever */
+		while (coalesce > 0 && !poll_stop
+		       && mnt_monitor_wait(mn, coalesce) > 0) {
+			mnt_monitor_event_cleanup(mn);
+			gettime_monotonic(&now);
+			if (timeval_diff(&now, &wakeup) * 1000 > 10 * coalesce)
+				break;
 		}
 
+		if (tabtype == TABTYPE_MTAB)
+			rc = mnt_table_parse_mtab(tb_new, NULL);
+		else
+			rc = mnt_table_parse_file(tb_new, _PATH_PROC_MOUNTINFO);
+		if (!rc)
+			rc = diff_tables_window(diff, tb, tb_new, old_win, new_win);
+		if (rc < 0)
+			goto done;
+
+		count = print_poll_changes(diff, itr, table, direction);
+		if (count < 0)
+			goto done;
+		poll_stats_update(st, &wakeup, count);
+
 		/* swap tables */
 		tmp = tb;
 		tb = tb_new;
 		tb_new = tmp;
 
-		/* remove already printed lines to reduce memory usage */
-		scols_table_remove_lines(table);
 		mnt_reset_table(tb_new);
+		mnt_reset_table(old_win);
+		mnt_reset_table(new_win);
 
 		if (count && (flags & FL_FIRSTONLY))
 			break;
@@ -1166,11 +1502,13 @@ static int poll_table(struct libmnt_table *tb, const char *tabfile,
 
 	rc = 0;
 done:
+	mnt_unref_table(tb);
 	mnt_unref_table(tb_new);
+	mnt_unref_table(old_win);
+	mnt_unref_table(new_win);
 	mnt_free_tabdiff(diff);
 	mnt_free_iter(itr);
-	if (f)
-		fclose(f);
+	mnt_unref_monitor(mn);
 	return rc;
 }
 
@@ -1207,6 +1545,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputc('\n', out);
 	fputs(_(" -p, --poll[=<list>]    monitor changes in table of mounted filesystems\n"), out);
 	fputs(_(" -w, --timeout <num>    upper limit in milliseconds that --poll will block\n"), out);
+	fputs(_("     --coalesce <num>   handle --poll events within <num> milliseconds together\n"), out);
+	fputs(_("     --poll-summary     print number of events and latency when --poll ends\n"), out);
 	fputc('\n', out);
 
 	fputs(_(" -A, --all              disable all built-in filters, print all filesystems\n"), out);
@@ -1242,6 +1582,7 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputc('\n', out);
 	fputs(_(" -x, --verify           verify mount table content (default is fstab)\n"), out);
+	fputs(_(" -j, --jobs <num>       verify up to <num> entries in parallel\n"), out);
 	fputs(_("     --verbose          print more details\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
@@ -1262,8 +1603,9 @@ int main(int argc, char *argv[])
 	char **tabfiles = NULL;
 	int direction = MNT_ITER_FORWARD;
 	int verify = 0;
-	int c, rc = -1, timeout = -1;
-	int ntabfiles = 0, tabtype = 0;
+	int c, rc = -1, timeout = -1, coalesce = 0, poll_summary = 0;
+	size_t njobs = 1;
+	int ntabfiles = 0, tabtype = 0, polltype;
 	char *outarg = NULL;
 	size_t i;
 	int force_tree = 0, istree = 0;
@@ -1272,7 +1614,9 @@ int main(int argc, char *argv[])
 
 	enum {
                 FINDMNT_OPT_VERBOSE = CHAR_MAX + 1,
-		FINDMNT_OPT_TREE
+		FINDMNT_OPT_TREE,
+		FINDMNT_OPT_COALESCE,
+		FINDMNT_OPT_POLLSUMMARY
 	};
 
 	static const struct option longopts[] = {
@@ -1280,6 +1624,7 @@ int main(int argc, char *argv[])
 		{ "ascii",	    no_argument,       NULL, 'a'		 },
 		{ "bytes",	    no_argument,       NULL, 'b'		 },
 		{ "canonicalize",   no_argument,       NULL, 'c'		 },
+		{ "coalesce",	    required_argument, NULL, FINDMNT_OPT_COALESCE },
 		{ "direction",	    required_argument, NULL, 'd'		 },
 		{ "df",		    no_argument,       NULL, 'D'		 },
 		{ "evaluate",	    no_argument,       NULL, 'e'		 },
@@ -1287,6 +1632,7 @@ int main(int argc, char *argv[])
 		{ "fstab",	    no_argument,       NULL, 's'		 },
 		{ "help",	    no_argument,       NULL, 'h'		 },
 		{ "invert",	    no_argument,       NULL, 'i'		 },
+		{ "jobs",	    required_argument, NULL, 'j'		 },
 		{ "json",	    no_argument,       NULL, 'J'		 },
 		{ "kernel",	    no_argument,       NULL, 'k'		 },
 		{ "list",	    no_argument,       NULL, 'l'		 },
@@ -1297,6 +1643,7 @@ int main(int argc, char *argv[])
 		{ "options",	    required_argument, NULL, 'O'		 },
 		{ "output",	    required_argument, NULL, 'o'		 },
 		{ "poll",	    optional_argument, NULL, 'p'		 },
+		{ "poll-summary",   no_argument,       NULL, FINDMNT_OPT_POLLSUMMARY },
 		{ "pairs",	    no_argument,       NULL, 'P'		 },
 		{ "raw",	    no_argument,       NULL, 'r'		 },
 		{ "types",	    required_argument, NULL, 't'		 },
@@ -1324,7 +1671,7 @@ int main(int argc, char *argv[])
 		{ 'N','k','m','s' },		/* task,kernel,mtab,fstab */
 		{ 'P','l','r','x' },		/* pairs,list,raw,verify */
 		{ 'p','x' },			/* poll,verify */
-		{ 'm','p','s' },		/* mtab,poll,fstab */
+		{ 'p','s' },			/* poll,fstab */
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -1338,7 +1685,7 @@ int main(int argc, char *argv[])
 	flags |= FL_TREE;
 
 	while ((c = getopt_long(argc, argv,
-				"AabCcDd:ehiJfF:o:O:p::PklmM:nN:rst:uvRS:T:Uw:Vx",
+				"AabCcDd:ehiJj:fF:o:O:p::PklmM:nN:rst:uvRS:T:Uw:Vx",
 				longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
@@ -1384,6 +1731,11 @@ int main(int argc, char *argv[])
 		case 'J':
 			flags |= FL_JSON;
 			break;
+		case 'j':
+			njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!njobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'f':
 			flags |= FL_FIRSTONLY;
 			break;
@@ -1476,6 +1828,12 @@ int main(int argc, char *argv[])
 		case FINDMNT_OPT_VERBOSE:
 			flags |= FL_VERBOSE;
 			break;
+		case FINDMNT_OPT_COALESCE:
+			coalesce = strtos32_or_err(optarg, _("invalid coalesce argument"));
+			break;
+		case FINDMNT_OPT_POLLSUMMARY:
+			poll_summary = 1;
+			break;
 		case FINDMNT_OPT_TREE:
 			force_tree = 1;
 			break;
@@ -1557,6 +1915,9 @@ int main(int argc, char *argv[])
 	if (!tb)
 		goto leave;
 
+	/* --poll --mtab re-reads mountinfo and utab */
+	polltype = tabtype;
+
 	if (tabtype == TABTYPE_MTAB && tab_is_kernel(tb))
 		tabtype = TABTYPE_KERNEL;
 
@@ -1583,7 +1944,7 @@ int main(int argc, char *argv[])
 		mnt_table_uniq_fs(tb, MNT_UNIQ_KEEPTREE, uniq_fs_target_cmp);
 
 	if (verify) {
-		rc = verify_table(tb);
+		rc = verify_table(tb, njobs);
 		goto leave;
 	}
 
@@ -1628,8 +1989,26 @@ int main(int argc, char *argv[])
 	 * Fill in data to the output table
 	 */
 	if (flags & FL_POLL) {
-		/* poll mode (accept the first tabfile only) */
-		rc = poll_table(tb, tabfiles ? *tabfiles : _PATH_PROC_MOUNTINFO, timeout, table, direction);
+		struct poll_stats st = { .nwakeups = 0 };
+
+		if (poll_summary) {
+			struct sigaction sa = { .sa_handler = poll_stop_handler };
+
+			/* no SA_RESTART, interrupt poll() and epoll_wait() */
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGINT, &sa, NULL);
+			sigaction(SIGTERM, &sa, NULL);
+		}
+		gettime_monotonic(&st.start);
+
+		if (tabfiles)
+			/* poll mode (accept the first tabfile only) */
+			rc = poll_table(tb, *tabfiles, timeout, table, direction, &st);
+		else
+			rc = monitor_table(tb, polltype, timeout, coalesce,
+					   table, direction, &st);
+		if (poll_summary)
+			poll_stats_print(&st);
 
 	} else if ((flags & FL_TREE) && !(flags & FL_SUBMOUNTS)) {
 		/* whole tree */
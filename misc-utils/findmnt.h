@@ -34,6 +34,6 @@ extern int parse_nerrors;
 
 extern int is_listall_mode(void);
 extern struct libmnt_fs *get_next_fs(struct libmnt_table *tb, struct libmnt_iter *itr);
-extern int verify_table(struct libmnt_table *tb);
+extern int verify_table(struct libmnt_table *tb, size_t njobs);
 
 #endif /* UTIL_LINUX_FINDMNT_H */
@@ -99,7 +99,22 @@ enum {
 	OPT_ID,
 	OPT_STRUCTURED_DATA_ID,
 	OPT_STRUCTURED_DATA_PARAM,
-	OPT_OCTET_COUNT
+	OPT_OCTET_COUNT,
+	OPT_BATCH
+};
+
+#define LOGGER_INBUF_SIZE	(64 * 1024)	/* stdin buffer */
+#define LOGGER_BATCH_DEFAULT	64		/* --batch default */
+
+/* messages for sendmmsg() */
+struct logger_batch {
+	char *data;			/* the messages */
+	size_t datasz;			/* allocated size of the data */
+	size_t used;			/* used size of the data */
+
+	struct iovec *iov;		/* offsets to data for each message */
+	size_t nmsgs;			/* number of messages */
+	size_t max;			/* max number of messages */
 };
 
 /* rfc5424 structured data */
@@ -115,6 +130,9 @@ struct logger_ctl {
 	int pri;
 	pid_t pid;			/* zero when unwanted */
 	char *hdr;			/* the syslog header (based on protocol) */
+	struct timeval hdr_tv;		/* time used in the header */
+	int hdr_pri;			/* priority used in the header */
+	size_t hdr_usec_off;		/* microseconds offset in the header or 0 */
 	char const *tag;
 	char *msgid;
 	char *unix_socket;		/* -u <path> or default to _PATH_DEVLOG */
@@ -125,6 +143,12 @@ struct logger_ctl {
 	struct list_head user_sds;	/* user defined rfc5424 structured data */
 	struct list_head reserved_sds;	/* standard rfc5424 structured data */
 
+	char *inbuf;			/* stdin buffer */
+	size_t inbuf_pos;
+	size_t inbuf_len;
+
+	struct logger_batch batch;	/* messages not sent yet (--batch) */
+
 	void (*syslogfp)(struct logger_ctl *ctl);
 
 	unsigned int
@@ -386,18 +410,16 @@ static char const *xgetlogin(void)
  * of a leading 0). The function uses a static buffer which is
  * overwritten on the next call (just like ctime() does).
  */
-static char const *rfc3164_current_time(void)
+static char const *rfc3164_current_time(const struct timeval *tv)
 {
 	static char time[32];
-	struct timeval tv;
 	struct tm *tm;
 	static char const * const monthnames[] = {
 		"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug",
 		"Sep", "Oct", "Nov", "Dec"
 	};
 
-	logger_gettimeofday(&tv, NULL);
-	tm = localtime(&tv.tv_sec);
+	tm = localtime(&tv->tv_sec);
 	snprintf(time, sizeof(time),"%s %2d %2.2d:%2.2d:%2.2d",
 		monthnames[tm->tm_mon], tm->tm_mday,
 		tm->tm_hour, tm->tm_min, tm->tm_sec);
@@ -420,6 +442,117 @@ static char const *rfc3164_current_time(void)
 #define iovec_memcmp(ary, idx, str, len)		\
 		memcmp((ary)[(idx) - 1].iov_base, str, len)
 
+/* syslog/journald may follow local socket credentials rather than in the
+ * message PID. If we use --id as root than we can force kernel to accept
+ * another valid PID than the real logger(1) PID.
+ */
+static int need_credentials(const struct logger_ctl *ctl)
+{
+#ifdef SCM_CREDENTIALS
+	return ctl->pid && !ctl->server && ctl->pid != getpid()
+	       && geteuid() == 0 && kill(ctl->pid, 0) == 0;
+#else
+	return 0;
+#endif
+}
+
+/* messages are batched only for datagram sockets, every message is
+ * a separate datagram there
+ */
+static int use_batch(const struct logger_ctl *ctl)
+{
+	return ctl->batch.max > 1 && !ctl->noact && is_connected(ctl)
+	       && ctl->socket_type == TYPE_UDP && !need_credentials(ctl);
+}
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+/* sends all batched messages */
+static void logger_flush_batch(struct logger_ctl *ctl)
+{
+	struct logger_batch *b = &ctl->batch;
+	size_t i, done = 0;
+	int retried = 0;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr *msgs;
+#endif
+
+	if (!b->nmsgs)
+		return;
+
+	/* the offsets to pointers, the data are not reallocated anymore */
+	for (i = 0; i < b->nmsgs; i++)
+		b->iov[i].iov_base = b->data + (size_t) b->iov[i].iov_base;
+
+#ifdef HAVE_SENDMMSG
+	msgs = xcalloc(b->nmsgs, sizeof(struct mmsghdr));
+	for (i = 0; i < b->nmsgs; i++) {
+		msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+	while (done < b->nmsgs) {
+		int rc;
+#ifdef HAVE_SENDMMSG
+		rc = sendmmsg(ctl->fd, msgs + done, b->nmsgs - done, MSG_NOSIGNAL);
+#else
+		struct msghdr message = { .msg_iov = &b->iov[done], .msg_iovlen = 1 };
+
+		rc = sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0 ? -1 : 1;
+#endif
+		if (rc < 0) {
+			/* see write_output() */
+			if (retried) {
+				warn(_("send message failed"));
+				break;
+			}
+			logger_reopen(ctl);
+			retried = 1;
+			continue;
+		}
+		done += rc;
+	}
+#ifdef HAVE_SENDMMSG
+	free(msgs);
+#endif
+	b->nmsgs = 0;
+	b->used = 0;
+}
+
+/* copies the message to the batch, the batch is sent when full */
+static void logger_batch_message(struct logger_ctl *ctl,
+				 const struct iovec *iov, int iovlen)
+{
+	struct logger_batch *b = &ctl->batch;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovlen; i++)
+		len += iov[i].iov_len;
+
+	if (!b->iov)
+		b->iov = xcalloc(b->max, sizeof(struct iovec));
+	if (b->used + len > b->datasz) {
+		b->datasz = max(b->used + len, b->datasz * 2);
+		b->data = xrealloc(b->data, b->datasz);
+	}
+
+	/* the offset is converted to pointer in logger_flush_batch() */
+	b->iov[b->nmsgs].iov_base = (void *) b->used;
+	b->iov[b->nmsgs].iov_len = len;
+	b->nmsgs++;
+
+	for (i = 0; i < iovlen; i++) {
+		memcpy(b->data + b->used, iov[i].iov_base, iov[i].iov_len);
+		b->used += iov[i].iov_len;
+	}
+
+	if (b->nmsgs == b->max)
+		logger_flush_batch(ctl);
+}
+
 /* writes generated buffer to desired destination. For TCP syslog,
  * we use RFC6587 octet-stuffing (unless octet-counting is selected).
  * This is not great, but doing full blown RFC5425 (TLS) looks like
@@ -448,7 +581,10 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 	/* 3) message */
 	iovec_add_string(iov, iovlen, msg, 0);
 
-	if (!ctl->noact && is_connected(ctl)) {
+	if (use_batch(ctl))
+		logger_batch_message(ctl, iov, iovlen);
+
+	else if (!ctl->noact && is_connected(ctl)) {
 		struct msghdr message = { 0 };
 #ifdef SCM_CREDENTIALS
 		struct cmsghdr *cmhp;
@@ -467,14 +603,7 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 		message.msg_iovlen = iovlen;
 
 #ifdef SCM_CREDENTIALS
-		/* syslog/journald may follow local socket credentials rather
-		 * than in the message PID. If we use --id as root than we can
-		 * force kernel to accept another valid PID than the real logger(1)
-		 * PID.
-		 */
-		if (ctl->pid && !ctl->server && ctl->pid != getpid()
-		    && geteuid() == 0 && kill(ctl->pid, 0) == 0) {
-
+		if (need_credentials(ctl)) {
 			message.msg_control = cbuf.control;
 			message.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
 
@@ -496,9 +625,6 @@ static void write_output(struct logger_ctl *ctl, const char *const msg)
 		 * MSG_NOSIGNAL is POSIX.1-2008 compatible, but it for example
 		 * not supported by apple-darwin15.6.0.
 		 */
-#ifndef MSG_NOSIGNAL
-# define MSG_NOSIGNAL 0
-#endif
 		if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0) {
 			logger_reopen(ctl);
 			if (sendmsg(ctl->fd, &message, MSG_NOSIGNAL) < 0)
@@ -534,7 +660,7 @@ static void syslog_rfc3164_header(struct logger_ctl *const ctl)
 		hostname = xstrdup(NILVALUE);
 
 	xasprintf(&ctl->hdr, "<%d>%.15s %s %.200s%s: ",
-		 ctl->pri, rfc3164_current_time(), hostname, ctl->tag, pid);
+		 ctl->pri, rfc3164_current_time(&ctl->hdr_tv), hostname, ctl->tag, pid);
 
 	free(hostname);
 }
@@ -751,10 +877,9 @@ static void syslog_rfc5424_header(struct logger_ctl *const ctl)
 	struct list_head *sd;
 
 	if (ctl->rfc5424_time) {
-		struct timeval tv;
+		struct timeval tv = ctl->hdr_tv;
 		struct tm *tm;
 
-		logger_gettimeofday(&tv, NULL);
 		if ((tm = localtime(&tv.tv_sec)) != NULL) {
 			char fmt[64];
 			const size_t i = strftime(fmt, sizeof(fmt),
@@ -821,6 +946,11 @@ static void syslog_rfc5424_header(struct logger_ctl *const ctl)
 		msgid,
 		structured);
 
+	/* "<pri>1 YYYY-MM-DDTHH:MM:SS.uuuuuu+TZ" */
+	if (ctl->rfc5424_time)
+		ctl->hdr_usec_off = strchr(ctl->hdr, ' ') - ctl->hdr
+				    + sizeof("YYYY-MM-DDTHH:MM:SS.");
+
 	free(time);
 	free(hostname);
 	/* app_name points to ctl->tag, do NOT free! */
@@ -869,14 +999,38 @@ static void syslog_local_header(struct logger_ctl *const ctl)
 	else
 		pid[0] = '\0';
 
-	xasprintf(&ctl->hdr, "<%d>%s %s%s: ", ctl->pri, rfc3164_current_time(),
-		ctl->tag, pid);
+	xasprintf(&ctl->hdr, "<%d>%s %s%s: ", ctl->pri,
+		rfc3164_current_time(&ctl->hdr_tv), ctl->tag, pid);
 }
 
+/*
+ * The header is cached. It's generated again only when the priority or the
+ * time in seconds has been changed, otherwise only the microseconds in the
+ * RFC5424 time stamp are updated.
+ */
 static void generate_syslog_header(struct logger_ctl *const ctl)
 {
+	struct timeval tv;
+
+	logger_gettimeofday(&tv, NULL);
+
+	if (ctl->hdr && ctl->hdr_pri == ctl->pri
+	    && ctl->hdr_tv.tv_sec == tv.tv_sec) {
+		if (ctl->hdr_usec_off && ctl->hdr_tv.tv_usec != tv.tv_usec) {
+			char usec[7];
+
+			snprintf(usec, sizeof(usec), "%06u", (unsigned int) tv.tv_usec);
+			memcpy(ctl->hdr + ctl->hdr_usec_off, usec, 6);
+		}
+		ctl->hdr_tv = tv;
+		return;
+	}
+
 	free(ctl->hdr);
 	ctl->hdr = NULL;
+	ctl->hdr_tv = tv;
+	ctl->hdr_pri = ctl->pri;
+	ctl->hdr_usec_off = 0;
 	ctl->syslogfp(ctl);
 }
 
@@ -950,6 +1104,34 @@ static void logger_command_line(struct logger_ctl *ctl, char **argv)
 	free(buf);
 }
 
+/* reads the next chunk of stdin; the batched messages are sent before
+ * because read() may block for a long time
+ */
+static int logger_fill_input(struct logger_ctl *ctl)
+{
+	ssize_t rc;
+
+	logger_flush_batch(ctl);
+
+	if (!ctl->inbuf)
+		ctl->inbuf = xmalloc(LOGGER_INBUF_SIZE);
+	do {
+		rc = read(fileno(stdin), ctl->inbuf, LOGGER_INBUF_SIZE);
+	} while (rc < 0 && errno == EINTR);
+
+	ctl->inbuf_pos = 0;
+	ctl->inbuf_len = rc > 0 ? rc : 0;
+	return rc;
+}
+
+/* like getchar(), but without stdio locking and per-character overhead */
+static inline int logger_getc(struct logger_ctl *ctl)
+{
+	if (ctl->inbuf_pos >= ctl->inbuf_len && logger_fill_input(ctl) <= 0)
+		return EOF;
+	return (unsigned char) ctl->inbuf[ctl->inbuf_pos++];
+}
+
 static void logger_stdin(struct logger_ctl *ctl)
 {
 	/* note: we re-generate the syslog header for each log message to
@@ -965,13 +1147,13 @@ static void logger_stdin(struct logger_ctl *ctl)
 	int c;
 	size_t i;
 
-	c = getchar();
+	c = logger_getc(ctl);
 	while (c != EOF) {
 		i = 0;
 		if (ctl->prio_prefix && c == '<') {
 			pri = 0;
 			buf[i++] = c;
-			while (isdigit(c = getchar()) && pri <= 191) {
+			while (isdigit(c = logger_getc(ctl)) && pri <= 191) {
 				buf[i++] = c;
 				pri = pri * 10 + c - '0';
 			}
@@ -993,12 +1175,12 @@ static void logger_stdin(struct logger_ctl *ctl)
 				last_pri = ctl->pri;
 			}
 			if (c != EOF && c != '\n')
-				c = getchar();
+				c = logger_getc(ctl);
 		}
 
 		while (c != EOF && c != '\n' && i < max_usrmsg_size) {
 			buf[i++] = c;
-			c = getchar();
+			c = logger_getc(ctl);
 		}
 		buf[i] = '\0';
 
@@ -1010,17 +1192,22 @@ static void logger_stdin(struct logger_ctl *ctl)
 		}
 
 		if (c == '\n')	/* discard line terminator */
-			c = getchar();
+			c = logger_getc(ctl);
 	}
 
 	free(buf);
 }
 
-static void logger_close(const struct logger_ctl *ctl)
+static void logger_close(struct logger_ctl *ctl)
 {
+	logger_flush_batch(ctl);
+
 	if (ctl->fd != -1 && close(ctl->fd) != 0)
 		err(EXIT_FAILURE, _("close failed"));
 	free(ctl->hdr);
+	free(ctl->inbuf);
+	free(ctl->batch.data);
+	free(ctl->batch.iov);
 }
 
 static void __attribute__((__noreturn__)) usage(void)
@@ -1040,6 +1227,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("     --no-act             do everything except the write the log\n"), out);
 	fputs(_(" -p, --priority <prio>    mark given message with this priority\n"), out);
 	fputs(_("     --octet-count        use rfc6587 octet counting\n"), out);
+	fputs(_("     --batch[=<count>]    send up to <count> messages from stdin at once\n"), out);
 	fputs(_("     --prio-prefix        look for a prefix on every line read from stdin\n"), out);
 	fputs(_(" -s, --stderr             output message to standard error as well\n"), out);
 	fputs(_(" -S, --size <size>        maximum size for a single message\n"), out);
@@ -1117,6 +1305,7 @@ int main(int argc, char **argv)
 		{ "version",	   no_argument,	      0, 'V'		   },
 		{ "help",	   no_argument,	      0, 'h'		   },
 		{ "octet-count",   no_argument,	      0, OPT_OCTET_COUNT   },
+		{ "batch",	   optional_argument, 0, OPT_BATCH	   },
 		{ "prio-prefix",   no_argument,	      0, OPT_PRIO_PREFIX   },
 		{ "rfc3164",	   no_argument,	      0, OPT_RFC3164	   },
 		{ "rfc5424",	   optional_argument, 0, OPT_RFC5424	   },
@@ -1199,6 +1388,13 @@ int main(int argc, char **argv)
 		case OPT_OCTET_COUNT:
 			ctl.octet_count = 1;
 			break;
+		case OPT_BATCH:
+			ctl.batch.max = optarg ? strtou32_or_err(optarg,
+						_("failed to parse batch size")) :
+					LOGGER_BATCH_DEFAULT;
+			if (ctl.batch.max > IOV_MAX)
+				ctl.batch.max = IOV_MAX;
+			break;
 		case OPT_PRIO_PREFIX:
 			ctl.prio_prefix = 1;
 			break;
@@ -56,8 +56,10 @@
 #include <string.h>
 #include <ctype.h>
 #include <getopt.h>
+#include <stdint.h>
 
 #include "nls.h"
+#include "c.h"
 #include "xalloc.h"
 #include "pathnames.h"
 #include "closestream.h"
@@ -73,10 +75,30 @@ static int stringlen;
 static char *string;
 static char *comparbuf;
 
+/*
+ * Line index (--build-index, --index). The file starts with the header and
+ * continues with offsets of all lines in the indexed file. The index uses
+ * native byte order.
+ */
+#define LOOK_INDEX_MAGIC	"LOOKIDX1"
+
+struct look_index_header {
+	char		magic[8];	/* LOOK_INDEX_MAGIC */
+	uint64_t	size;		/* size of the indexed file */
+	int64_t		mtime;		/* modification time of the indexed file */
+	uint64_t	nlines;		/* number of offsets */
+};
+
+static uint64_t *offsets;
+static size_t noffsets;
+
 static char *binary_search (char *, char *);
+static char *index_search (char *, char *);
 static int compare (char *, char *);
 static char *linear_search (char *, char *);
 static int look (char *, char *);
+static int build_index (const char *, char *, char *, struct stat *);
+static void load_index (const char *, struct stat *);
 static void print_from (char *, char *);
 static void __attribute__((__noreturn__)) usage(void);
 
@@ -84,13 +106,22 @@ int
 main(int argc, char *argv[])
 {
 	struct stat sb;
-	int ch, fd, termchar;
-	char *back, *file, *front, *p;
-
+	int ch, fd, termchar, rc;
+	int batch = 0, build = 0, use_index = 0;
+	char *back, *file, *front, *p, *idxfile = NULL;
+	size_t len = 0;
+
+	enum {
+		OPT_BUILD_INDEX = CHAR_MAX + 1,
+		OPT_INDEX
+	};
 	static const struct option longopts[] = {
 		{"alternative", no_argument, NULL, 'a'},
 		{"alphanum", no_argument, NULL, 'd'},
+		{"batch", no_argument, NULL, 'b'},
+		{"build-index", optional_argument, NULL, OPT_BUILD_INDEX},
 		{"ignore-case", no_argument, NULL, 'f'},
+		{"index", optional_argument, NULL, OPT_INDEX},
 		{"terminate", required_argument, NULL, 't'},
 		{"version", no_argument, NULL, 'V'},
 		{"help", no_argument, NULL, 'h'},
@@ -112,11 +143,24 @@ main(int argc, char *argv[])
 	termchar = '\0';
 	string = NULL;		/* just for gcc */
 
-	while ((ch = getopt_long(argc, argv, "adft:Vh", longopts, NULL)) != -1)
+	while ((ch = getopt_long(argc, argv, "abdft:Vh", longopts, NULL)) != -1)
 		switch(ch) {
 		case 'a':
 			file = _PATH_WORDS_ALT;
 			break;
+		case 'b':
+			batch = 1;
+			break;
+		case OPT_BUILD_INDEX:
+			build = 1;
+			if (optarg)
+				idxfile = optarg;
+			break;
+		case OPT_INDEX:
+			use_index = 1;
+			if (optarg)
+				idxfile = optarg;
+			break;
 		case 'd':
 			dflag = 1;
 			break;
@@ -137,22 +181,37 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	switch (argc) {
-	case 2:				/* Don't set -df for user. */
-		string = *argv++;
-		file = *argv;
-		break;
-	case 1:				/* But set -df by default. */
-		dflag = fflag = 1;
-		string = *argv;
-		break;
-	default:
-		warnx(_("bad usage"));
-		errtryhelp(EXIT_FAILURE);
-	}
+	if (batch || build) {
+		/* the strings are read from stdin */
+		switch (argc) {
+		case 1:
+			file = *argv;
+			break;
+		case 0:
+			dflag = fflag = 1;
+			break;
+		default:
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
+	} else {
+		switch (argc) {
+		case 2:				/* Don't set -df for user. */
+			string = *argv++;
+			file = *argv;
+			break;
+		case 1:				/* But set -df by default. */
+			dflag = fflag = 1;
+			string = *argv;
+			break;
+		default:
+			warnx(_("bad usage"));
+			errtryhelp(EXIT_FAILURE);
+		}
 
-	if (termchar != '\0' && (p = strchr(string, termchar)) != NULL)
-		*++p = '\0';
+		if (termchar != '\0' && (p = strchr(string, termchar)) != NULL)
+			*++p = '\0';
+	}
 
 	if ((fd = open(file, O_RDONLY, 0)) < 0 || fstat(fd, &sb))
 		err(EXIT_FAILURE, "%s", file);
@@ -166,7 +225,140 @@ main(int argc, char *argv[])
 #endif
 			err(EXIT_FAILURE, "%s", file);
 	back = front + sb.st_size;
-	return look(front, back);
+
+	if ((build || use_index) && !idxfile)
+		xasprintf(&idxfile, "%s.idx", file);
+	if (build)
+		return build_index(idxfile, front, back, &sb);
+	if (use_index)
+		load_index(idxfile, &sb);
+
+	if (!batch)
+		return look(front, back);
+
+	/* all the strings are searched in the same mapped file */
+	rc = 1;
+	while (getline(&string, &len, stdin) >= 0) {
+		p = strchr(string, '\n');
+		if (p)
+			*p = '\0';
+		if (termchar != '\0' && (p = strchr(string, termchar)) != NULL)
+			*++p = '\0';
+		if (look(front, back) == 0)
+			rc = 0;
+	}
+	free(string);
+	return rc;
+}
+
+/*
+ * Write offsets of all lines to the index file. The file is written to a
+ * temporary file and renamed, so the index is never incomplete.
+ */
+static int
+build_index(const char *idxfile, char *front, char *back, struct stat *sb)
+{
+	struct look_index_header hdr;
+	char *tmpname, *p = front;
+	FILE *f;
+	int fd;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOOK_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.size = sb->st_size;
+	hdr.mtime = sb->st_mtime;
+
+	xasprintf(&tmpname, "%s.XXXXXX", idxfile);
+	fd = mkstemp(tmpname);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot create %s"), idxfile);
+	f = fdopen(fd, "w");
+	if (!f)
+		err(EXIT_FAILURE, _("cannot create %s"), idxfile);
+
+	/* header is rewritten when the number of lines is known */
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1)
+		goto fail;
+
+	while (p < back) {
+		uint64_t off = p - front;
+
+		if (fwrite(&off, sizeof(off), 1, f) != 1)
+			goto fail;
+		hdr.nlines++;
+		p = memchr(p, '\n', back - p);
+		if (!p)
+			break;
+		p++;
+	}
+
+	if (fseek(f, 0, SEEK_SET) != 0
+	    || fwrite(&hdr, sizeof(hdr), 1, f) != 1
+	    || fchmod(fd, 0644) != 0
+	    || close_stream(f) != 0) {
+		f = NULL;
+		goto fail;
+	}
+	if (rename(tmpname, idxfile) != 0)
+		goto fail;
+
+	free(tmpname);
+	return EXIT_SUCCESS;
+fail:
+	warn(_("cannot write %s"), idxfile);
+	if (f)
+		fclose(f);
+	unlink(tmpname);
+	free(tmpname);
+	return EXIT_FAILURE;
+}
+
+/*
+ * Map the index file. The index is ignored if it does not match the size
+ * and the modification time of the file, look falls back to the binary
+ * search in the file in this case.
+ */
+static void
+load_index(const char *idxfile, struct stat *sb)
+{
+	struct look_index_header *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(idxfile, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		warn(_("cannot open %s"), idxfile);
+		return;
+	}
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*hdr)) {
+		warnx(_("%s: invalid index"), idxfile);
+		close(fd);
+		return;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		warn(_("%s: mmap failed"), idxfile);
+		return;
+	}
+
+	hdr = map;
+	if (memcmp(hdr->magic, LOOK_INDEX_MAGIC, sizeof(hdr->magic)) != 0
+	    || hdr->nlines != (st.st_size - sizeof(*hdr)) / sizeof(uint64_t)
+	    || (st.st_size - sizeof(*hdr)) % sizeof(uint64_t)) {
+		warnx(_("%s: invalid index"), idxfile);
+		munmap(map, st.st_size);
+		return;
+	}
+	if (hdr->size != (uint64_t) sb->st_size || hdr->mtime != sb->st_mtime) {
+		warnx(_("%s: index does not match the file, ignored"), idxfile);
+		munmap(map, st.st_size);
+		return;
+	}
+
+	offsets = (uint64_t *) (hdr + 1);
+	noffsets = hdr->nlines;
 }
 
 static int
@@ -188,7 +380,10 @@ look(char *front, char *back)
 
 	comparbuf = xmalloc(stringlen+1);
 
-	front = binary_search(front, back);
+	if (offsets)
+		front = index_search(front, back);
+	else
+		front = binary_search(front, back);
 	front = linear_search(front, back);
 
 	if (front)
@@ -260,6 +455,28 @@ binary_search(char *front, char *back)
 	return (front);
 }
 
+/*
+ * Binary search for the first line not less than "string" by the line index.
+ * Unlike binary_search() it does not have to find the line starts.
+ */
+static char *
+index_search(char *front, char *back)
+{
+	size_t lo = 0, hi = noffsets;
+	uint64_t size = back - front;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (offsets[mid] < size
+		    && compare(front + offsets[mid], back) == GREATER)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo < noffsets && offsets[lo] < size ? front + offsets[lo] : back;
+}
+
 /*
  * Find the first line that starts with string, linearly searching from front
  * to back.
@@ -294,19 +511,13 @@ linear_search(char *front, char *back)
 static void
 print_from(char *front, char *back)
 {
-	int eol;
-
 	while (front < back && compare(front, back) == EQUAL) {
-		if (compare(front, back) == EQUAL) {
-			eol = 0;
-			while (front < back && !eol) {
-				if (putchar(*front) == EOF)
-					err(EXIT_FAILURE, "stdout");
-				if (*front++ == '\n')
-					eol = 1;
-			}
-		} else
-			SKIP_PAST_NEWLINE(front, back);
+		char *eol = memchr(front, '\n', back - front);
+		size_t sz = eol ? (size_t) (eol - front) + 1 : (size_t) (back - front);
+
+		if (fwrite(front, 1, sz, stdout) != sz)
+			err(EXIT_FAILURE, "stdout");
+		front += sz;
 	}
 }
 
@@ -331,6 +542,19 @@ compare(char *s2, char *s2end) {
 	int i;
 	char *p;
 
+	if (!dflag && !fflag) {
+		/* nothing to ignore, compare in place by memchr() and memcmp() */
+		size_t n = min((size_t) stringlen, (size_t) (s2end - s2));
+
+		p = memchr(s2, '\n', n);
+		if (p)
+			n = p - s2;
+		i = memcmp(s2, string, n);
+		if (i == 0 && n < (size_t) stringlen)
+			i = -1;		/* s2 is shorter */
+		return ((i > 0) ? LESS : (i < 0) ? GREATER : EQUAL);
+	}
+
 	/* copy, ignoring things that should be ignored */
 	p = comparbuf;
 	i = stringlen;
@@ -363,13 +587,15 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("Display lines beginning with a specified string.\n"), out);
 
 	fputs(USAGE_OPTIONS, out);
-	fputs(_(" -a, --alternative        use the alternative dictionary\n"), out);
-	fputs(_(" -d, --alphanum           compare only blanks and alphanumeric characters\n"), out);
-	fputs(_(" -f, --ignore-case        ignore case differences when comparing\n"), out);
-	fputs(_(" -t, --terminate <char>   define the string-termination character\n"), out);
-
+	fputs(_(" -a, --alternative            use the alternative dictionary\n"), out);
+	fputs(_(" -b, --batch                  read the strings from standard input\n"), out);
+	fputs(_(" -d, --alphanum               compare only blanks and alphanumeric characters\n"), out);
+	fputs(_(" -f, --ignore-case            ignore case differences when comparing\n"), out);
+	fputs(_(" -t, --terminate <char>       define the string-termination character\n"), out);
+	fputs(_("     --build-index[=<index>]  write index of the file lines and exit\n"), out);
+	fputs(_("     --index[=<index>]        use the index (default is <file>.idx)\n"), out);
 	fputs(USAGE_SEPARATOR, out);
-	printf(USAGE_HELP_OPTIONS(26));
+	printf(USAGE_HELP_OPTIONS(30));
 	printf(USAGE_MAN_TAIL("look(1)"));
 
 	exit(EXIT_SUCCESS);
@@ -20,6 +20,7 @@
  */
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -68,8 +69,11 @@ struct wipe_control {
 	struct libscols_table *outtab;
 	struct wipe_desc *offsets;		/* -o <offset> -o <offset> ... */
 
+	size_t		jobs;			/* -j <num> */
+
 	unsigned int	noact : 1,
 			all : 1,
+			batch : 1,
 			quiet : 1,
 			backup : 1,
 			force : 1,
@@ -448,15 +452,10 @@ static void free_wipe(struct wipe_desc *wp)
 	}
 }
 
-static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
-			struct wipe_desc *w)
+static void print_wiped(struct wipe_control *ctl, struct wipe_desc *w)
 {
 	size_t i;
 
-	if (blkid_do_wipe(pr, ctl->noact) != 0)
-		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
-		     ctl->devname, w->type, (intmax_t)w->offset);
-
 	if (ctl->quiet)
 		return;
 
@@ -473,6 +472,77 @@ static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
 	putchar('\n');
 }
 
+static void do_wipe_real(struct wipe_control *ctl, blkid_probe pr,
+			struct wipe_desc *w)
+{
+	if (blkid_do_wipe(pr, ctl->noact) != 0)
+		err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+		     ctl->devname, w->type, (intmax_t)w->offset);
+
+	print_wiped(ctl, w);
+}
+
+static int cmp_wipe_offsets(const void *a, const void *b)
+{
+	const struct wipe_desc *wa = *(struct wipe_desc * const *) a,
+			       *wb = *(struct wipe_desc * const *) b;
+
+	return wa->offset < wb->offset ? -1 : wa->offset > wb->offset;
+}
+
+/*
+ * Erases the magic strings of all signatures in @wp0 list at once. The
+ * adjacent and overlapping areas are merged and written by one write.
+ */
+static void do_wipe_batch(struct wipe_control *ctl, int fd,
+			  struct wipe_desc *wp0)
+{
+	struct wipe_desc *w, **ws;
+	size_t i, n = 0, bufsz = 0;
+	char *buf;
+
+	for (w = wp0; w; w = w->next)
+		n++;
+	if (!n)
+		return;
+
+	ws = xmalloc(n * sizeof(struct wipe_desc *));
+	for (i = 0, w = wp0; w; w = w->next) {
+		ws[i++] = w;
+		bufsz = max(bufsz, w->len);
+	}
+	qsort(ws, n, sizeof(struct wipe_desc *), cmp_wipe_offsets);
+
+	for (i = 0; i < n; ) {
+		loff_t start = ws[i]->offset, end = start + ws[i]->len;
+		size_t k;
+
+		for (k = i + 1; k < n && ws[k]->offset <= end; k++)
+			end = max(end, (loff_t) (ws[k]->offset + ws[k]->len));
+		bufsz = max(bufsz, (size_t) (end - start));
+		i = k;
+	}
+
+	buf = xcalloc(1, bufsz);
+
+	for (i = 0; i < n; ) {
+		loff_t start = ws[i]->offset, end = start + ws[i]->len;
+		size_t k;
+
+		for (k = i + 1; k < n && ws[k]->offset <= end; k++)
+			end = max(end, (loff_t) (ws[k]->offset + ws[k]->len));
+
+		if (lseek(fd, start, SEEK_SET) == (off_t) -1
+		    || write_all(fd, buf, end - start) != 0)
+			err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+			     ctl->devname, ws[i]->type, (intmax_t) ws[i]->offset);
+		i = k;
+	}
+
+	free(buf);
+	free(ws);
+}
+
 static void do_backup(struct wipe_desc *wp, const char *base)
 {
 	char *fname = NULL;
@@ -511,7 +581,7 @@ static int do_wipe(struct wipe_control *ctl)
 	int mode = O_RDWR, reread = 0, need_force = 0;
 	blkid_probe pr;
 	char *backup = NULL;
-	struct wipe_desc *w;
+	struct wipe_desc *w, *erased = NULL, **erased_last = &erased;
 
 	if (!ctl->force)
 		mode |= O_EXCL;
@@ -551,11 +621,22 @@ static int do_wipe(struct wipe_control *ctl)
 
 		if (backup)
 			do_backup(wp, backup);
-		do_wipe_real(ctl, pr, wp);
+		if (ctl->batch) {
+			/* hide the signature now, erase it later */
+			if (blkid_do_wipe(pr, 1) != 0)
+				err(EXIT_FAILURE, _("%s: failed to erase %s magic string at offset 0x%08jx"),
+				     ctl->devname, wp->type, (intmax_t)wp->offset);
+		} else
+			do_wipe_real(ctl, pr, wp);
 		if (wp->is_parttable)
 			reread = 1;
 		wiped = 1;
 	done:
+		if (wiped && ctl->batch) {
+			*erased_last = wp;
+			erased_last = &wp->next;
+			continue;
+		}
 		if (!wiped && len) {
 			/* if the offset has not been wiped (probably because
 			 * filtered out by -t or -o) we need to hide it for
@@ -579,6 +660,14 @@ static int do_wipe(struct wipe_control *ctl)
 	if (need_force)
 		warnx(_("Use the --force option to force erase."));
 
+	if (erased) {
+		if (!ctl->noact)
+			do_wipe_batch(ctl, blkid_probe_get_fd(pr), erased);
+		for (w = erased; w; w = w->next)
+			print_wiped(ctl, w);
+		free_wipe(erased);
+	}
+
 	fsync(blkid_probe_get_fd(pr));
 
 #ifdef BLKRRPART
@@ -592,6 +681,43 @@ static int do_wipe(struct wipe_control *ctl)
 	return 0;
 }
 
+/*
+ * Wipes @devs by up to ctl->jobs processes, every device by one process.
+ */
+static int wipe_parallel(struct wipe_control *ctl, char **devs, size_t ndevs)
+{
+	size_t i = 0, running = 0;
+	int rc = EXIT_SUCCESS;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	while (i < ndevs || running) {
+		int status;
+		pid_t pid;
+
+		if (i < ndevs && running < ctl->jobs) {
+			pid = fork();
+			if (pid < 0)
+				err(EXIT_FAILURE, _("fork failed"));
+			if (pid == 0) {
+				ctl->devname = devs[i];
+				do_wipe(ctl);
+				exit(EXIT_SUCCESS);	/* flushes output */
+			}
+			running++;
+			i++;
+			continue;
+		}
+
+		if (wait(&status) < 0)
+			err(EXIT_FAILURE, _("waitpid failed"));
+		running--;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = EXIT_FAILURE;
+	}
+	return rc;
+}
 
 static void __attribute__((__noreturn__))
 usage(void)
@@ -607,8 +733,10 @@ usage(void)
 	fputs(USAGE_OPTIONS, stdout);
 	puts(_(" -a, --all           wipe all magic strings (BE CAREFUL!)"));
 	puts(_(" -b, --backup        create a signature backup in $HOME"));
+	puts(_("     --batch         erase all signatures by one pass"));
 	puts(_(" -f, --force         force erasure"));
 	puts(_(" -i, --noheadings    don't print headings"));
+	puts(_(" -j, --jobs <num>    wipe up to <num> devices in parallel"));
 	puts(_(" -J, --json          use JSON output format"));
 	puts(_(" -n, --no-act        do everything except the actual write() call"));
 	puts(_(" -o, --offset <num>  offset to erase, in bytes"));
@@ -631,15 +759,20 @@ usage(void)
 int
 main(int argc, char **argv)
 {
-	struct wipe_control ctl = { .devname = NULL };
+	struct wipe_control ctl = { .devname = NULL, .jobs = 1 };
 	int c;
 	char *outarg = NULL;
+	enum {
+		OPT_BATCH = CHAR_MAX + 1
+	};
 
 	static const struct option longopts[] = {
 	    { "all",       no_argument,       NULL, 'a' },
 	    { "backup",    no_argument,       NULL, 'b' },
+	    { "batch",     no_argument,       NULL, OPT_BATCH },
 	    { "force",     no_argument,       NULL, 'f' },
 	    { "help",      no_argument,       NULL, 'h' },
+	    { "jobs",      required_argument, NULL, 'j' },
 	    { "no-act",    no_argument,       NULL, 'n' },
 	    { "offset",    required_argument, NULL, 'o' },
 	    { "parsable",  no_argument,       NULL, 'p' },
@@ -663,7 +796,7 @@ main(int argc, char **argv)
 	textdomain(PACKAGE);
 	atexit(close_stdout);
 
-	while ((c = getopt_long(argc, argv, "abfhiJnO:o:pqt:V", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "abfhij:JnO:o:pqt:V", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -674,6 +807,9 @@ main(int argc, char **argv)
 		case 'b':
 			ctl.backup = 1;
 			break;
+		case OPT_BATCH:
+			ctl.batch = 1;
+			break;
 		case 'f':
 			ctl.force = 1;
 			break;
@@ -686,6 +822,11 @@ main(int argc, char **argv)
 		case 'i':
 			ctl.no_headings = 1;
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'O':
 			outarg = optarg;
 			break;
@@ -763,6 +904,9 @@ main(int argc, char **argv)
 		/*
 		 * Erase
 		 */
+		if (ctl.jobs > 1 && argc - optind > 1)
+			return wipe_parallel(&ctl, argv + optind, argc - optind);
+
 		while (optind < argc) {
 			ctl.devname = argv[optind++];
 			do_wipe(&ctl);
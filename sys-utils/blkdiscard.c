@@ -32,10 +32,12 @@
 #include <limits.h>
 #include <getopt.h>
 #include <time.h>
+#include <errno.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <linux/fs.h>
 
 #include "nls.h"
@@ -43,6 +45,9 @@
 #include "c.h"
 #include "closestream.h"
 #include "monotonic.h"
+#include "sysfs.h"
+#include "all-io.h"
+#include "xalloc.h"
 
 #ifndef BLKDISCARD
 # define BLKDISCARD	_IO(0x12,119)
@@ -62,6 +67,25 @@ enum {
 	ACT_SECURE
 };
 
+static const char *ioctl_names[] = {
+	[ACT_DISCARD] = "BLKDISCARD",
+	[ACT_ZEROOUT] = "BLKZEROOUT",
+	[ACT_SECURE]  = "BLKSECDISCARD"
+};
+
+static int discard_range(int fd, int act, uint64_t range[2])
+{
+	switch (act) {
+	case ACT_ZEROOUT:
+		return ioctl(fd, BLKZEROOUT, range);
+	case ACT_SECURE:
+		return ioctl(fd, BLKSECDISCARD, range);
+	case ACT_DISCARD:
+		return ioctl(fd, BLKDISCARD, range);
+	}
+	return -EINVAL;
+}
+
 static void print_stats(int act, char *path, uint64_t stats[])
 {
 	switch (act) {
@@ -77,6 +101,192 @@ static void print_stats(int act, char *path, uint64_t stats[])
 	}
 }
 
+/*
+ * Parallel discard
+ */
+struct discard_record {
+	uint64_t	offset;
+	uint64_t	length;
+	uint64_t	usec;		/* latency of the ioctl */
+};
+
+struct discard_stats {
+	uint64_t	bytes;
+	uint64_t	usec;		/* sum of the latencies */
+	uint64_t	max_usec;
+	size_t		nchunks;
+};
+
+static uint64_t timeval_usec(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+/*
+ * Returns the default size of the chunks discarded by one ioctl, that is the
+ * largest request accepted by the device aligned to the discard granularity.
+ * The number of parallel requests is limited by the device queue depth.
+ */
+static uint64_t device_chunk_size(struct stat *sb, int act, size_t *jobs)
+{
+	struct sysfs_cxt cxt = UL_SYSFSCXT_EMPTY;
+	uint64_t max = 0, gran = 0, nr = 0;
+	dev_t disk = 0;
+
+	if (sysfs_devno_to_wholedisk(sb->st_rdev, NULL, 0, &disk) || !disk)
+		return 0;
+	if (sysfs_init(&cxt, disk, NULL))
+		return 0;
+
+	if (act == ACT_ZEROOUT)
+		sysfs_read_u64(&cxt, "queue/write_zeroes_max_bytes", &max);
+	else {
+		sysfs_read_u64(&cxt, "queue/discard_max_bytes", &max);
+		sysfs_read_u64(&cxt, "queue/discard_granularity", &gran);
+	}
+	if (sysfs_read_u64(&cxt, "queue/nr_requests", &nr) == 0
+	    && nr && *jobs > nr)
+		*jobs = nr;
+
+	sysfs_deinit(&cxt);
+
+	if (gran && max > gran)
+		max -= max % gran;
+	return max;
+}
+
+static void __attribute__((__noreturn__))
+discard_child(int fd, int act, char *path, uint64_t start, uint64_t end,
+	      uint64_t chunk, size_t jobs, size_t first, int pfd)
+{
+	uint64_t range[2];
+	size_t i;
+
+	for (i = first; ; i += jobs) {
+		struct discard_record rec;
+		struct timeval a, b;
+
+		range[0] = start + i * chunk;
+		if (range[0] >= end || range[0] < start)
+			break;
+		range[1] = min(chunk, end - range[0]);
+
+		gettime_monotonic(&a);
+		if (discard_range(fd, act, range)) {
+			warn(_("%s: %s ioctl failed"), path, ioctl_names[act]);
+			_exit(EXIT_FAILURE);
+		}
+		gettime_monotonic(&b);
+
+		rec.offset = range[0];
+		rec.length = range[1];
+		rec.usec = timeval_usec(&b) - timeval_usec(&a);
+
+		/* the records are shorter than PIPE_BUF, so the writes are atomic */
+		if (write_all(pfd, &rec, sizeof(rec)))
+			_exit(EXIT_FAILURE);
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+static void print_chunk_stats(char *path, struct discard_stats *st,
+			      uint64_t usec)
+{
+	printf(_("%s: %zu chunks, %.1f MiB/s, latency avg %.3f ms, max %.3f ms\n"),
+		path, st->nchunks,
+		usec ? (double) st->bytes / (1 << 20) * 1000000 / usec : 0.0,
+		st->nchunks ? (double) st->usec / st->nchunks / 1000 : 0.0,
+		(double) st->max_usec / 1000);
+}
+
+/*
+ * Discards the range from @start to @end in chunks of @chunk bytes by @jobs
+ * processes. Every process discards every @jobs-th chunk and sends the
+ * latency of the ioctl back by pipe.
+ */
+static int discard_parallel(int fd, int act, char *path, int verbose,
+			    uint64_t start, uint64_t end, uint64_t chunk,
+			    size_t jobs)
+{
+	struct discard_stats total = { .bytes = 0 }, cur = { .bytes = 0 };
+	struct discard_record rec;
+	struct timeval begin, last, now;
+	uint64_t stats[2];
+	pid_t *pids;
+	size_t i;
+	int pfd[2], rc = 0;
+
+	pids = xcalloc(jobs, sizeof(pid_t));
+
+	if (pipe(pfd) != 0)
+		err(EXIT_FAILURE, _("cannot create pipe"));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < jobs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (pids[i] == 0) {
+			close(pfd[0]);
+			discard_child(fd, act, path, start, end, chunk, jobs, i, pfd[1]);
+		}
+	}
+	close(pfd[1]);
+
+	gettime_monotonic(&begin);
+	last = begin;
+
+	while (read_all(pfd[0], (char *) &rec, sizeof(rec)) == sizeof(rec)) {
+		cur.bytes += rec.length;
+		cur.usec += rec.usec;
+		cur.max_usec = max(cur.max_usec, rec.usec);
+		cur.nchunks++;
+
+		if (!verbose)
+			continue;
+
+		/* reporting progress at most once per second */
+		gettime_monotonic(&now);
+		if (timeval_usec(&now) - timeval_usec(&last) >= 1000000) {
+			print_chunk_stats(path, &cur,
+					  timeval_usec(&now) - timeval_usec(&last));
+			total.bytes += cur.bytes;
+			total.usec += cur.usec;
+			total.max_usec = max(total.max_usec, cur.max_usec);
+			total.nchunks += cur.nchunks;
+			memset(&cur, 0, sizeof(cur));
+			last = now;
+		}
+	}
+	close(pfd[0]);
+
+	total.bytes += cur.bytes;
+	total.usec += cur.usec;
+	total.max_usec = max(total.max_usec, cur.max_usec);
+	total.nchunks += cur.nchunks;
+
+	for (i = 0; i < jobs; i++) {
+		int status;
+
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+		    || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = -ECHILD;
+	}
+	free(pids);
+
+	if (verbose && total.bytes) {
+		gettime_monotonic(&now);
+		stats[0] = start;
+		stats[1] = total.bytes;
+		print_stats(act, path, stats);
+		print_chunk_stats(path, &total,
+				  timeval_usec(&now) - timeval_usec(&begin));
+	}
+	return rc;
+}
+
 static void __attribute__((__noreturn__)) usage(void)
 {
 	FILE *out = stdout;
@@ -88,6 +298,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("Discard the content of sectors on a device.\n"), out);
 
 	fputs(USAGE_OPTIONS, out);
+	fputs(_(" -j, --jobs <num>    discard by <num> processes in parallel\n"), out);
 	fputs(_(" -o, --offset <num>  offset in bytes to discard from\n"), out);
 	fputs(_(" -l, --length <num>  length of bytes to discard from the offset\n"), out);
 	fputs(_(" -p, --step <num>    size of the discard iterations within the offset\n"), out);
@@ -111,10 +322,12 @@ int main(int argc, char **argv)
 	struct stat sb;
 	struct timeval now, last;
 	int act = ACT_DISCARD;
+	size_t jobs = 1;
 
 	static const struct option longopts[] = {
 	    { "help",      no_argument,       NULL, 'h' },
 	    { "version",   no_argument,       NULL, 'V' },
+	    { "jobs",      required_argument, NULL, 'j' },
 	    { "offset",    required_argument, NULL, 'o' },
 	    { "length",    required_argument, NULL, 'l' },
 	    { "step",      required_argument, NULL, 'p' },
@@ -133,7 +346,7 @@ int main(int argc, char **argv)
 	range[1] = ULLONG_MAX;
 	step = 0;
 
-	while ((c = getopt_long(argc, argv, "hVsvo:l:p:z", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVsvj:o:l:p:z", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'h':
 			usage();
@@ -141,6 +354,11 @@ int main(int argc, char **argv)
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!jobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'l':
 			range[1] = strtosize_or_err(optarg,
 					_("failed to parse length"));
@@ -203,6 +421,18 @@ int main(int argc, char **argv)
 	if (end < range[0] || end > blksize)
 		end = blksize;
 
+	if (jobs > 1 && !step) {
+		/* split the range to the chunks accepted by the device */
+		uint64_t len = end - range[0];
+		uint64_t per_job = (len + jobs - 1) / jobs;
+
+		per_job = (per_job + secsize - 1) / secsize * secsize;
+		step = device_chunk_size(&sb, act, &jobs);
+		step -= step % secsize;
+		if (!step || step > per_job)
+			step = per_job;
+	}
+
 	range[1] = (step > 0) ? step : end - range[0];
 
 	/* check length alignment to the sector size */
@@ -210,6 +440,16 @@ int main(int argc, char **argv)
 		errx(EXIT_FAILURE, _("%s: length %" PRIu64 " is not aligned "
 			 "to sector size %i"), path, range[1], secsize);
 
+	if (jobs > 1 && range[1]) {
+		size_t nchunks = (end - range[0] + range[1] - 1) / range[1];
+		int rc;
+
+		rc = discard_parallel(fd, act, path, verbose, range[0], end,
+				      range[1], min(jobs, max(nchunks, (size_t) 1)));
+		close(fd);
+		return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
 	stats[0] = range[0], stats[1] = 0;
 	gettime_monotonic(&last);
 
@@ -217,20 +457,8 @@ int main(int argc, char **argv)
 		if (range[0] + range[1] > end)
 			range[1] = end - range[0];
 
-		switch (act) {
-		case ACT_ZEROOUT:
-			if (ioctl(fd, BLKZEROOUT, &range))
-				 err(EXIT_FAILURE, _("%s: BLKZEROOUT ioctl failed"), path);
-			break;
-		case ACT_SECURE:
-			if (ioctl(fd, BLKSECDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKSECDISCARD ioctl failed"), path);
-			break;
-		case ACT_DISCARD:
-			if (ioctl(fd, BLKDISCARD, &range))
-				err(EXIT_FAILURE, _("%s: BLKDISCARD ioctl failed"), path);
-			break;
-		}
+		if (discard_range(fd, act, range))
+			err(EXIT_FAILURE, _("%s: %s ioctl failed"), path, ioctl_names[act]);
 
 		stats[1] += range[1];
 
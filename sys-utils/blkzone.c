@@ -20,6 +20,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -32,6 +33,7 @@
 #include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <linux/fs.h>
 #include <linux/blkzoned.h>
 
@@ -66,6 +68,10 @@ struct blkzone_control {
 	uint64_t length;
 	uint32_t count;
 
+	const char *dump;		/* write zone table to the file */
+	const char *load;		/* read zone table from the file */
+	size_t jobs;			/* number of reset processes */
+
 	unsigned int verbose : 1;
 };
 
@@ -136,11 +142,6 @@ static unsigned long blkdev_chunk_sectors(const char *dname)
 	return rc == 0 ? sz : 0;
 }
 
-/*
- * blkzone report
- */
-#define DEF_REPORT_LEN		(1U << 12) /* 4k zones per report (256k kzalloc) */
-
 static const char *type_text[] = {
 	"RESERVED",
 	"CONVENTIONAL",
@@ -160,85 +161,414 @@ static const char *condition_str[] = {
 	"of"  /* Offline */
 };
 
-static int blkzone_report(struct blkzone_control *ctl)
+/*
+ * Zone-state table
+ */
+struct blkzone_table {
+	struct blk_zone *zones;
+	size_t nzones;
+	size_t alloc;
+};
+
+#define BLKZONE_TABLE_HEADER	"# blkzone zone table"
+
+static void table_add_zone(struct blkzone_table *tb, const struct blk_zone *z)
 {
-	struct blk_zone_report *zi;
-	unsigned long zonesize;
-	uint32_t i, nr_zones;
-	int fd;
+	if (tb->nzones == tb->alloc) {
+		tb->alloc = tb->alloc ? tb->alloc * 2 : 1024;
+		tb->zones = xrealloc(tb->zones, tb->alloc * sizeof(struct blk_zone));
+	}
+	tb->zones[tb->nzones++] = *z;
+}
 
-	fd = init_device(ctl, O_RDONLY);
+static void table_free(struct blkzone_table *tb)
+{
+	free(tb->zones);
+	tb->zones = NULL;
+	tb->nzones = tb->alloc = 0;
+}
 
-	if (ctl->offset > ctl->total_sectors)
-		errx(EXIT_FAILURE, _("%s: offset is greater than device size"), ctl->devname);
+/*
+ * Reads the table written by table_dump(). The zones have to be sorted by
+ * start sector.
+ */
+static void table_load(struct blkzone_control *ctl, struct blkzone_table *tb)
+{
+	FILE *f;
+	char buf[BUFSIZ];
+	size_t line = 0;
+
+	f = fopen(ctl->load, "r" UL_CLOEXECSTR);
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->load);
+
+	while (fgets(buf, sizeof(buf), f)) {
+		struct blk_zone z = { .start = 0 };
+		uint64_t start, len, wp;
+		unsigned int type, cond, reset, non_seq;
+
+		line++;
+		if (line == 1 && strncmp(buf, BLKZONE_TABLE_HEADER,
+					 sizeof(BLKZONE_TABLE_HEADER) - 1) != 0)
+			errx(EXIT_FAILURE, _("%s: not a zone table"), ctl->load);
+		if (*buf == '#' || *buf == '\n')
+			continue;
+
+		if (sscanf(buf, "%" SCNx64 " %" SCNx64 " %" SCNx64 " %u %u %u %u",
+			   &start, &len, &wp, &type, &cond, &reset, &non_seq) != 7
+		    || !len || type >= ARRAY_SIZE(type_text) || cond > 0xff
+		    || (tb->nzones && start < tb->zones[tb->nzones - 1].start
+					      + tb->zones[tb->nzones - 1].len))
+			errx(EXIT_FAILURE, _("%s: parse error at line %zu"),
+				ctl->load, line);
+
+		z.start = start;
+		z.len = len;
+		z.wp = wp;
+		z.type = type;
+		z.cond = cond;
+		z.reset = reset ? 1 : 0;
+		z.non_seq = non_seq ? 1 : 0;
+		table_add_zone(tb, &z);
+	}
+	if (ferror(f))
+		err(EXIT_FAILURE, _("cannot read %s"), ctl->load);
+	if (!line)
+		errx(EXIT_FAILURE, _("%s: not a zone table"), ctl->load);
+	fclose(f);
+}
 
-	zonesize = blkdev_chunk_sectors(ctl->devname);
-	if (!zonesize)
-		errx(EXIT_FAILURE, _("%s: unable to determine zone size"), ctl->devname);
+static void table_dump(struct blkzone_control *ctl,
+		       const struct blk_zone *zones, size_t nzones)
+{
+	FILE *f;
+	size_t i;
 
-	if (ctl->count)
-		nr_zones = ctl->count;
-	else if (ctl->length)
-		nr_zones = (ctl->length + zonesize - 1) / zonesize;
-	else
-		nr_zones = 1 + (ctl->total_sectors - ctl->offset) / zonesize;
+	f = fopen(ctl->dump, "w" UL_CLOEXECSTR);
+	if (!f)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->dump);
+
+	fprintf(f, "%s\n", BLKZONE_TABLE_HEADER);
+	fprintf(f, "# device: %s\n", ctl->devname ? ctl->devname : ctl->load);
+	fputs("# start len wptr type cond reset non-seq\n", f);
+
+	for (i = 0; i < nzones; i++) {
+		const struct blk_zone *z = &zones[i];
+
+		fprintf(f, "0x%09" PRIx64 " 0x%06" PRIx64 " 0x%09" PRIx64 " %u %u %u %u\n",
+			(uint64_t) z->start, (uint64_t) z->len, (uint64_t) z->wp,
+			z->type, z->cond, z->reset, z->non_seq);
+	}
+
+	if (close_stream(f) != 0)
+		err(EXIT_FAILURE, _("write failed: %s"), ctl->dump);
+}
+
+/*
+ * Returns the index of the first zone in @tb which ends behind @sector.
+ */
+static size_t table_find_zone(struct blkzone_table *tb, uint64_t sector)
+{
+	size_t lo = 0, hi = tb->nzones;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const struct blk_zone *z = &tb->zones[mid];
+
+		if (z->start + z->len <= sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * blkzone report
+ */
+#define DEF_REPORT_LEN		(1U << 12) /* 4k zones per report (256k kzalloc) */
+#define MAX_REPORT_LEN		(1U << 16) /* 64k zones per report (4M kzalloc) */
+
+static void print_zone(const struct blk_zone *entry)
+{
+	unsigned int type = entry->type;
+	uint64_t start = entry->start;
+	uint64_t wp = entry->wp;
+	uint8_t cond = entry->cond;
+	uint64_t len = entry->len;
+
+	printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64", wptr 0x%06"PRIx64
+		" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n"),
+		start, len, (type == 0x1) ? 0 : wp - start,
+		entry->reset, entry->non_seq,
+		cond, condition_str[cond & (ARRAY_SIZE(condition_str) - 1)],
+		type, type_text[type]);
+}
+
+/*
+ * Reads up to @nr_zones zones from @sector into @tb. The number of zones
+ * requested by one BLKREPORTZONE ioctl grows while the device returns full
+ * reports and shrinks when the kernel is not able to allocate the buffer.
+ */
+static void report_zones(struct blkzone_control *ctl, int fd,
+			 struct blkzone_table *tb, uint64_t sector,
+			 uint32_t nr_zones, int print)
+{
+	struct blk_zone_report *zi;
+	uint32_t i, len = DEF_REPORT_LEN;
 
 	zi = xmalloc(sizeof(struct blk_zone_report) +
-		     (DEF_REPORT_LEN * sizeof(struct blk_zone)));
+		     (len * sizeof(struct blk_zone)));
 
-	while (nr_zones && ctl->offset < ctl->total_sectors) {
+	while (nr_zones && sector < ctl->total_sectors) {
 
-		zi->nr_zones = min(nr_zones, DEF_REPORT_LEN);
-		zi->sector = ctl->offset;
+		zi->nr_zones = min(nr_zones, len);
+		zi->sector = sector;
 
-		if (ioctl(fd, BLKREPORTZONE, zi) == -1)
+		if (ioctl(fd, BLKREPORTZONE, zi) == -1) {
+			if (errno == ENOMEM && len > 1) {
+				len /= 2;
+				continue;
+			}
 			err(EXIT_FAILURE, _("%s: BLKREPORTZONE ioctl failed"), ctl->devname);
+		}
 
-		if (ctl->verbose)
+		if (ctl->verbose && print)
 			printf(_("Found %d zones from 0x%"PRIx64"\n"),
-				zi->nr_zones, ctl->offset);
+				zi->nr_zones, sector);
 
-		if (!zi->nr_zones) {
-			nr_zones = 0;
+		if (!zi->nr_zones)
 			break;
-		}
 
 		for (i = 0; i < zi->nr_zones; i++) {
 			const struct blk_zone *entry = &zi->zones[i];
-			unsigned int type = entry->type;
-			uint64_t start = entry->start;
-			uint64_t wp = entry->wp;
-			uint8_t cond = entry->cond;
-			uint64_t len = entry->len;
 
-			if (!len) {
+			if (!entry->len) {
 				nr_zones = 0;
 				break;
 			}
-
-			printf(_("  start: 0x%09"PRIx64", len 0x%06"PRIx64", wptr 0x%06"PRIx64
-			 	" reset:%u non-seq:%u, zcond:%2u(%s) [type: %u(%s)]\n"),
-				start, len, (type == 0x1) ? 0 : wp - start,
-				entry->reset, entry->non_seq,
-				cond, condition_str[cond & (ARRAY_SIZE(condition_str) - 1)],
-				type, type_text[type]);
+			if (print)
+				print_zone(entry);
+			if (tb)
+				table_add_zone(tb, entry);
 
 			nr_zones--;
-			ctl->offset = start + len;
-
+			sector = entry->start + entry->len;
 		}
 
+		if (zi->nr_zones == len && len < MAX_REPORT_LEN) {
+			len *= 2;
+			zi = xrealloc(zi, sizeof(struct blk_zone_report) +
+				      (len * sizeof(struct blk_zone)));
+		}
 	}
 
 	free(zi);
-	close(fd);
+}
+
+static int blkzone_report(struct blkzone_control *ctl)
+{
+	struct blkzone_table tb = { .nzones = 0 };
+	size_t first = 0, last;
+	uint32_t nr_zones;
+
+	if (ctl->load) {
+		size_t i;
+
+		table_load(ctl, &tb);
+
+		i = first = table_find_zone(&tb, ctl->offset);
+		nr_zones = ctl->count ? ctl->count : UINT32_MAX;
 
+		for (; nr_zones && i < tb.nzones; i++, nr_zones--) {
+			const struct blk_zone *z = &tb.zones[i];
+
+			if (ctl->length && z->start >= ctl->offset + ctl->length)
+				break;
+			print_zone(z);
+		}
+		last = i;
+	} else {
+		unsigned long zonesize;
+		int fd;
+
+		fd = init_device(ctl, O_RDONLY);
+
+		if (ctl->offset > ctl->total_sectors)
+			errx(EXIT_FAILURE, _("%s: offset is greater than device size"), ctl->devname);
+
+		zonesize = blkdev_chunk_sectors(ctl->devname);
+		if (!zonesize)
+			errx(EXIT_FAILURE, _("%s: unable to determine zone size"), ctl->devname);
+
+		if (ctl->count)
+			nr_zones = ctl->count;
+		else if (ctl->length)
+			nr_zones = (ctl->length + zonesize - 1) / zonesize;
+		else
+			nr_zones = 1 + (ctl->total_sectors - ctl->offset) / zonesize;
+
+		report_zones(ctl, fd, ctl->dump ? &tb : NULL,
+			     ctl->offset, nr_zones, 1);
+		last = tb.nzones;
+		close(fd);
+	}
+
+	if (ctl->dump)
+		table_dump(ctl, tb.zones + first, last - first);
+
+	table_free(&tb);
 	return 0;
 }
 
 /*
  * blkzone reset
  */
+struct blkzone_range {
+	uint64_t sector;
+	uint64_t nr_sectors;
+};
+
+static void __attribute__((__noreturn__))
+reset_child(struct blkzone_control *ctl, int fd,
+	    struct blkzone_range *ranges, size_t nranges, size_t first)
+{
+	size_t i;
+
+	for (i = first; i < nranges; i += ctl->jobs) {
+		struct blk_zone_range za = {
+			.sector = ranges[i].sector,
+			.nr_sectors = ranges[i].nr_sectors
+		};
+
+		if (ioctl(fd, BLKRESETZONE, &za) == -1) {
+			warn(_("%s: BLKRESETZONE ioctl failed"), ctl->devname);
+			_exit(EXIT_FAILURE);
+		}
+	}
+	_exit(EXIT_SUCCESS);
+}
+
+/*
+ * Resets @ranges by ctl->jobs processes. Every process resets every
+ * ctl->jobs-th range.
+ */
+static void reset_ranges(struct blkzone_control *ctl, int fd,
+			 struct blkzone_range *ranges, size_t nranges)
+{
+	pid_t *pids;
+	size_t i;
+	int rc = 0;
+
+	if (ctl->jobs > nranges)
+		ctl->jobs = max(nranges, (size_t) 1);
+
+	if (ctl->jobs == 1) {
+		for (i = 0; i < nranges; i++) {
+			struct blk_zone_range za = {
+				.sector = ranges[i].sector,
+				.nr_sectors = ranges[i].nr_sectors
+			};
+
+			if (ioctl(fd, BLKRESETZONE, &za) == -1)
+				err(EXIT_FAILURE, _("%s: BLKRESETZONE ioctl failed"), ctl->devname);
+		}
+		return;
+	}
+
+	pids = xcalloc(ctl->jobs, sizeof(pid_t));
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < ctl->jobs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			err(EXIT_FAILURE, _("fork failed"));
+		if (pids[i] == 0)
+			reset_child(ctl, fd, ranges, nranges, i);
+	}
+
+	for (i = 0; i < ctl->jobs; i++) {
+		int status;
+
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status)
+		    || WEXITSTATUS(status) != EXIT_SUCCESS)
+			rc = -ECHILD;
+	}
+	free(pids);
+
+	if (rc)
+		exit(EXIT_FAILURE);
+}
+
+/*
+ * Splits the zones in the range from @sector to @end into ranges of zones
+ * which need a reset. Conventional zones are skipped, empty zones only if
+ * @skip_empty is set (the zone condition is up to date). The ranges are not
+ * longer than @maxzones zones, so they may be reset in parallel.
+ */
+static size_t table_to_ranges(struct blkzone_control *ctl,
+			      struct blkzone_table *tb,
+			      uint64_t sector, uint64_t end,
+			      int skip_empty,
+			      struct blkzone_range **ranges)
+{
+	struct blkzone_range *res = NULL;
+	size_t i, first, n, nranges = 0, nzones = 0, maxzones, cur = 0;
+
+	first = table_find_zone(tb, sector);
+
+	/* count zones to reset */
+	for (i = first; i < tb->nzones && tb->zones[i].start < end; i++) {
+		const struct blk_zone *z = &tb->zones[i];
+
+		if (i == first && z->start != sector)
+			errx(EXIT_FAILURE, _("%s: zone table does not match "
+				"offset %" PRIu64), ctl->devname, sector);
+		if (i > first && z->start != z[-1].start + z[-1].len)
+			errx(EXIT_FAILURE, _("%s: zone table is not contiguous "
+				"at sector %" PRIu64), ctl->devname,
+				(uint64_t) z->start);
+		if (z->type != BLK_ZONE_TYPE_CONVENTIONAL &&
+		    !(skip_empty && z->cond == BLK_ZONE_COND_EMPTY))
+			nzones++;
+	}
+	if (sector < end &&
+	    (i == first || tb->zones[i - 1].start + tb->zones[i - 1].len < end))
+		errx(EXIT_FAILURE, _("%s: zone table does not cover the range"),
+			ctl->devname);
+
+	maxzones = max((nzones + ctl->jobs - 1) / ctl->jobs, (size_t) 1);
+	n = 0;
+
+	for (i = first; i < tb->nzones && tb->zones[i].start < end; i++) {
+		const struct blk_zone *z = &tb->zones[i];
+
+		if (z->type == BLK_ZONE_TYPE_CONVENTIONAL ||
+		    (skip_empty && z->cond == BLK_ZONE_COND_EMPTY)) {
+			n = 0;
+			continue;
+		}
+
+		if (n && n < maxzones) {
+			res[cur].nr_sectors += z->len;	/* extend the range */
+			n++;
+			continue;
+		}
+
+		if (nranges % 64 == 0)
+			res = xrealloc(res, (nranges + 64) * sizeof(*res));
+		cur = nranges++;
+		res[cur].sector = z->start;
+		res[cur].nr_sectors = z->len;
+		n = 1;
+	}
+
+	*ranges = res;
+	return nranges;
+}
+
 static int blkzone_reset(struct blkzone_control *ctl)
 {
 	struct blk_zone_range za = { .sector = 0 };
@@ -276,13 +606,41 @@ static int blkzone_reset(struct blkzone_control *ctl)
 			"to zone size %lu"),
 			ctl->devname, ctl->length, zonesize);
 
-	za.sector = ctl->offset;
-	za.nr_sectors = zlen;
+	if (ctl->load || ctl->jobs > 1) {
+		/*
+		 * The conventional zones are always skipped. The empty zones
+		 * are skipped only if the zone table is from the device
+		 * report; the table from --load may be out of date, so it's
+		 * used for the zone geometry only and the empty zones are
+		 * reset too.
+		 */
+		struct blkzone_table tb = { .nzones = 0 };
+		struct blkzone_range *ranges;
+		size_t nranges;
+
+		if (ctl->load)
+			table_load(ctl, &tb);
+		else
+			report_zones(ctl, fd, &tb, ctl->offset,
+				     (zlen + zonesize - 1) / zonesize, 0);
+
+		nranges = table_to_ranges(ctl, &tb, ctl->offset,
+					  ctl->offset + zlen, !ctl->load,
+					  &ranges);
+		reset_ranges(ctl, fd, ranges, nranges);
+
+		free(ranges);
+		table_free(&tb);
+	} else {
+		za.sector = ctl->offset;
+		za.nr_sectors = zlen;
+
+		if (ioctl(fd, BLKRESETZONE, &za) == -1)
+			err(EXIT_FAILURE, _("%s: BLKRESETZONE ioctl failed"), ctl->devname);
+	}
 
-	if (ioctl(fd, BLKRESETZONE, &za) == -1)
-		err(EXIT_FAILURE, _("%s: BLKRESETZONE ioctl failed"), ctl->devname);
-	else if (ctl->verbose)
-		printf(_("%s: successfully reset in range from %" PRIu64 ", to %" PRIu64),
+	if (ctl->verbose)
+		printf(_("%s: successfully reset in range from %" PRIu64 ", to %" PRIu64 "\n"),
 			ctl->devname,
 			ctl->offset,
 			ctl->offset + zlen);
@@ -309,6 +667,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -o, --offset <sector>  start sector of zone to act (in 512-byte sectors)\n"), out);
 	fputs(_(" -l, --length <sectors> maximum sectors to act (in 512-byte sectors)\n"), out);
 	fputs(_(" -c, --count <number>   maximum number of zones\n"), out);
+	fputs(_(" -j, --jobs <num>       reset zones by <num> processes\n"), out);
+	fputs(_("     --dump <file>      write zone table to the file\n"), out);
+	fputs(_("     --load <file>      read zone table from the file\n"), out);
 	fputs(_(" -v, --verbose          display more details\n"), out);
 	fputs(USAGE_SEPARATOR, out);
 	printf(USAGE_HELP_OPTIONS(24));
@@ -324,13 +685,21 @@ int main(int argc, char **argv)
 		.devname = NULL,
 		.offset = 0,
 		.count = 0,
-		.length = 0
+		.length = 0,
+		.jobs = 1
+	};
+	enum {
+		OPT_DUMP = CHAR_MAX + 1,
+		OPT_LOAD
 	};
 
 	static const struct option longopts[] = {
 	    { "help",    no_argument,       NULL, 'h' },
 	    { "count",   required_argument, NULL, 'c' }, /* max #of zones to operate on */
+	    { "dump",    required_argument, NULL, OPT_DUMP },
+	    { "jobs",    required_argument, NULL, 'j' },
 	    { "length",  required_argument, NULL, 'l' }, /* max of sectors to operate on */
+	    { "load",    required_argument, NULL, OPT_LOAD },
 	    { "offset",  required_argument, NULL, 'o' }, /* starting LBA */
 	    { "verbose", no_argument,       NULL, 'v' },
 	    { "version", no_argument,       NULL, 'V' },
@@ -356,7 +725,7 @@ int main(int argc, char **argv)
 		argc--;
 	}
 
-	while ((c = getopt_long(argc, argv, "hc:l:o:vV", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hc:j:l:o:vV", longopts, NULL)) != -1) {
 
 		err_exclusive_options(c, longopts, excl, excl_st);
 
@@ -368,6 +737,17 @@ int main(int argc, char **argv)
 			ctl.count = strtou32_or_err(optarg,
 					_("failed to parse number of zones"));
 			break;
+		case 'j':
+			ctl.jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.jobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
+		case OPT_DUMP:
+			ctl.dump = optarg;
+			break;
+		case OPT_LOAD:
+			ctl.load = optarg;
+			break;
 		case 'l':
 			ctl.length = strtosize_or_err(optarg,
 					_("failed to parse number of sectors"));
@@ -390,9 +770,13 @@ int main(int argc, char **argv)
 	if (!ctl.command)
 		errx(EXIT_FAILURE, _("no command specified"));
 
-	if (optind == argc)
+	if (ctl.dump && ctl.command->handler != blkzone_report)
+		errx(EXIT_FAILURE, _("--dump is supported for report only"));
+
+	if (optind < argc)
+		ctl.devname = argv[optind++];
+	else if (!ctl.load || ctl.command->handler != blkzone_report)
 		errx(EXIT_FAILURE, _("no device specified"));
-	ctl.devname = argv[optind++];
 
 	if (optind != argc)
 		errx(EXIT_FAILURE,_("unexpected number of arguments"));
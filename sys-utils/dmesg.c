@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 
 #include "c.h"
 #include "colors.h"
@@ -146,7 +147,8 @@ static const struct dmesg_name facility_names[] =
 enum {
 	DMESG_METHOD_KMSG,	/* read messages from /dev/kmsg (default) */
 	DMESG_METHOD_SYSLOG,	/* klogctl() buffer */
-	DMESG_METHOD_MMAP	/* mmap file with records (see --file) */
+	DMESG_METHOD_MMAP,	/* mmap file with records (see --file) */
+	DMESG_METHOD_ARCHIVE	/* mmap archive file (see --archive) */
 };
 
 enum {
@@ -161,6 +163,66 @@ enum {
 };
 #define is_timefmt(c, f) ((c)->time_fmt == (DMESG_TIMEFTM_ ##f))
 
+/*
+ * The /dev/kmsg records are read into one buffer until the buffer is full or
+ * there is no more record available, then all the records are parsed and
+ * printed in place. Every read() requires space for the longest record.
+ */
+#define DMESG_KMSG_BUFSIZ	(64 * 1024)
+#define DMESG_KMSG_RECSIZ	BUFSIZ
+
+/*
+ * The archive (--archive, --archive-append) is a sequence of blocks. Every
+ * block starts with a header, then there is the offset of every record and
+ * then the records. All numbers are little-endian.
+ *
+ * The header describes all records in the block, so blocks with no matching
+ * record are skipped without reading the records; in the time ordered blocks
+ * the first record for --since is found by binary search.
+ */
+#define DMESG_ARCHIVE_MAGIC	"DMESGAR1"
+#define DMESG_ARCHIVE_RECORDS	1024	/* max number of records in block */
+
+enum {
+	DMESG_ARCHIVE_FL_SORTED = (1 << 0),	/* records ordered by time */
+	DMESG_ARCHIVE_FL_SEQNUM = (1 << 1)	/* seqnum from /dev/kmsg is valid */
+};
+
+struct dmesg_archive_header {
+	char		magic[8];	/* DMESG_ARCHIVE_MAGIC */
+	uint32_t	nrecords;
+	uint32_t	flags;		/* DMESG_ARCHIVE_FL_* */
+	uint32_t	levels;		/* bitmap of levels used in the block */
+	uint32_t	facilities;	/* bitmap of facilities used in the block */
+	uint64_t	boot_time;	/* usec since epoch */
+	uint64_t	first;		/* oldest record, usec since boot */
+	uint64_t	last;		/* newest record, usec since boot */
+	uint64_t	seqnum;		/* kmsg sequence number of the last record */
+	uint64_t	size;		/* block size without the header */
+	char		boot_id[40];	/* /proc/sys/kernel/random/boot_id */
+};
+
+/* the record is followed by the message, terminated and padded by zeros */
+struct dmesg_archive_record {
+	uint64_t	time;		/* usec since boot */
+	uint32_t	size;		/* message size */
+	uint8_t		level;		/* 0xff if unknown */
+	uint8_t		facility;	/* 0xff if unknown */
+	uint16_t	reserved;
+};
+
+/* --archive-append block in progress */
+struct dmesg_archive {
+	int		fd;
+	struct dmesg_archive_header hdr;	/* in host byte order */
+	uint32_t	offsets[DMESG_ARCHIVE_RECORDS];
+	char		*data;
+	size_t		datasz;
+
+	uint64_t	skip_seqnum;	/* records already in the archive */
+	unsigned int	has_skip:1;
+};
+
 struct dmesg_control {
 	/* bit arrays -- see include/bitops.h */
 	char levels[ARRAY_SIZE(level_names) / NBBY + 1];
@@ -177,7 +239,8 @@ struct dmesg_control {
 
 	int		kmsg;		/* /dev/kmsg file descriptor */
 	ssize_t		kmsg_first_read;/* initial read() return code */
-	char		kmsg_buf[BUFSIZ];/* buffer to read kmsg data */
+	size_t		kmsg_len;	/* number of bytes in kmsg_buf[] */
+	char		kmsg_buf[DMESG_KMSG_BUFSIZ];/* records read from kmsg */
 
 	/*
 	 * For the --file option we mmap whole file. The unnecessary (already
@@ -189,6 +252,10 @@ struct dmesg_control {
 	size_t		pagesize;
 	unsigned int	time_fmt;	/* time format */
 
+	struct dmesg_archive *archive_out;	/* --archive-append */
+	usec_t		since;		/* --since, usec since epoch */
+	usec_t		until;		/* --until, usec since epoch */
+
 	unsigned int	follow:1,	/* wait for new messages */
 			raw:1,		/* raw mode */
 			fltr_lev:1,	/* filter out by levels[] */
@@ -208,6 +275,7 @@ struct dmesg_record {
 	int		level;
 	int		facility;
 	struct timeval  tv;
+	uint64_t	seqnum;		/* kmsg only, for --archive-append */
 
 	const char	*next;		/* buffer with next unparsed record */
 	size_t		next_size;	/* size of the next buffer */
@@ -220,9 +288,18 @@ struct dmesg_record {
 		(_r)->level = -1; \
 		(_r)->tv.tv_sec = 0; \
 		(_r)->tv.tv_usec = 0; \
+		(_r)->seqnum = 0; \
 	} while (0)
 
+/* the timestamp is necessary for output, --since, --until and --archive-append */
+#define need_timestamp(c) (!is_timefmt(c, NONE) || (c)->since || (c)->until \
+			   || (c)->archive_out)
+
 static int read_kmsg(struct dmesg_control *ctl);
+static int read_archive(struct dmesg_control *ctl);
+static void archive_add_record(struct dmesg_control *ctl,
+			       struct dmesg_record *rec);
+static void archive_write_block(struct dmesg_control *ctl);
 
 static int set_level_color(int log_level, const char *mesg, size_t mesgsz)
 {
@@ -274,6 +351,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -D, --console-off           disable printing messages to console\n"), out);
 	fputs(_(" -E, --console-on            enable printing messages to console\n"), out);
 	fputs(_(" -F, --file <file>           use the file instead of the kernel log buffer\n"), out);
+	fputs(_("     --archive <file>        read messages from the archive file\n"), out);
+	fputs(_("     --archive-append <file> append messages to the archive file\n"), out);
 	fputs(_(" -f, --facility <list>       restrict output to defined facilities\n"), out);
 	fputs(_(" -H, --human                 human readable output\n"), out);
 	fputs(_(" -k, --kernel                display kernel messages\n"), out);
@@ -290,6 +369,8 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -u, --userspace             display userspace messages\n"), out);
 	fputs(_(" -w, --follow                wait for new messages\n"), out);
 	fputs(_(" -x, --decode                decode facility and level to readable string\n"), out);
+	fputs(_("     --since <time>          display the messages since the specified time\n"), out);
+	fputs(_("     --until <time>          display the messages until the specified time\n"), out);
 	fputs(_(" -d, --show-delta            show time delta between printed messages\n"), out);
 	fputs(_(" -e, --reltime               show local time and time delta in readable format\n"), out);
 	fputs(_(" -T, --ctime                 show human-readable timestamp (may be inaccurate!)\n"), out);
@@ -579,6 +660,9 @@ static ssize_t read_buffer(struct dmesg_control *ctl, char **buf)
 	case DMESG_METHOD_MMAP:
 		n = mmap_file_buffer(ctl, buf);
 		break;
+	case DMESG_METHOD_ARCHIVE:
+		n = read_archive(ctl);
+		break;
 	case DMESG_METHOD_SYSLOG:
 		if (!ctl->bufsize)
 			ctl->bufsize = get_syslog_buffer_size();
@@ -627,6 +711,23 @@ static void safe_fwrite(const char *buf, size_t size, int indent, FILE *out)
 		int rc, hex = 0;
 		size_t len;
 
+		/* write printable ASCII at once */
+		for (len = 0; i + len < size; len++) {
+			unsigned char c = p[len];
+
+			if ((c < 0x20 || c > 0x7e) && c != '\t')
+				break;
+		}
+		if (len) {
+			if (fwrite(p, 1, len, out) != len) {
+				if (errno != EPIPE)
+					err(EXIT_FAILURE, _("write failed"));
+				exit(EXIT_SUCCESS);
+			}
+			i += len - 1;
+			continue;
+		}
+
 #ifdef HAVE_WIDECHAR
 		wchar_t wc;
 		len = mbrtowc(&wc, p, size - i, &s);
@@ -724,7 +825,8 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 			continue;	/* error or empty line? */
 
 		if (*begin == '<') {
-			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode || ctl->color)
+			if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode || ctl->color
+			    || ctl->archive_out)
 				begin = parse_faclev(begin + 1, &rec->facility,
 						     &rec->level);
 			else
@@ -734,7 +836,7 @@ static int get_next_syslog_record(struct dmesg_control *ctl,
 		if (*begin == '[' && (*(begin + 1) == ' ' ||
 				      isdigit(*(begin + 1)))) {
 
-			if (!is_timefmt(ctl, NONE))
+			if (need_timestamp(ctl))
 				begin = parse_syslog_timestamp(begin + 1, &rec->tv);
 			else
 				begin = skip_item(begin, end, "]");
@@ -771,6 +873,16 @@ static int accept_record(struct dmesg_control *ctl, struct dmesg_record *rec)
 			      !isset(ctl->facilities, rec->facility)))
 		return 0;
 
+	if (ctl->since || ctl->until) {
+		usec_t t = ((usec_t) ctl->boot_time.tv_sec + rec->tv.tv_sec) * USEC_PER_SEC
+			   + ctl->boot_time.tv_usec + rec->tv.tv_usec;
+
+		if (ctl->since && t < ctl->since)
+			return 0;
+		if (ctl->until && t > ctl->until)
+			return 0;
+	}
+
 	return 1;
 }
 
@@ -891,6 +1003,11 @@ static void print_record(struct dmesg_control *ctl,
 	if (!accept_record(ctl, rec))
 		return;
 
+	if (ctl->archive_out) {
+		archive_add_record(ctl, rec);
+		return;
+	}
+
 	if (!rec->mesg_size) {
 		putchar('\n');
 		return;
@@ -1079,16 +1196,21 @@ static void print_buffer(struct dmesg_control *ctl,
 		print_record(ctl, &rec);
 }
 
+/*
+ * Appends the next record to kmsg_buf[].
+ */
 static ssize_t read_kmsg_one(struct dmesg_control *ctl)
 {
 	ssize_t size;
 
 	/* kmsg returns EPIPE if record was modified while reading */
 	do {
-		size = read(ctl->kmsg, ctl->kmsg_buf,
-			    sizeof(ctl->kmsg_buf) - 1);
+		size = read(ctl->kmsg, ctl->kmsg_buf + ctl->kmsg_len,
+			    sizeof(ctl->kmsg_buf) - ctl->kmsg_len - 1);
 	} while (size < 0 && errno == EPIPE);
 
+	if (size > 0)
+		ctl->kmsg_len += size;
 	return size;
 }
 
@@ -1096,12 +1218,19 @@ static int init_kmsg(struct dmesg_control *ctl)
 {
 	int mode = O_RDONLY;
 
+	const char *path = "/dev/kmsg";
+
 	if (!ctl->follow)
 		mode |= O_NONBLOCK;
 	else
-		setlinebuf(stdout);
+		/* flushed by read_kmsg() before it waits for new records */
+		setvbuf(stdout, NULL, _IOFBF, DMESG_KMSG_BUFSIZ);
 
-	ctl->kmsg = open("/dev/kmsg", mode);
+#ifdef TEST_DMESG
+	if (getenv("DMESG_TEST_KMSG"))
+		path = getenv("DMESG_TEST_KMSG");
+#endif
+	ctl->kmsg = open(path, mode);
 	if (ctl->kmsg < 0)
 		return -1;
 
@@ -1161,7 +1290,7 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 
 	/* A) priority and facility */
 	if (ctl->fltr_lev || ctl->fltr_fac || ctl->decode ||
-	    ctl->raw || ctl->color)
+	    ctl->raw || ctl->color || ctl->archive_out)
 		p = parse_faclev(p, &rec->facility, &rec->level);
 	else
 		p = skip_item(p, end, ",");
@@ -1169,12 +1298,14 @@ static int parse_kmsg_record(struct dmesg_control *ctl,
 		goto mesg;
 
 	/* B) sequence number */
+	if (ctl->archive_out)
+		rec->seqnum = strtoull(p, NULL, 10);
 	p = skip_item(p, end, ",;");
 	if (LAST_KMSG_FIELD(p))
 		goto mesg;
 
 	/* C) timestamp */
-	if (is_timefmt(ctl, NONE))
+	if (!need_timestamp(ctl))
 		p = skip_item(p, end, ",;");
 	else
 		p = parse_kmsg_timestamp(p, &rec->tv);
@@ -1217,10 +1348,57 @@ mesg:
 	return 0;
 }
 
+/*
+ * Parses and prints all complete records from kmsg_buf[], an incomplete record
+ * is moved to the begin of the buffer.
+ *
+ * The record is terminated by \n. The lines with message tags start with
+ * a space; the tags are ignored.
+ */
+static void print_kmsg_buffer(struct dmesg_control *ctl)
+{
+	struct dmesg_record rec;
+	char *p = ctl->kmsg_buf, *end = ctl->kmsg_buf + ctl->kmsg_len;
+
+	while (p < end) {
+		char *nl = memchr(p, '\n', end - p);
+
+		if (!nl) {
+			/* full buffer without \n, print it anyway */
+			if (p > ctl->kmsg_buf || ctl->kmsg_len + DMESG_KMSG_RECSIZ
+						 < sizeof(ctl->kmsg_buf))
+				break;
+			nl = end - 1;
+		}
+		if (*p != ' ' && parse_kmsg_record(ctl, &rec, p, nl - p + 1) == 0)
+			print_record(ctl, &rec);
+		p = nl + 1;
+	}
+
+	ctl->kmsg_len = end - p;
+	if (ctl->kmsg_len)
+		memmove(ctl->kmsg_buf, p, ctl->kmsg_len);
+}
+
+/* returns 1 if the next read() will not wait */
+static int kmsg_ready(struct dmesg_control *ctl)
+{
+	struct pollfd fd = { .fd = ctl->kmsg, .events = POLLIN };
+
+	if (!ctl->follow)
+		return 1;	/* O_NONBLOCK */
+	return poll(&fd, 1, 0) > 0;
+}
+
 /*
  * Note that each read() call for /dev/kmsg returns always one record. It means
  * that we don't have to read whole message buffer before the records parsing.
  *
+ * The records are read into kmsg_buf[] until the buffer is full or there is no
+ * other record available, then the records are printed. This keeps the
+ * kernel ring buffer drained on heavy logging, and in follow mode stdout is
+ * flushed only before we wait for new records.
+ *
  * So this function does not compose one huge buffer (like read_syslog_buffer())
  * and print_buffer() is unnecessary. All is done in this function.
  *
@@ -1228,7 +1406,6 @@ mesg:
  */
 static int read_kmsg(struct dmesg_control *ctl)
 {
-	struct dmesg_record rec;
 	ssize_t sz;
 
 	if (ctl->method != DMESG_METHOD_KMSG || ctl->kmsg < 0)
@@ -1242,15 +1419,360 @@ static int read_kmsg(struct dmesg_control *ctl)
 	sz = ctl->kmsg_first_read;
 
 	while (sz > 0) {
-		*(ctl->kmsg_buf + sz) = '\0';	/* for debug messages */
+		while (ctl->kmsg_len + DMESG_KMSG_RECSIZ < sizeof(ctl->kmsg_buf)
+		       && kmsg_ready(ctl)) {
+			sz = read_kmsg_one(ctl);
+			if (sz <= 0)
+				break;
+		}
 
-		if (parse_kmsg_record(ctl, &rec,
-				      ctl->kmsg_buf, (size_t) sz) == 0)
-			print_record(ctl, &rec);
+		*(ctl->kmsg_buf + ctl->kmsg_len) = '\0';	/* for debug messages */
+		print_kmsg_buffer(ctl);
+
+		if (sz > 0) {
+			if (ctl->follow && ctl->archive_out)
+				archive_write_block(ctl);
+			else if (ctl->follow)
+				fflush(stdout);
+			sz = read_kmsg_one(ctl);
+		}
+	}
+
+	/* incomplete record at the end of input */
+	if (ctl->kmsg_len) {
+		ctl->kmsg_buf[ctl->kmsg_len++] = '\n';
+		print_kmsg_buffer(ctl);
+	}
+	return 0;
+}
+
+static void read_boot_id(char *buf, size_t bufsz)
+{
+	FILE *f;
+
+	memset(buf, 0, bufsz);
+#ifdef TEST_DMESG
+	if (getenv("DMESG_TEST_BOOTID")) {
+		xstrncpy(buf, getenv("DMESG_TEST_BOOTID"), bufsz);
+		return;
+	}
+#endif
+	f = fopen("/proc/sys/kernel/random/boot_id", "r" UL_CLOEXECSTR);
+	if (!f)
+		return;
+	if (fgets(buf, bufsz, f))
+		buf[strcspn(buf, "\n")] = '\0';
+	fclose(f);
+}
+
+static void archive_header_to_host(struct dmesg_archive_header *hdr)
+{
+	hdr->nrecords = le32_to_cpu(hdr->nrecords);
+	hdr->flags = le32_to_cpu(hdr->flags);
+	hdr->levels = le32_to_cpu(hdr->levels);
+	hdr->facilities = le32_to_cpu(hdr->facilities);
+	hdr->boot_time = le64_to_cpu(hdr->boot_time);
+	hdr->first = le64_to_cpu(hdr->first);
+	hdr->last = le64_to_cpu(hdr->last);
+	hdr->seqnum = le64_to_cpu(hdr->seqnum);
+	hdr->size = le64_to_cpu(hdr->size);
+}
+
+/* returns 0 if the block header is valid and the block is in the file */
+static int archive_check_header(struct dmesg_archive_header *hdr,
+				size_t avail)
+{
+	if (memcmp(hdr->magic, DMESG_ARCHIVE_MAGIC, sizeof(hdr->magic)) != 0)
+		return -1;
+	if (hdr->nrecords > DMESG_ARCHIVE_RECORDS || hdr->size > avail ||
+	    hdr->size < hdr->nrecords * (sizeof(uint32_t)
+					 + sizeof(struct dmesg_archive_record)))
+		return -1;
+	return 0;
+}
 
-		sz = read_kmsg_one(ctl);
+/*
+ * Opens the archive for --archive-append. The records from /dev/kmsg which are
+ * already in the last block of the archive are not added again.
+ */
+static void archive_open(struct dmesg_control *ctl, const char *filename)
+{
+	struct dmesg_archive *ar = xcalloc(1, sizeof(*ar));
+	struct dmesg_archive_header hdr, last;
+	struct stat st;
+	off_t off = 0;
+	int have_last = 0;
+
+	ar->fd = open(filename, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (ar->fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), filename);
+	if (fstat(ar->fd, &st))
+		err(EXIT_FAILURE, _("stat of %s failed"), filename);
+
+	/* the headers only */
+	while (off < st.st_size) {
+		if (pread(ar->fd, &hdr, sizeof(hdr), off) != sizeof(hdr))
+			errx(EXIT_FAILURE, _("%s: invalid archive"), filename);
+		archive_header_to_host(&hdr);
+		off += sizeof(hdr);
+		if (archive_check_header(&hdr, st.st_size - off) != 0)
+			errx(EXIT_FAILURE, _("%s: invalid archive"), filename);
+		off += hdr.size;
+		last = hdr;
+		have_last = 1;
 	}
 
+	memcpy(ar->hdr.magic, DMESG_ARCHIVE_MAGIC, sizeof(ar->hdr.magic));
+	read_boot_id(ar->hdr.boot_id, sizeof(ar->hdr.boot_id));
+
+	if (have_last && (last.flags & DMESG_ARCHIVE_FL_SEQNUM) && *ar->hdr.boot_id
+	    && strncmp(last.boot_id, ar->hdr.boot_id, sizeof(last.boot_id)) == 0) {
+		ar->skip_seqnum = last.seqnum;
+		ar->has_skip = 1;
+	}
+	ctl->archive_out = ar;
+}
+
+static void archive_write_block(struct dmesg_control *ctl)
+{
+	struct dmesg_archive *ar = ctl->archive_out;
+	struct dmesg_archive_header hdr = ar->hdr;
+	size_t i, offsz = ar->hdr.nrecords * sizeof(uint32_t);
+
+	if (!ar->hdr.nrecords)
+		return;
+
+	hdr.size = offsz + ar->datasz;
+	hdr.nrecords = cpu_to_le32(hdr.nrecords);
+	hdr.flags = cpu_to_le32(hdr.flags);
+	hdr.levels = cpu_to_le32(hdr.levels);
+	hdr.facilities = cpu_to_le32(hdr.facilities);
+	hdr.boot_time = cpu_to_le64(hdr.boot_time);
+	hdr.first = cpu_to_le64(hdr.first);
+	hdr.last = cpu_to_le64(hdr.last);
+	hdr.seqnum = cpu_to_le64(hdr.seqnum);
+	hdr.size = cpu_to_le64(hdr.size);
+
+	for (i = 0; i < ar->hdr.nrecords; i++)
+		ar->offsets[i] = cpu_to_le32(ar->offsets[i]);
+
+	if (write_all(ar->fd, &hdr, sizeof(hdr)) ||
+	    write_all(ar->fd, ar->offsets, offsz) ||
+	    write_all(ar->fd, ar->data, ar->datasz))
+		err(EXIT_FAILURE, _("write failed"));
+
+	ar->hdr.nrecords = 0;
+	ar->datasz = 0;
+}
+
+static void archive_add_record(struct dmesg_control *ctl,
+			       struct dmesg_record *rec)
+{
+	struct dmesg_archive *ar = ctl->archive_out;
+	struct dmesg_archive_header *hdr = &ar->hdr;
+	struct dmesg_archive_record ar_rec = { .level = 0xff, .facility = 0xff };
+	uint64_t time = (uint64_t) rec->tv.tv_sec * USEC_PER_SEC + rec->tv.tv_usec;
+	size_t sz;
+
+	if (ar->has_skip && ctl->method == DMESG_METHOD_KMSG
+	    && rec->seqnum <= ar->skip_seqnum)
+		return;
+
+	if (!hdr->nrecords) {
+		hdr->flags = DMESG_ARCHIVE_FL_SORTED;
+		if (ctl->method == DMESG_METHOD_KMSG)
+			hdr->flags |= DMESG_ARCHIVE_FL_SEQNUM;
+		hdr->levels = hdr->facilities = 0;
+		hdr->boot_time = (uint64_t) ctl->boot_time.tv_sec * USEC_PER_SEC
+				 + ctl->boot_time.tv_usec;
+		hdr->first = hdr->last = time;
+	} else if (time < hdr->last) {
+		hdr->flags &= ~DMESG_ARCHIVE_FL_SORTED;
+		hdr->first = min(hdr->first, time);
+	} else
+		hdr->last = time;
+	hdr->seqnum = rec->seqnum;
+
+	if (rec->level >= 0 && rec->level < 32) {
+		ar_rec.level = rec->level;
+		hdr->levels |= 1U << rec->level;
+	}
+	if (rec->facility >= 0 && rec->facility < 32) {
+		ar_rec.facility = rec->facility;
+		hdr->facilities |= 1U << rec->facility;
+	}
+	ar_rec.time = cpu_to_le64(time);
+	ar_rec.size = cpu_to_le32(rec->mesg_size);
+
+	/* the record, the message and at least one zero */
+	sz = sizeof(ar_rec) + ((rec->mesg_size + 8) & ~7);
+	ar->data = xrealloc(ar->data, ar->datasz + sz);
+	memset(ar->data + ar->datasz, 0, sz);
+	memcpy(ar->data + ar->datasz, &ar_rec, sizeof(ar_rec));
+	memcpy(ar->data + ar->datasz + sizeof(ar_rec), rec->mesg, rec->mesg_size);
+
+	ar->offsets[hdr->nrecords++] = ar->datasz;
+	ar->datasz += sz;
+
+	if (hdr->nrecords == DMESG_ARCHIVE_RECORDS)
+		archive_write_block(ctl);
+}
+
+static void archive_close(struct dmesg_control *ctl)
+{
+	struct dmesg_archive *ar = ctl->archive_out;
+
+	archive_write_block(ctl);
+	if (close_fd(ar->fd) != 0)
+		err(EXIT_FAILURE, _("write failed"));
+	free(ar->data);
+	free(ar);
+	ctl->archive_out = NULL;
+}
+
+/* converts @bitarray (see include/bitops.h) to 32-bit mask */
+static uint32_t bitarray_to_mask(const char *bitarray, size_t nbits)
+{
+	uint32_t mask = 0;
+	size_t i;
+
+	for (i = 0; i < nbits && i < 32; i++)
+		if (isset(bitarray, i))
+			mask |= 1U << i;
+	return mask;
+}
+
+/*
+ * Copies the record @idx to @rec in host byte order. The records are only
+ * 4-byte aligned in the file (the offsets table is nrecords * 4 bytes), so
+ * they are not accessed in place. Returns the message or NULL if the record
+ * is not in the block.
+ */
+static const char *archive_get_record(const char *data,
+			const struct dmesg_archive_header *hdr, size_t idx,
+			struct dmesg_archive_record *rec)
+{
+	size_t recs = hdr->nrecords * sizeof(uint32_t);
+	uint32_t off;
+
+	memcpy(&off, data + idx * sizeof(uint32_t), sizeof(off));
+	off = le32_to_cpu(off);
+	if (off > hdr->size - recs - sizeof(*rec))
+		return NULL;
+
+	memcpy(rec, data + recs + off, sizeof(*rec));
+	rec->time = le64_to_cpu(rec->time);
+	rec->size = le32_to_cpu(rec->size);
+	return data + recs + off + sizeof(*rec);
+}
+
+/*
+ * Reads messages from archive. Returns 0 on success, the records are printed
+ * by this function.
+ */
+static int read_archive(struct dmesg_control *ctl)
+{
+	uint32_t levels = bitarray_to_mask(ctl->levels, ARRAY_SIZE(level_names));
+	uint32_t facilities = bitarray_to_mask(ctl->facilities,
+					       ARRAY_SIZE(facility_names));
+	struct stat st;
+	char *base, *p, *end;
+	int fd;
+
+	if (!ctl->filename)
+		return -1;
+
+	fd = open(ctl->filename, O_RDONLY);
+	if (fd < 0)
+		err(EXIT_FAILURE, _("cannot open %s"), ctl->filename);
+	if (fstat(fd, &st))
+		err(EXIT_FAILURE, _("stat of %s failed"), ctl->filename);
+	if (!st.st_size) {
+		close(fd);
+		return 0;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		err(EXIT_FAILURE, _("cannot mmap: %s"), ctl->filename);
+	close(fd);
+
+	end = base + st.st_size;
+
+	for (p = base; p < end; ) {
+		struct dmesg_archive_header hdr;
+		usec_t boot;
+		size_t i = 0, n;
+		char *data;
+
+		if ((size_t) (end - p) < sizeof(hdr))
+			errx(EXIT_FAILURE, _("%s: invalid archive"), ctl->filename);
+		memcpy(&hdr, p, sizeof(hdr));
+		archive_header_to_host(&hdr);
+		data = p + sizeof(hdr);
+		if (archive_check_header(&hdr, end - data) != 0)
+			errx(EXIT_FAILURE, _("%s: invalid archive"), ctl->filename);
+		p = data + hdr.size;
+
+		/* skip blocks without the requested records */
+		if ((ctl->fltr_lev && !(hdr.levels & levels)) ||
+		    (ctl->fltr_fac && !(hdr.facilities & facilities)))
+			continue;
+		boot = hdr.boot_time;
+		if ((ctl->since && boot + hdr.last < ctl->since) ||
+		    (ctl->until && boot + hdr.first > ctl->until))
+			continue;
+
+		ctl->boot_time.tv_sec = boot / USEC_PER_SEC;
+		ctl->boot_time.tv_usec = boot % USEC_PER_SEC;
+
+		/* the first record since --since */
+		if (ctl->since && (hdr.flags & DMESG_ARCHIVE_FL_SORTED)) {
+			size_t lo = 0, hi = hdr.nrecords;
+
+			while (lo < hi) {
+				size_t mid = lo + (hi - lo) / 2;
+				struct dmesg_archive_record r;
+
+				if (!archive_get_record(data, &hdr, mid, &r))
+					errx(EXIT_FAILURE, _("%s: invalid archive"),
+					     ctl->filename);
+				if (boot + r.time < ctl->since)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			i = lo;
+		}
+
+		for (n = hdr.nrecords; i < n; i++) {
+			struct dmesg_archive_record r;
+			struct dmesg_record rec;
+			const char *mesg;
+
+			mesg = archive_get_record(data, &hdr, i, &r);
+			if (!mesg || r.size >= (size_t) (p - mesg))
+				errx(EXIT_FAILURE, _("%s: invalid archive"),
+				     ctl->filename);
+
+			if (ctl->until && boot + r.time > ctl->until &&
+			    (hdr.flags & DMESG_ARCHIVE_FL_SORTED))
+				break;
+
+			INIT_DMESG_RECORD(&rec);
+			rec.mesg = mesg;
+			rec.mesg_size = r.size;
+			rec.tv.tv_sec = r.time / USEC_PER_SEC;
+			rec.tv.tv_usec = r.time % USEC_PER_SEC;
+			if (r.level != 0xff)
+				rec.level = r.level;
+			if (r.facility != 0xff)
+				rec.facility = r.facility;
+
+			print_record(ctl, &rec);
+		}
+	}
+
+	munmap(base, st.st_size);
 	return 0;
 }
 
@@ -1306,7 +1828,12 @@ int main(int argc, char *argv[])
 	int colormode = UL_COLORMODE_UNDEF;
 	enum {
 		OPT_TIME_FORMAT = CHAR_MAX + 1,
+		OPT_ARCHIVE,
+		OPT_ARCHIVE_APPEND,
+		OPT_SINCE,
+		OPT_UNTIL
 	};
+	char *archive_out = NULL;
 
 	static const struct option longopts[] = {
 		{ "buffer-size",   required_argument, NULL, 's' },
@@ -1335,19 +1862,25 @@ int main(int argc, char *argv[])
 		{ "version",       no_argument,	      NULL, 'V' },
 		{ "time-format",   required_argument, NULL, OPT_TIME_FORMAT },
 		{ "force-prefix",  no_argument,       NULL, 'p' },
+		{ "archive",       required_argument, NULL, OPT_ARCHIVE },
+		{ "archive-append", required_argument, NULL, OPT_ARCHIVE_APPEND },
+		{ "since",         required_argument, NULL, OPT_SINCE },
+		{ "until",         required_argument, NULL, OPT_UNTIL },
 		{ NULL,	           0, NULL, 0 }
 	};
 
 	static const ul_excl_t excl[] = {	/* rows and cols in ASCII order */
 		{ 'C','D','E','c','n','r' },	/* clear,off,on,read-clear,level,raw*/
+		{ 'F', OPT_ARCHIVE },		/* file, archive */
 		{ 'H','r' },			/* human, raw */
 		{ 'L','r' },			/* color, raw */
-		{ 'S','w' },			/* syslog,follow */
+		{ 'S','w', OPT_ARCHIVE },	/* syslog,follow,archive */
 		{ 'T','r' },			/* ctime, raw */
 		{ 'd','r' },			/* delta, raw */
 		{ 'e','r' },			/* reltime, raw */
 		{ 'r','x' },			/* raw, decode */
 		{ 'r','t' },			/* notime, raw */
+		{ 'r', OPT_ARCHIVE_APPEND },	/* raw, archive-append */
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -1460,6 +1993,21 @@ int main(int argc, char *argv[])
 		case OPT_TIME_FORMAT:
 			ctl.time_fmt = which_time_format(optarg);
 			break;
+		case OPT_ARCHIVE:
+			ctl.filename = optarg;
+			ctl.method = DMESG_METHOD_ARCHIVE;
+			break;
+		case OPT_ARCHIVE_APPEND:
+			archive_out = optarg;
+			break;
+		case OPT_SINCE:
+			if (parse_timestamp(optarg, &ctl.since) < 0)
+				errx(EXIT_FAILURE, _("invalid since argument: %s"), optarg);
+			break;
+		case OPT_UNTIL:
+			if (parse_timestamp(optarg, &ctl.until) < 0)
+				errx(EXIT_FAILURE, _("invalid until argument: %s"), optarg);
+			break;
 		default:
 			errtryhelp(EXIT_FAILURE);
 		}
@@ -1476,6 +2024,13 @@ int main(int argc, char *argv[])
 	    && dmesg_get_boot_time(&ctl.boot_time) != 0)
 		ctl.time_fmt = DMESG_TIMEFTM_NONE;
 
+	/* the archive has boot time in every block */
+	if ((ctl.since || ctl.until || archive_out)
+	    && ctl.method != DMESG_METHOD_ARCHIVE
+	    && !timerisset(&ctl.boot_time)
+	    && dmesg_get_boot_time(&ctl.boot_time) != 0)
+		err(EXIT_FAILURE, _("cannot get system boot time"));
+
 	if (delta)
 		switch (ctl.time_fmt) {
 		case DMESG_TIMEFTM_CTIME:
@@ -1511,12 +2066,15 @@ int main(int argc, char *argv[])
 			    errx(EXIT_FAILURE, _("--raw can be used together with --level or "
 				 "--facility only when reading messages from /dev/kmsg"));
 
-		/* only kmsg supports multi-line messages */
-		if (ctl.force_prefix && ctl.method != DMESG_METHOD_KMSG)
+		/* only kmsg (and so archive) supports multi-line messages */
+		if (ctl.force_prefix && ctl.method != DMESG_METHOD_KMSG
+		    && ctl.method != DMESG_METHOD_ARCHIVE)
 			ctl.force_prefix = 0;
 
 		if (ctl.pager)
 			pager_redirect();
+		if (archive_out)
+			archive_open(&ctl, archive_out);
 		n = read_buffer(&ctl, &buf);
 		if (n > 0)
 			print_buffer(&ctl, buf, n);
@@ -1524,6 +2082,8 @@ int main(int argc, char *argv[])
 			free(buf);
 		if (n < 0)
 			err(EXIT_FAILURE, _("read kernel buffer failed"));
+		if (ctl.archive_out)
+			archive_close(&ctl);
 		if (ctl.kmsg >= 0)
 			close(ctl.kmsg);
 		break;
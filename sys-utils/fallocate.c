@@ -147,37 +147,31 @@ static void xposix_fallocate(int fd, off_t offset, off_t length)
 }
 #endif
 
-/* The real buffer size has to be bufsize + sizeof(uintptr_t) */
-static int is_nul(void *buf, size_t bufsize)
+/*
+ * Returns non-zero if the buffer contains zeros only. The begin of the buffer
+ * is checked byte by byte and then the rest of the buffer is compared with
+ * its begin by memcmp(), which is well optimized in libc.
+ */
+static int is_nul(const char *buf, size_t bufsize)
 {
-	typedef uintptr_t word;
-	void const *vp;
-	char const *cbuf = buf, *cp;
-	word const *wp = buf;
-
-	/* set sentinel */
-	memset((char *) buf + bufsize, '\1', sizeof(word));
-
-	/* Find first nonzero *word*, or the word with the sentinel.  */
-	while (*wp++ == 0)
-		continue;
+	size_t i, n = min(bufsize, (size_t) 16);
 
-	/* Find the first nonzero *byte*, or the sentinel.  */
-	vp = wp - 1;
-	cp = vp;
-
-	while (*cp++ == 0)
-		continue;
-
-	return cbuf + bufsize < cp;
+	for (i = 0; i < n; i++) {
+		if (buf[i])
+			return 0;
+	}
+	return memcmp(buf, buf + n, bufsize - n) == 0;
 }
 
+/* the size of one read() for --dig-holes */
+#define DIG_HOLES_BUFSIZ	(1024 * 1024)
+
 static void dig_holes(int fd, off_t file_off, off_t len)
 {
 	off_t file_end = len ? file_off + len : 0;
 	off_t hole_start = 0, hole_sz = 0;
 	uintmax_t ct = 0;
-	size_t  bufsz;
+	size_t  bufsz, blksz;
 	char *buf;
 	struct stat st;
 #if defined(POSIX_FADV_SEQUENTIAL) && defined(HAVE_POSIX_FADVISE)
@@ -196,13 +190,14 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 	if (fstat(fd, &st) != 0)
 		err(EXIT_FAILURE, _("stat of %s failed"), filename);
 
-	bufsz = st.st_blksize;
+	/* holes are detected per block, but read in larger chunks */
+	blksz = st.st_blksize;
+	bufsz = max(blksz, DIG_HOLES_BUFSIZ / blksz * blksz);
 
 	if (lseek(fd, file_off, SEEK_SET) < 0)
 		err(EXIT_FAILURE, _("seek on %s failed"), filename);
 
-	/* buffer + extra space for is_nul() sentinel */
-	buf = xmalloc(bufsz + sizeof(uintptr_t));
+	buf = xmalloc(bufsz);
 	while (file_end == 0 || file_off < file_end) {
 		/*
 		 * Detect data area (skip holes)
@@ -237,11 +232,23 @@ static void dig_holes(int fd, off_t file_off, off_t len)
 				if (!hole_sz)				/* new hole detected */
 					hole_start = off;
 				hole_sz += rsz;
-			 } else if (hole_sz) {
-				xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
-					   hole_start, hole_sz);
-				ct += hole_sz;
-				hole_sz = hole_start = 0;
+			} else {
+				size_t i;
+
+				for (i = 0; i < (size_t) rsz; i += blksz) {
+					size_t sz = min(blksz, (size_t) rsz - i);
+
+					if (is_nul(buf + i, sz)) {
+						if (!hole_sz)		/* new hole detected */
+							hole_start = off + i;
+						hole_sz += sz;
+					} else if (hole_sz) {
+						xfallocate(fd, FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,
+							   hole_start, hole_sz);
+						ct += hole_sz;
+						hole_sz = hole_start = 0;
+					}
+				}
 			}
 
 #if defined(POSIX_FADV_DONTNEED) && defined(HAVE_POSIX_FADVISE)
@@ -35,6 +35,8 @@
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 
 #ifdef HAVE_SYS_FS_H
 # include <linux/fs.h>
@@ -44,8 +46,10 @@
 #include "strutils.h"
 #include "c.h"
 #include "closestream.h"
+#include "monotonic.h"
 #include "pathnames.h"
 #include "sysfs.h"
+#include "xalloc.h"
 
 #include <libmount.h>
 
@@ -58,13 +62,17 @@ struct fstrim_range {
 #define FITRIM		_IOWR('X', 121, struct fstrim_range)
 #endif
 
-/* returns: 0 = success, 1 = unsupported, < 0 = error */
-static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
-			    int verbose)
+/*
+ * The @devname and the time of the trim are reported in verbose mode for
+ * --jobs only. Returns: 0 = success, 1 = unsupported, < 0 = error
+ */
+static int fstrim_filesystem(const char *path, const char *devname,
+			     struct fstrim_range *rangetpl, int verbose)
 {
 	int fd, rc;
 	struct stat sb;
 	struct fstrim_range range;
+	struct timeval start, end;
 
 	/* kernel modifies the range */
 	memcpy(&range, rangetpl, sizeof(range));
@@ -86,6 +94,7 @@ static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
 		goto done;
 	}
 	errno = 0;
+	gettime_monotonic(&start);
 	if (ioctl(fd, FITRIM, &range)) {
 		rc = errno == EOPNOTSUPP || errno == ENOTTY ? 1 : -errno;
 
@@ -98,10 +107,19 @@ static int fstrim_filesystem(const char *path, struct fstrim_range *rangetpl,
 		char *str = size_to_human_string(
 				SIZE_SUFFIX_3LETTER | SIZE_SUFFIX_SPACE,
 				(uint64_t) range.len);
-		/* TRANSLATORS: The standard value here is a very large number. */
-		printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
+		gettime_monotonic(&end);
+		if (devname)
+			/* TRANSLATORS: The standard value here is a very large number. */
+			printf(_("%s: %s (%" PRIu64 " bytes) trimmed on %s in %.3f seconds\n"),
+				path, str, (uint64_t) range.len, devname,
+				(end.tv_sec - start.tv_sec) +
+				(end.tv_usec - start.tv_usec) / 1000000.0);
+		else
+			/* TRANSLATORS: The standard value here is a very large number. */
+			printf(_("%s: %s (%" PRIu64 " bytes) trimmed\n"),
 				path, str, (uint64_t) range.len);
 		free(str);
+		fflush(stdout);
 	}
 
 	rc = 0;
@@ -111,7 +129,8 @@ done:
 	return rc;
 }
 
-static int has_discard(const char *devname, struct sysfs_cxt *wholedisk)
+static int has_discard(const char *devname, struct sysfs_cxt *wholedisk,
+		       dev_t *diskno)
 {
 	struct sysfs_cxt cxt, *parent = NULL;
 	uint64_t dg = 0;
@@ -129,6 +148,7 @@ static int has_discard(const char *devname, struct sysfs_cxt *wholedisk)
 	 */
 	if (sysfs_devno_to_wholedisk(dev, NULL, 0, &disk) || !disk)
 		return 1;
+	*diskno = disk;
 	if (dev != disk) {
 		if (wholedisk->devno != disk) {
 			sysfs_deinit(wholedisk);
@@ -167,6 +187,79 @@ static int uniq_fs_source_cmp(
 	return !mnt_fs_streq_srcpath(a, mnt_fs_get_srcpath(b));
 }
 
+struct fstrim_fs {
+	char *target;
+	char *source;
+	dev_t disk;		/* whole disk of the source */
+};
+
+/*
+ * Trims @fss by @jobs processes. The filesystems on the same whole disk are
+ * trimmed by one process one after another, the different disks are trimmed
+ * in parallel. Returns the number of failed filesystems.
+ */
+static int fstrim_all_parallel(struct fstrim_fs *fss, size_t nfss,
+			       struct fstrim_range *rangetpl, int verbose,
+			       size_t jobs)
+{
+	size_t i, running = 0;
+	int *done = xcalloc(nfss, sizeof(int));
+	int cnt_err = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < nfss || running; ) {
+		int status;
+		pid_t pid;
+
+		/* start a process for the next disk */
+		if (i < nfss && running < jobs) {
+			dev_t disk = fss[i].disk;
+			size_t k;
+
+			pid = fork();
+			if (pid < 0)
+				err(MNT_EX_FAIL, _("fork failed"));
+			if (pid == 0) {
+				int errs = 0;
+
+				for (k = i; k < nfss; k++) {
+					if (fss[k].disk != disk)
+						continue;
+					if (fstrim_filesystem(fss[k].target,
+							fss[k].source, rangetpl,
+							verbose) < 0)
+						errs++;
+				}
+				_exit(min(errs, 255));
+			}
+			running++;
+
+			/* mark the disk as done, find the next one */
+			for (k = i; k < nfss; k++) {
+				if (fss[k].disk == disk)
+					done[k] = 1;
+			}
+			while (i < nfss && done[i])
+				i++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0)
+			err(MNT_EX_FAIL, _("waitpid failed"));
+		running--;
+		if (!WIFEXITED(status))
+			cnt_err++;
+		else
+			cnt_err += WEXITSTATUS(status);
+	}
+
+	free(done);
+	return cnt_err;
+}
+
 /*
  * fstrim --all follows "mount -a" return codes:
  *
@@ -174,12 +267,14 @@ static int uniq_fs_source_cmp(
  * 32 = all failed
  * 64 = some failed, some success
  */
-static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
+static int fstrim_all(struct fstrim_range *rangetpl, int verbose, size_t jobs)
 {
 	struct libmnt_fs *fs;
 	struct libmnt_iter *itr;
 	struct libmnt_table *tab;
 	struct sysfs_cxt wholedisk = UL_SYSFSCXT_EMPTY;
+	struct fstrim_fs *fss = NULL;
+	size_t i, nfss = 0;
 	int cnt = 0, cnt_err = 0;
 
 	mnt_init_debug(0);
@@ -202,6 +297,7 @@ static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
 		const char *src = mnt_fs_get_srcpath(fs),
 			   *tgt = mnt_fs_get_target(fs);
 		char *path;
+		dev_t disk = 0;
 		int rc = 1;
 
 		if (!src || !tgt || *src != '/' ||
@@ -218,10 +314,21 @@ static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
 		if (rc)
 			continue;	/* overlaying mount */
 
-		if (!has_discard(src, &wholedisk))
+		if (!has_discard(src, &wholedisk, &disk))
 			continue;
 		cnt++;
 
+		if (jobs > 1) {
+			/* trimmed later by fstrim_all_parallel() */
+			if (nfss % 16 == 0)
+				fss = xrealloc(fss, (nfss + 16) * sizeof(*fss));
+			fss[nfss].target = xstrdup(tgt);
+			fss[nfss].source = xstrdup(src);
+			fss[nfss].disk = disk;
+			nfss++;
+			continue;
+		}
+
 		/*
 		 * We're able to detect that the device supports discard, but
 		 * things also depend on filesystem or device mapping, for
@@ -230,10 +337,19 @@ static int fstrim_all(struct fstrim_range *rangetpl, int verbose)
 		 * This is reason why we ignore EOPNOTSUPP and ENOTTY errors
 		 * from discard ioctl.
 		 */
-		if (fstrim_filesystem(tgt, rangetpl, verbose) < 0)
+		if (fstrim_filesystem(tgt, NULL, rangetpl, verbose) < 0)
 		       cnt_err++;
 	}
 
+	if (nfss)
+		cnt_err = fstrim_all_parallel(fss, nfss, rangetpl, verbose, jobs);
+
+	for (i = 0; i < nfss; i++) {
+		free(fss[i].target);
+		free(fss[i].source);
+	}
+	free(fss);
+
 	sysfs_deinit(&wholedisk);
 	mnt_unref_table(tab);
 	mnt_free_iter(itr);
@@ -258,6 +374,7 @@ static void __attribute__((__noreturn__)) usage(void)
 
 	fputs(USAGE_OPTIONS, out);
 	fputs(_(" -a, --all           trim all mounted filesystems that are supported\n"), out);
+	fputs(_(" -j, --jobs <num>    trim up to <num> disks in parallel (with --all)\n"), out);
 	fputs(_(" -o, --offset <num>  the offset in bytes to start discarding from\n"), out);
 	fputs(_(" -l, --length <num>  the number of bytes to discard\n"), out);
 	fputs(_(" -m, --minimum <num> the minimum extent length to discard\n"), out);
@@ -273,12 +390,14 @@ int main(int argc, char **argv)
 {
 	char *path = NULL;
 	int c, rc, verbose = 0, all = 0;
+	size_t jobs = 1;
 	struct fstrim_range range;
 
 	static const struct option longopts[] = {
 	    { "all",       no_argument,       NULL, 'a' },
 	    { "help",      no_argument,       NULL, 'h' },
 	    { "version",   no_argument,       NULL, 'V' },
+	    { "jobs",      required_argument, NULL, 'j' },
 	    { "offset",    required_argument, NULL, 'o' },
 	    { "length",    required_argument, NULL, 'l' },
 	    { "minimum",   required_argument, NULL, 'm' },
@@ -294,7 +413,7 @@ int main(int argc, char **argv)
 	memset(&range, 0, sizeof(range));
 	range.len = ULLONG_MAX;
 
-	while ((c = getopt_long(argc, argv, "ahVo:l:m:v", longopts, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "ahVj:o:l:m:v", longopts, NULL)) != -1) {
 		switch(c) {
 		case 'a':
 			all = 1;
@@ -305,6 +424,11 @@ int main(int argc, char **argv)
 		case 'V':
 			printf(UTIL_LINUX_VERSION);
 			return EXIT_SUCCESS;
+		case 'j':
+			jobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!jobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 'l':
 			range.len = strtosize_or_err(optarg,
 					_("failed to parse length"));
@@ -338,9 +462,9 @@ int main(int argc, char **argv)
 	}
 
 	if (all)
-		rc = fstrim_all(&range, verbose);
+		rc = fstrim_all(&range, verbose, jobs);
 	else {
-		rc = fstrim_filesystem(path, &range, verbose);
+		rc = fstrim_filesystem(path, NULL, &range, verbose);
 		if (rc == 1) {
 			warnx(_("%s: the discard operation is not supported"), path);
 			rc = EXIT_FAILURE;
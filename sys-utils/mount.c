@@ -26,6 +26,8 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdarg.h>
@@ -38,6 +40,7 @@
 #include "strutils.h"
 #include "closestream.h"
 #include "canonicalize.h"
+#include "monotonic.h"
 
 #define XALLOC_EXIT_CODE MNT_EX_SYSERR
 #include "xalloc.h"
@@ -231,6 +234,371 @@ static int mount_all(struct libmnt_context *cxt)
 	return rc;
 }
 
+/*
+ * mount -a --jobs <num>
+ *
+ * The fstab entries are mounted by up to <num> processes in parallel. An
+ * entry is not mounted before the entries it depends on are done; the
+ * dependencies are:
+ *
+ *  - the entry with the nearest parent mountpoint (e.g. /usr for /usr/local),
+ *  - the previous entry with the same mountpoint (over-mounts),
+ *  - the entries with the nearest mountpoint for the paths specified by
+ *    x-systemd.requires-mounts-for=<path> options.
+ *
+ * The entries which do not depend on each other are mounted in fstab order.
+ */
+enum {
+	MOUNT_JOB_MOUNTED = 0,	/* exit codes of the mount processes */
+	MOUNT_JOB_FAILED,
+	MOUNT_JOB_IGNORED,
+	MOUNT_JOB_ALREADY,
+	MOUNT_JOB_NOTMOUNTED	/* success, but not mounted (e.g. nofail) */
+};
+
+enum {
+	MOUNT_JOB_PENDING = 0,
+	MOUNT_JOB_RUNNING,
+	MOUNT_JOB_DONE
+};
+
+struct mount_job {
+	struct libmnt_fs *fs;
+	char *target;		/* mountpoint without trailing slashes */
+	size_t idx;		/* position in fstab */
+
+	size_t *deps;		/* indexes of the entries to wait for */
+	size_t ndeps;
+
+	pid_t pid;
+	struct timeval start;
+	int state;
+};
+
+static int cmp_mount_jobs(const void *a, const void *b)
+{
+	const struct mount_job *ja = *((const struct mount_job * const *) a);
+	const struct mount_job *jb = *((const struct mount_job * const *) b);
+	int rc = strcmp(ja->target, jb->target);
+
+	if (rc)
+		return rc;
+	return ja->idx < jb->idx ? -1 : ja->idx > jb->idx;
+}
+
+/*
+ * Returns index of the entry mounted on @path the entry @self should wait for,
+ * or -1. The last entry before @self is preferred; if @before is not zero
+ * only the entries before @self are accepted.
+ */
+static ssize_t find_mount_job(struct mount_job **sorted, size_t nsorted,
+			      const char *path, size_t self, int before)
+{
+	size_t lo = 0, hi = nsorted;
+	ssize_t res = -1;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (strcmp(sorted[mid]->target, path) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (; lo < nsorted && strcmp(sorted[lo]->target, path) == 0; lo++) {
+		size_t idx = sorted[lo]->idx;
+
+		if (idx < self)
+			res = idx;
+		else if (idx > self) {
+			if (res < 0 && !before)
+				res = idx;
+			break;
+		}
+	}
+	return res;
+}
+
+/* removes the last path component, returns 0 if there is nothing to remove */
+static int parent_path(char *path)
+{
+	char *p = strrchr(path, '/');
+
+	if (!p || (p == path && !*(p + 1)))
+		return 0;
+	if (p == path)
+		*(p + 1) = '\0';
+	else
+		*p = '\0';
+	return 1;
+}
+
+static void add_mount_dep(struct mount_job *job, ssize_t idx)
+{
+	size_t i;
+
+	if (idx < 0 || (size_t) idx == job->idx)
+		return;
+	for (i = 0; i < job->ndeps; i++) {
+		if (job->deps[i] == (size_t) idx)
+			return;
+	}
+	job->deps = xrealloc(job->deps, (job->ndeps + 1) * sizeof(size_t));
+	job->deps[job->ndeps++] = idx;
+}
+
+/* adds dependence on the entry with the nearest mountpoint for @path */
+static void add_mount_path_dep(struct mount_job *job,
+			       struct mount_job **sorted, size_t nsorted,
+			       char *path)
+{
+	do {
+		ssize_t idx = find_mount_job(sorted, nsorted, path, job->idx, 0);
+
+		if (idx >= 0) {
+			add_mount_dep(job, idx);
+			break;
+		}
+	} while (parent_path(path));
+}
+
+static char *normalize_mount_target(const char *target)
+{
+	char *res = xstrdup(target);
+	size_t sz = strlen(res);
+
+	while (sz > 1 && res[sz - 1] == '/')
+		res[--sz] = '\0';
+	return res;
+}
+
+static void mount_job_deps(struct mount_job *job,
+			   struct mount_job **sorted, size_t nsorted)
+{
+	const char *optstr = mnt_fs_get_user_options(job->fs);
+	char *name, *value, *path;
+	size_t namesz, valuesz;
+
+	if (!job->target)
+		return;
+
+	/* over-mount */
+	add_mount_dep(job, find_mount_job(sorted, nsorted,
+					  job->target, job->idx, 1));
+	/* parent */
+	path = xstrdup(job->target);
+	if (parent_path(path))
+		add_mount_path_dep(job, sorted, nsorted, path);
+	free(path);
+
+	/* x-systemd.requires-mounts-for= */
+	while (optstr && mnt_optstr_next_option((char **) &optstr,
+				&name, &namesz, &value, &valuesz) == 0) {
+		if (namesz != sizeof("x-systemd.requires-mounts-for") - 1
+		    || strncmp(name, "x-systemd.requires-mounts-for", namesz) != 0
+		    || !value || !valuesz || *value != '/')
+			continue;
+		path = xstrndup(value, valuesz);
+		if (*path) {
+			char *tmp = normalize_mount_target(path);
+
+			free(path);
+			path = tmp;
+			add_mount_path_dep(job, sorted, nsorted, path);
+		}
+		free(path);
+	}
+}
+
+static int mount_job_is_ready(struct mount_job *jobs, struct mount_job *job)
+{
+	size_t i;
+
+	for (i = 0; i < job->ndeps; i++) {
+		if (jobs[job->deps[i]].state != MOUNT_JOB_DONE)
+			return 0;
+	}
+	return 1;
+}
+
+static void __attribute__((__noreturn__))
+mount_job_child(struct libmnt_context *cxt, struct libmnt_table *fstab,
+		struct libmnt_fs *fs)
+{
+	struct libmnt_iter *itr;
+	int rc, mntrc, ignored, code = MOUNT_JOB_FAILED;
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		err(MNT_EX_SYSERR, _("failed to initialize libmount iterator"));
+
+	mnt_table_set_iter(fstab, itr, fs);
+
+	rc = mnt_context_next_mount(cxt, itr, &fs, &mntrc, &ignored);
+	if (rc) {
+		errno = -rc;
+		warn(_("%s: failed to mount"), mnt_fs_get_target(fs));
+	} else if (ignored)
+		code = ignored == 1 ? MOUNT_JOB_IGNORED : MOUNT_JOB_ALREADY;
+	else if (mk_exit_code(cxt, mntrc) == MNT_EX_SUCCESS)
+		code = mnt_context_get_status(cxt) ? MOUNT_JOB_MOUNTED :
+						     MOUNT_JOB_NOTMOUNTED;
+	fflush(stdout);
+	fflush(stderr);
+	_exit(code);
+}
+
+static int mount_all_parallel(struct libmnt_context *cxt, size_t njobs)
+{
+	struct libmnt_table *fstab, *mtab;
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	struct mount_job *jobs = NULL, **sorted;
+	size_t i, n = 0, nsorted = 0, ndone = 0, running = 0, next = 0;
+	int nsucc = 0, nerrs = 0, verbose = mnt_context_is_verbose(cxt);
+	int cycle = 0;
+
+	if (mnt_context_get_fstab(cxt, &fstab))
+		err(MNT_EX_SYSERR, _("failed to read fstab"));
+
+	/* read mtab only once, the mount processes share it */
+	if (mnt_context_get_mtab(cxt, &mtab))
+		err(MNT_EX_SYSERR, _("failed to read mtab"));
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		err(MNT_EX_SYSERR, _("failed to initialize libmount iterator"));
+
+	while (mnt_table_next_fs(fstab, itr, &fs) == 0) {
+		const char *tgt = mnt_fs_get_target(fs);
+
+		jobs = xrealloc(jobs, (n + 1) * sizeof(*jobs));
+		memset(&jobs[n], 0, sizeof(*jobs));
+		jobs[n].fs = fs;
+		jobs[n].idx = n;
+		if (tgt && *tgt == '/')
+			jobs[n].target = normalize_mount_target(tgt);
+		n++;
+	}
+	mnt_free_iter(itr);
+
+	sorted = xcalloc(n ? n : 1, sizeof(*sorted));
+	for (i = 0; i < n; i++) {
+		if (jobs[i].target)
+			sorted[nsorted++] = &jobs[i];
+	}
+	qsort(sorted, nsorted, sizeof(*sorted), cmp_mount_jobs);
+
+	for (i = 0; i < n; i++)
+		mount_job_deps(&jobs[i], sorted, nsorted);
+	free(sorted);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	while (ndone < n) {
+		struct mount_job *job = NULL;
+		struct timeval now;
+		int status, code;
+		pid_t pid;
+
+		/* the first pending entry with all dependencies done */
+		while (next < n && jobs[next].state != MOUNT_JOB_PENDING)
+			next++;
+		if (running < njobs) {
+			for (i = next; i < n; i++) {
+				if (jobs[i].state == MOUNT_JOB_PENDING &&
+				    mount_job_is_ready(jobs, &jobs[i])) {
+					job = &jobs[i];
+					break;
+				}
+			}
+			/* x-systemd.requires-mounts-for= loop */
+			if (!job && !running) {
+				if (!cycle++)
+					warnx(_("dependency loop in fstab, "
+						"mounting in fstab order"));
+				job = &jobs[next];
+			}
+		}
+
+		if (job) {
+			gettime_monotonic(&job->start);
+
+			pid = fork();
+			if (pid < 0)
+				err(MNT_EX_SYSERR, _("fork failed"));
+			if (pid == 0)
+				mount_job_child(cxt, fstab, job->fs);
+
+			job->pid = pid;
+			job->state = MOUNT_JOB_RUNNING;
+			running++;
+			continue;
+		}
+
+		pid = wait(&status);
+		if (pid < 0)
+			err(MNT_EX_SYSERR, _("waitpid failed"));
+
+		for (i = 0; i < n; i++) {
+			if (jobs[i].state == MOUNT_JOB_RUNNING &&
+			    jobs[i].pid == pid) {
+				job = &jobs[i];
+				break;
+			}
+		}
+		if (!job)
+			continue;
+
+		gettime_monotonic(&now);
+		job->state = MOUNT_JOB_DONE;
+		running--;
+		ndone++;
+
+		code = WIFEXITED(status) ? WEXITSTATUS(status) : MOUNT_JOB_FAILED;
+		switch (code) {
+		case MOUNT_JOB_MOUNTED:
+			nsucc++;
+			if (verbose)
+				printf(_("%-25s: successfully mounted in %.3f seconds\n"),
+					mnt_fs_get_target(job->fs),
+					(now.tv_sec - job->start.tv_sec) +
+					(now.tv_usec - job->start.tv_usec) / 1000000.0);
+			break;
+		case MOUNT_JOB_NOTMOUNTED:
+			nsucc++;
+			break;
+		case MOUNT_JOB_IGNORED:
+			if (verbose)
+				printf(_("%-25s: ignored\n"),
+					mnt_fs_get_target(job->fs));
+			break;
+		case MOUNT_JOB_ALREADY:
+			if (verbose)
+				printf(_("%-25s: already mounted\n"),
+					mnt_fs_get_target(job->fs));
+			break;
+		default:
+			nerrs++;
+			break;
+		}
+		fflush(stdout);
+	}
+
+	for (i = 0; i < n; i++) {
+		free(jobs[i].target);
+		free(jobs[i].deps);
+	}
+	free(jobs);
+
+	if (nerrs == 0)
+		return MNT_EX_SUCCESS;		/* all success */
+	if (nsucc == 0)
+		return MNT_EX_FAIL;		/* all failed */
+	return MNT_EX_SOMEOK;			/* some success, some failed */
+}
+
 static void success_message(struct libmnt_context *cxt)
 {
 	unsigned long mflags = 0;
@@ -405,6 +773,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	" -c, --no-canonicalize   don't canonicalize paths\n"
 	" -f, --fake              dry run; skip the mount(2) syscall\n"
 	" -F, --fork              fork off for each device (use with -a)\n"
+	" -j, --jobs <num>        mount up to <num> filesystems at once (use with -a)\n"
 	" -T, --fstab <path>      alternative file to /etc/fstab\n"));
 	fprintf(out, _(
 	" -i, --internal-only     don't call the mount.<type> helpers\n"));
@@ -466,6 +835,7 @@ static void __attribute__((__noreturn__)) usage(void)
 int main(int argc, char **argv)
 {
 	int c, rc = MNT_EX_SUCCESS, all = 0, show_labels = 0;
+	size_t njobs = 1;
 	struct libmnt_context *cxt;
 	struct libmnt_table *fstab = NULL;
 	char *srcbuf = NULL;
@@ -492,6 +862,7 @@ int main(int argc, char **argv)
 		{ "fstab",            required_argument, NULL, 'T'                   },
 		{ "fork",             no_argument,       NULL, 'F'                   },
 		{ "help",             no_argument,       NULL, 'h'                   },
+		{ "jobs",             required_argument, NULL, 'j'                   },
 		{ "no-mtab",          no_argument,       NULL, 'n'                   },
 		{ "read-only",        no_argument,       NULL, 'r'                   },
 		{ "ro",               no_argument,       NULL, 'r'                   },
@@ -525,6 +896,7 @@ int main(int argc, char **argv)
 
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'B','M','R' },			/* bind,move,rbind */
+		{ 'F','j' },				/* fork,jobs */
 		{ 'L','U', MOUNT_OPT_SOURCE },	/* label,uuid,source */
 		{ 0 }
 	};
@@ -545,7 +917,7 @@ int main(int argc, char **argv)
 
 	mnt_context_set_tables_errcb(cxt, table_parser_errcb);
 
-	while ((c = getopt_long(argc, argv, "aBcfFhilL:Mno:O:rRsU:vVwt:T:",
+	while ((c = getopt_long(argc, argv, "aBcfFhij:lL:Mno:O:rRsU:vVwt:T:",
 					longopts, NULL)) != -1) {
 
 		/* only few options are allowed for non-root users */
@@ -573,6 +945,11 @@ int main(int argc, char **argv)
 		case 'h':
 			usage();
 			break;
+		case 'j':
+			njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!njobs)
+				errx(MNT_EX_USAGE, _("invalid jobs argument"));
+			break;
 		case 'i':
 			mnt_context_disable_helpers(cxt, TRUE);
 			break;
@@ -722,7 +1099,10 @@ int main(int argc, char **argv)
 		/*
 		 * A) Mount all
 		 */
-		rc = mount_all(cxt);
+		if (njobs > 1)
+			rc = mount_all_parallel(cxt, njobs);
+		else
+			rc = mount_all(cxt);
 		goto done;
 
 	} else if (argc == 0 && (mnt_context_get_source(cxt) ||
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <ctype.h>
@@ -23,6 +24,7 @@
 #include "strutils.h"
 #include "optutils.h"
 #include "closestream.h"
+#include "monotonic.h"
 
 #include "swapheader.h"
 #include "swapprober.h"
@@ -110,6 +112,13 @@ struct swap_prop {
 	int no_fail;			/* skip device if not exist */
 };
 
+/* swapon -a entry */
+struct swapon_job {
+	const char *device;		/* canonicalized device or file */
+	struct swap_prop prop;		/* per device setting */
+	pid_t pid;			/* --jobs worker or 0 */
+};
+
 /* device description */
 struct swap_device {
 	const char *path;		/* device or file to be turned on */
@@ -124,6 +133,7 @@ struct swapon_ctl {
 	int ncolumns;				/* number of columns */
 
 	struct swap_prop props;		/* global settings for all devices */
+	size_t njobs;			/* --jobs */
 
 	unsigned int
 		all:1,			/* turn on all swap devices */
@@ -623,10 +633,13 @@ static int do_swapon(const struct swapon_ctl *ctl,
 	int status;
 	int flags = 0;
 	int priority;
+	struct timeval start, end;
 
 	assert(ctl);
 	assert(prop);
 
+	gettime_monotonic(&start);
+
 	if (!canonic) {
 		dev.path = mnt_resolve_spec(spec, mntcache);
 		if (!dev.path)
@@ -672,6 +685,12 @@ static int do_swapon(const struct swapon_ctl *ctl,
 	status = swapon(dev.path, flags);
 	if (status < 0)
 		warn(_("%s: swapon failed"), dev.path);
+	else if (ctl->verbose) {
+		gettime_monotonic(&end);
+		printf(_("%s: activated in %.3f seconds\n"), dev.path,
+			(end.tv_sec - start.tv_sec) +
+			(end.tv_usec - start.tv_usec) / 1E6);
+	}
 
 	return status;
 }
@@ -722,11 +741,73 @@ static int parse_options(struct swap_prop *props, const char *options)
 }
 
 
+/*
+ * Activates the swap areas by up to ctl->njobs processes. The areas are
+ * independent, every worker probes and activates one device.
+ */
+static int swapon_all_parallel(struct swapon_ctl *ctl,
+			       struct swapon_job *jobs, size_t njobs)
+{
+	size_t i, next = 0, running = 0;
+	int status = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	while (next < njobs || running) {
+		int st;
+		pid_t pid;
+
+		while (running < ctl->njobs && next < njobs) {
+			struct swapon_job *job = &jobs[next++];
+
+			pid = fork();
+			if (pid < 0) {
+				warn(_("fork failed"));
+				status |= -1;
+				next = njobs;
+				break;
+			}
+			if (pid == 0) {
+				int rc = do_swapon(ctl, &job->prop, job->device, TRUE);
+
+				fflush(stdout);
+				_exit(rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+			}
+			job->pid = pid;
+			running++;
+		}
+		if (!running)
+			break;
+
+		pid = wait(&st);
+		if (pid < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EXIT_FAILURE, _("waitpid failed"));
+		}
+		for (i = 0; i < njobs; i++) {
+			if (jobs[i].pid == pid)
+				break;
+		}
+		if (i == njobs)
+			continue;	/* not our child */
+		running--;
+		jobs[i].pid = 0;
+		if (!WIFEXITED(st) || WEXITSTATUS(st) != EXIT_SUCCESS)
+			status |= -1;
+	}
+
+	return status;
+}
+
 static int swapon_all(struct swapon_ctl *ctl)
 {
 	struct libmnt_table *tb = get_fstab();
 	struct libmnt_iter *itr;
 	struct libmnt_fs *fs;
+	struct swapon_job *jobs = NULL;
+	size_t i, njobs = 0;
 	int status = 0;
 
 	if (!tb)
@@ -776,10 +857,33 @@ static int swapon_all(struct swapon_ctl *ctl)
 			continue;
 		}
 
-		/* swapon */
-		status |= do_swapon(ctl, &prop, device, TRUE);
+		/* the same device specified more than once */
+		for (i = 0; i < njobs; i++) {
+			if (strcmp(jobs[i].device, device) == 0)
+				break;
+		}
+		if (i < njobs) {
+			if (ctl->verbose)
+				warnx(_("%s: duplicate entry -- ignored"), device);
+			continue;
+		}
+
+		jobs = xrealloc(jobs, (njobs + 1) * sizeof(struct swapon_job));
+		jobs[njobs].device = device;
+		jobs[njobs].prop = prop;
+		jobs[njobs].pid = 0;
+		njobs++;
 	}
 
+	/* swapon */
+	if (ctl->njobs > 1 && njobs > 1)
+		status |= swapon_all_parallel(ctl, jobs, njobs);
+	else {
+		for (i = 0; i < njobs; i++)
+			status |= do_swapon(ctl, &jobs[i].prop, jobs[i].device, TRUE);
+	}
+
+	free(jobs);
 	mnt_free_iter(itr);
 	return status;
 }
@@ -801,6 +905,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -d, --discard[=<policy>] enable swap discards, if supported by device\n"), out);
 	fputs(_(" -e, --ifexists           silently skip devices that do not exist\n"), out);
 	fputs(_(" -f, --fixpgsz            reinitialize the swap space if necessary\n"), out);
+	fputs(_(" -j, --jobs <num>         activate up to <num> swaps in parallel (with --all)\n"), out);
 	fputs(_(" -o, --options <list>     comma-separated list of swap options\n"), out);
 	fputs(_(" -p, --priority <prio>    specify the priority of the swap device\n"), out);
 	fputs(_(" -s, --summary            display summary about used swap devices (DEPRECATED)\n"), out);
@@ -857,6 +962,7 @@ int main(int argc, char *argv[])
 		{ "summary",    no_argument,       NULL, 's'               },
 		{ "fixpgsz",    no_argument,       NULL, 'f'               },
 		{ "all",        no_argument,       NULL, 'a'               },
+		{ "jobs",       required_argument, NULL, 'j'               },
 		{ "help",       no_argument,       NULL, 'h'               },
 		{ "verbose",    no_argument,       NULL, 'v'               },
 		{ "version",    no_argument,       NULL, 'V'               },
@@ -889,7 +995,7 @@ int main(int argc, char *argv[])
 	mnt_init_debug(0);
 	mntcache = mnt_new_cache();
 
-	while ((c = getopt_long(argc, argv, "ahd::efo:p:svVL:U:",
+	while ((c = getopt_long(argc, argv, "ahd::efj:o:p:svVL:U:",
 				long_opts, NULL)) != -1) {
 
 		err_exclusive_options(c, long_opts, excl, excl_st);
@@ -934,6 +1040,11 @@ int main(int argc, char *argv[])
 		case 'f':
 			ctl.fix_page_size = 1;
 			break;
+		case 'j':
+			ctl.njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!ctl.njobs)
+				errx(EXIT_FAILURE, _("invalid jobs argument"));
+			break;
 		case 's':		/* status report */
 			status = display_summary();
 			return status;
@@ -989,6 +1100,9 @@ int main(int argc, char *argv[])
 		errtryhelp(EXIT_FAILURE);
 	}
 
+	if (ctl.njobs && !ctl.all)
+		errx(EXIT_FAILURE, _("--jobs requires --all"));
+
 	if (ctl.all)
 		status |= swapon_all(&ctl);
 
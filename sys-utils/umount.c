@@ -26,15 +26,19 @@
 #include <getopt.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
 
 #include <libmount.h>
 
 #include "nls.h"
 #include "c.h"
 #include "env.h"
+#include "strutils.h"
 #include "closestream.h"
 #include "pathnames.h"
 #include "canonicalize.h"
+#include "monotonic.h"
 
 #define XALLOC_EXIT_CODE MNT_EX_SYSERR
 #include "xalloc.h"
@@ -93,6 +97,7 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_("     --fake              dry run; skip the umount(2) syscall\n"), out);
 	fputs(_(" -f, --force             force unmount (in case of an unreachable NFS system)\n"), out);
 	fputs(_(" -i, --internal-only     don't call the umount.<type> helpers\n"), out);
+	fputs(_(" -j, --jobs <num>        unmount up to <num> filesystems at once (use with -R)\n"), out);
 	fputs(_(" -n, --no-mtab           don't write to /etc/mtab\n"), out);
 	fputs(_(" -l, --lazy              detach the filesystem now, clean up things later\n"), out);
 	fputs(_(" -O, --test-opts <list>  limit the set of filesystems (use with -a)\n"), out);
@@ -314,6 +319,289 @@ static int umount_recursive(struct libmnt_context *cxt, const char *spec)
 	return rc;
 }
 
+/*
+ * umount --recursive --jobs <num>
+ *
+ * The mount tree is read from mountinfo only once. The filesystems are
+ * unmounted bottom-up, level by level: the level of a filesystem is the
+ * height of its subtree (leaves are level 0), so all submounts are always
+ * unmounted before their parent. The filesystems on the same level are
+ * unmounted by up to <num> processes in parallel.
+ */
+struct umount_node {
+	struct libmnt_fs *fs;
+	int id;
+	int parent;		/* index of the parent node or -1 */
+	size_t first;		/* first child in the umount_tree.children */
+	size_t nchildren;
+	size_t level;
+};
+
+struct umount_tree {
+	struct umount_node *nodes;
+	size_t nnodes;
+	size_t *children;	/* children indexes ordered by parent */
+	size_t *order;		/* subtree of the target, parents first */
+	size_t norder;
+	size_t nlevels;
+};
+
+static int cmp_umount_nodes(const void *a, const void *b)
+{
+	const struct umount_node *na = a, *nb = b;
+
+	return na->id < nb->id ? -1 : na->id > nb->id;
+}
+
+static int find_umount_node(struct umount_tree *tree, int id)
+{
+	size_t lo = 0, hi = tree->nnodes;
+
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+
+		if (tree->nodes[mid].id == id)
+			return mid;
+		if (tree->nodes[mid].id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+/* builds the tree from the mount-ID parent links, @root is subtree to unmount */
+static void umount_tree_init(struct umount_tree *tree, struct libmnt_table *tb,
+			     struct libmnt_fs *root)
+{
+	struct libmnt_iter *itr;
+	struct libmnt_fs *fs;
+	size_t i, *pos, head;
+	int r;
+
+	memset(tree, 0, sizeof(*tree));
+
+	itr = mnt_new_iter(MNT_ITER_FORWARD);
+	if (!itr)
+		err(MNT_EX_SYSERR, _("libmount iterator allocation failed"));
+
+	tree->nodes = xcalloc(mnt_table_get_nents(tb) + 1, sizeof(struct umount_node));
+	while (mnt_table_next_fs(tb, itr, &fs) == 0) {
+		struct umount_node *nd = &tree->nodes[tree->nnodes++];
+
+		nd->fs = fs;
+		nd->id = mnt_fs_get_id(fs);
+	}
+	mnt_free_iter(itr);
+
+	qsort(tree->nodes, tree->nnodes, sizeof(struct umount_node), cmp_umount_nodes);
+
+	/* count children */
+	for (i = 0; i < tree->nnodes; i++) {
+		struct umount_node *nd = &tree->nodes[i];
+		int pid = mnt_fs_get_parent_id(nd->fs);
+
+		nd->parent = pid == nd->id ? -1 : find_umount_node(tree, pid);
+		if (nd->parent >= 0)
+			tree->nodes[nd->parent].nchildren++;
+	}
+
+	/* index children */
+	tree->children = xcalloc(tree->nnodes + 1, sizeof(size_t));
+	pos = xcalloc(tree->nnodes + 1, sizeof(size_t));
+	for (i = 0, head = 0; i < tree->nnodes; i++) {
+		tree->nodes[i].first = head;
+		pos[i] = head;
+		head += tree->nodes[i].nchildren;
+	}
+	for (i = 0; i < tree->nnodes; i++) {
+		int p = tree->nodes[i].parent;
+
+		if (p >= 0)
+			tree->children[pos[p]++] = i;
+	}
+	free(pos);
+
+	/* breadth-first walk of the @root subtree */
+	tree->order = xcalloc(tree->nnodes + 1, sizeof(size_t));
+	r = find_umount_node(tree, mnt_fs_get_id(root));
+	if (r < 0)
+		return;
+	tree->order[tree->norder++] = r;
+
+	for (head = 0; head < tree->norder; head++) {
+		struct umount_node *nd = &tree->nodes[tree->order[head]];
+
+		for (i = 0; i < nd->nchildren; i++)
+			tree->order[tree->norder++] = tree->children[nd->first + i];
+	}
+
+	/* levels, children are always after parents in the walk */
+	for (i = tree->norder; i > 0; i--) {
+		struct umount_node *nd = &tree->nodes[tree->order[i - 1]];
+
+		if (i > 1 && nd->level + 1 > tree->nodes[nd->parent].level)
+			tree->nodes[nd->parent].level = nd->level + 1;
+		if (nd->level + 1 > tree->nlevels)
+			tree->nlevels = nd->level + 1;
+	}
+}
+
+static void umount_tree_deinit(struct umount_tree *tree)
+{
+	free(tree->nodes);
+	free(tree->children);
+	free(tree->order);
+}
+
+/*
+ * Unmounts @fs from the mountinfo snapshot, returns 0 on success. The
+ * filesystem which is not mounted anymore (e.g. unmounted by umount
+ * propagation) is not an error.
+ */
+static int umount_tree_fs(struct libmnt_context *cxt, struct libmnt_fs *fs)
+{
+	int rc;
+
+	mnt_reset_context(cxt);
+	mnt_context_disable_swapmatch(cxt, 1);
+
+	/* libmount has to search in mountinfo for --lazy and --force, the
+	 * paths from mountinfo are canonical, so let's filter out the other
+	 * entries rather than parse whole mountinfo again */
+	if (mnt_context_is_lazy(cxt) || mnt_context_is_force(cxt))
+		mnt_context_disable_canonicalize(cxt, TRUE);
+
+	if (mnt_context_set_target(cxt, mnt_fs_get_target(fs))
+	    || mnt_context_set_fstype(cxt, mnt_fs_get_fstype(fs)))
+		err(MNT_EX_SYSERR, _("failed to set umount target"));
+
+	rc = mnt_context_umount(cxt);
+	if (rc && mnt_context_syscall_called(cxt)
+	    && mnt_context_get_syscall_errno(cxt) == EINVAL)
+		return 0;
+
+	rc = mk_exit_code(cxt, rc);
+	if (rc == MNT_EX_SUCCESS && mnt_context_is_verbose(cxt))
+		success_message(cxt);
+	return rc == MNT_EX_SUCCESS ? 0 : 1;
+}
+
+/* unmounts every @njobs-th filesystem of @level starting at @first */
+static size_t umount_tree_part(struct libmnt_context *cxt, struct umount_tree *tree,
+			       size_t level, size_t first, size_t njobs)
+{
+	size_t i, n = 0, nerrs = 0;
+
+	for (i = 0; i < tree->norder; i++) {
+		struct umount_node *nd = &tree->nodes[tree->order[i]];
+
+		if (nd->level != level)
+			continue;
+		if (n++ % njobs != first)
+			continue;
+		if (umount_tree_fs(cxt, nd->fs))
+			nerrs++;
+	}
+	return nerrs;
+}
+
+static int umount_recursive_parallel(struct libmnt_context *cxt,
+				     const char *spec, size_t njobs)
+{
+	struct libmnt_table *tb;
+	struct libmnt_fs *fs;
+	struct umount_tree tree;
+	struct timeval start, lstart, end;
+	size_t level, i, nerrs = 0, ndone = 0;
+	int verbose = mnt_context_is_verbose(cxt);
+
+	gettime_monotonic(&start);
+
+	tb = new_mountinfo(cxt);
+	if (!tb)
+		return MNT_EX_SOFTWARE;
+
+	fs = mnt_table_find_target(tb, spec, MNT_ITER_BACKWARD);
+	if (!fs) {
+		warnx(access(spec, F_OK) == 0 ?
+				_("%s: not mounted") :
+				_("%s: not found"), spec);
+		mnt_unref_table(tb);
+		return MNT_EX_USAGE;
+	}
+
+	umount_tree_init(&tree, tb, fs);
+
+	for (level = 0; level < tree.nlevels && !nerrs; level++) {
+		size_t n = 0, errs = 0;
+
+		for (i = 0; i < tree.norder; i++) {
+			if (tree.nodes[tree.order[i]].level == level)
+				n++;
+		}
+
+		gettime_monotonic(&lstart);
+		fflush(stdout);
+		fflush(stderr);
+
+		if (njobs == 1 || n == 1)
+			errs = umount_tree_part(cxt, &tree, level, 0, 1);
+		else {
+			size_t nprocs = min(njobs, n), running = 0;
+
+			for (i = 0; i < nprocs; i++) {
+				pid_t pid = fork();
+
+				if (pid < 0) {
+					warn(_("fork failed"));
+					errs += umount_tree_part(cxt, &tree,
+							level, i, nprocs);
+					continue;
+				}
+				if (pid == 0) {
+					errs = umount_tree_part(cxt, &tree,
+							level, i, nprocs);
+					fflush(stdout);
+					fflush(stderr);
+					_exit(min(errs, (size_t) 255));
+				}
+				running++;
+			}
+			while (running) {
+				int status;
+
+				if (wait(&status) < 0)
+					err(MNT_EX_SYSERR, _("waitpid failed"));
+				running--;
+				errs += WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+			}
+		}
+
+		gettime_monotonic(&end);
+		if (verbose)
+			printf(_("%s: level %zu: %zu unmounted, %zu failed in %.3f seconds\n"),
+				spec, level, n - min(errs, n), min(errs, n),
+				(end.tv_sec - lstart.tv_sec) +
+				(end.tv_usec - lstart.tv_usec) / 1000000.0);
+		ndone += n - min(errs, n);
+		nerrs += errs;
+	}
+
+	gettime_monotonic(&end);
+	if (verbose)
+		printf(_("%s: %zu of %zu filesystems unmounted in %.3f seconds\n"),
+			spec, ndone, tree.norder,
+			(end.tv_sec - start.tv_sec) +
+			(end.tv_usec - start.tv_usec) / 1000000.0);
+
+	umount_tree_deinit(&tree);
+	mnt_unref_table(tb);
+	mnt_reset_context(cxt);
+
+	return nerrs ? MNT_EX_FAIL : MNT_EX_SUCCESS;
+}
+
 static int umount_alltargets(struct libmnt_context *cxt, const char *spec, int rec)
 {
 	struct libmnt_fs *fs;
@@ -400,6 +688,7 @@ static char *sanitize_path(const char *path)
 int main(int argc, char **argv)
 {
 	int c, rc = 0, all = 0, recursive = 0, alltargets = 0;
+	size_t njobs = 0;
 	struct libmnt_context *cxt;
 	char *types = NULL;
 
@@ -415,6 +704,7 @@ int main(int argc, char **argv)
 		{ "force",           no_argument,       NULL, 'f'             },
 		{ "help",            no_argument,       NULL, 'h'             },
 		{ "internal-only",   no_argument,       NULL, 'i'             },
+		{ "jobs",            required_argument, NULL, 'j'             },
 		{ "lazy",            no_argument,       NULL, 'l'             },
 		{ "no-canonicalize", no_argument,       NULL, 'c'             },
 		{ "no-mtab",         no_argument,       NULL, 'n'             },
@@ -449,7 +739,7 @@ int main(int argc, char **argv)
 
 	mnt_context_set_tables_errcb(cxt, table_parser_errcb);
 
-	while ((c = getopt_long(argc, argv, "aAcdfhilnRrO:t:vV",
+	while ((c = getopt_long(argc, argv, "aAcdfhij:lnRrO:t:vV",
 					longopts, NULL)) != -1) {
 
 
@@ -484,6 +774,11 @@ int main(int argc, char **argv)
 		case 'i':
 			mnt_context_disable_helpers(cxt, TRUE);
 			break;
+		case 'j':
+			njobs = strtou32_or_err(optarg, _("invalid jobs argument"));
+			if (!njobs)
+				errx(MNT_EX_USAGE, _("invalid jobs argument"));
+			break;
 		case 'l':
 			mnt_context_enable_lazy(cxt, TRUE);
 			break;
@@ -517,6 +812,15 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
+	if (njobs && alltargets) {
+		warnx(_("--jobs cannot be used with --all-targets"));
+		errtryhelp(MNT_EX_USAGE);
+	}
+	if (njobs && !recursive) {
+		warnx(_("--jobs requires --recursive"));
+		errtryhelp(MNT_EX_USAGE);
+	}
+
 	if (all) {
 		if (!types)
 			types = "noproc,nodevfs,nodevpts,nosysfs,norpc_pipefs,nonfsd,noselinuxfs";
@@ -531,6 +835,9 @@ int main(int argc, char **argv)
 	} else if (alltargets) {
 		while (argc--)
 			rc += umount_alltargets(cxt, *argv++, recursive);
+	} else if (recursive && njobs) {
+		while (argc--)
+			rc += umount_recursive_parallel(cxt, *argv++, njobs);
 	} else if (recursive) {
 		while (argc--)
 			rc += umount_recursive(cxt, *argv++);
@@ -46,6 +46,7 @@ TS_CMD_ADDPART=${TS_CMD_ADDPART:-"$top_builddir/addpart"}
 TS_CMD_DELPART=${TS_CMD_DELPART:-"$top_builddir/delpart"}
 TS_CMD_BLKDISCARD=${TS_CMD_BLKID-"$top_builddir/blkdiscard"}
 TS_CMD_BLKID=${TS_CMD_BLKID-"$top_builddir/blkid"}
+TS_CMD_BLKZONE=${TS_CMD_BLKZONE-"$top_builddir/blkzone"}
 TS_CMD_CAL=${TS_CMD_CAL-"$top_builddir/cal"}
 TS_CMD_COLCRT=${TS_CMD_COLCRT:-"$top_builddir/colcrt"}
 TS_CMD_COLRM=${TS_CMD_COLRM:-"$top_builddir/colrm"}
@@ -34,6 +34,8 @@
  */
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <ctype.h>
 #include <stdio.h>
@@ -42,6 +44,7 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <fcntl.h>
 
 #include "nls.h"
 #include "c.h"
@@ -58,6 +61,9 @@
 
 #define TABCHAR_CELLS         8
 
+/* default number of lines used to count column widths for --table-stream */
+#define STREAM_SAMPLE_LINES   1000
+
 enum {
 	COLUMN_MODE_FILLCOLS = 0,
 	COLUMN_MODE_FILLROWS,
@@ -93,13 +99,40 @@ struct column_control {
 	size_t	nents;		/* number of entries */
 	size_t	maxlength;	/* longest input record (line) */
 
+	struct column_field *fields;	/* fields of the current line */
+	size_t	nfields;
+	size_t	maxfields;
+	char	*linebuf;	/* copy of the current line for wide-char conversion */
+	size_t	linebufsz;
+
+	size_t	*widths;	/* --table-stream and --table-two-pass column widths */
+	size_t	nwidths;
+	size_t	*fixed_widths;	/* --table-widths, zero means count from data */
+	size_t	nfixed_widths;
+
+	int	*colflags;	/* SCOLS_FL_* of the columns */
+
+	char	**sample;	/* --table-stream lines used to count widths */
+	size_t	nsample;
+	size_t	stream_lines;	/* --table-stream=<lines> */
+
 	unsigned int greedy :1,
 		     json :1,
 		     header_repeat :1,
 		     input_sep_space : 1,	/* input separator contains space chars */
+		     input_sep_ascii : 1,	/* input separator contains ASCII chars only */
+		     stream : 1,		/* --table-stream */
+		     stream_ready : 1,		/* widths known, print lines on the fly */
+		     twopass : 1,		/* --table-two-pass */
 		     tab_noheadings :1;
 };
 
+struct column_field {
+	const char	*data;
+	size_t		len;
+	char		*alloc;		/* allocated by the wide-char path */
+};
+
 static size_t width(const wchar_t *str)
 {
 	size_t width = 0;
@@ -189,6 +222,153 @@ static wchar_t *local_wcstok(wchar_t *p, const wchar_t *separator, int greedy, w
 	return result;
 }
 
+/* convert line to wide chars, broken sequences are encoded to \x<hex> */
+static wchar_t *line_to_wcs(const char *str)
+{
+	wchar_t *wcs = mbs_to_wcs(str);
+
+	if (!wcs) {
+		size_t tmpsz = 0;
+		char *tmp = mbs_invalid_encode(str, &tmpsz);
+
+		if (!tmp)
+			err(EXIT_FAILURE, _("read failed"));
+		wcs = mbs_to_wcs(tmp);
+		free(tmp);
+	}
+	return wcs;
+}
+
+static int is_ascii(const char *str, size_t len)
+{
+	const char *end = str + len;
+
+	for (; str < end; str++) {
+		if (*str & 0x80)
+			return 0;
+	}
+	return 1;
+}
+
+/* ASCII fast path for line_to_wcs() and width() */
+static wchar_t *ascii_to_wcs(const char *str, size_t len, size_t *wd)
+{
+	wchar_t *wcs = xmalloc((len + 1) * sizeof(wchar_t));
+	size_t i;
+
+	*wd = 0;
+	for (i = 0; i < len; i++) {
+		wcs[i] = (unsigned char) str[i];
+		if (isprint((unsigned char) str[i]))
+			(*wd)++;
+	}
+	wcs[len] = '\0';
+	return wcs;
+}
+
+static inline int is_input_separator(struct column_control *ctl, char c)
+{
+	return c && strchr(ctl->input_separator_raw, c);
+}
+
+static void reset_fields(struct column_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->nfields; i++)
+		free(ctl->fields[i].alloc);
+	ctl->nfields = 0;
+}
+
+static struct column_field *add_field(struct column_control *ctl,
+				      const char *data, size_t len)
+{
+	struct column_field *fl;
+
+	if (ctl->nfields == ctl->maxfields) {
+		ctl->maxfields += 32;
+		ctl->fields = xrealloc(ctl->fields,
+				ctl->maxfields * sizeof(struct column_field));
+	}
+	fl = &ctl->fields[ctl->nfields++];
+	fl->data = data;
+	fl->len = len;
+	fl->alloc = NULL;
+	return fl;
+}
+
+/*
+ * Split the line to ctl->fields. The @str does not have to be terminated
+ * and it is not modified. ASCII lines are split in place, other lines are
+ * converted to wide chars and tokenized by local_wcstok().
+ */
+static size_t split_line(struct column_control *ctl, const char *str, size_t len)
+{
+	reset_fields(ctl);
+
+	if (ctl->input_sep_ascii && is_ascii(str, len)) {
+		const char *p = str, *end = str + len, *tok;
+
+		if (ctl->greedy) {
+			/* the same as wcstok() */
+			while (p < end) {
+				while (p < end && is_input_separator(ctl, *p))
+					p++;
+				if (p == end)
+					break;
+				tok = p;
+				while (p < end && !is_input_separator(ctl, *p))
+					p++;
+				add_field(ctl, tok, p - tok);
+			}
+		} else {
+			/* the same as local_wcstok(), the last empty field is ignored */
+			do {
+				tok = p;
+				while (p < end && !is_input_separator(ctl, *p))
+					p++;
+				add_field(ctl, tok, p - tok);
+			} while (p < end && ++p < end);
+		}
+	} else {
+		wchar_t *wcs, *wcdata, *sv = NULL, *p;
+
+		if (ctl->linebufsz < len + 1) {
+			ctl->linebufsz = len + 1;
+			ctl->linebuf = xrealloc(ctl->linebuf, ctl->linebufsz);
+		}
+		memcpy(ctl->linebuf, str, len);
+		ctl->linebuf[len] = '\0';
+
+		p = wcs = line_to_wcs(ctl->linebuf);
+		while ((wcdata = local_wcstok(p, ctl->input_separator, ctl->greedy, &sv))) {
+			char *data = wcs_to_mbs(wcdata);
+
+			if (!data)
+				err(EXIT_FAILURE, _("failed to allocate output data"));
+			add_field(ctl, data, strlen(data))->alloc = data;
+			p = NULL;
+		}
+		free(wcs);
+	}
+
+	return ctl->nfields;
+}
+
+/* returns number of cells, the same as mbs_safe_nwidth() */
+static size_t field_width(const struct column_field *fl)
+{
+	size_t i;
+
+	for (i = 0; i < fl->len; i++) {
+		unsigned char c = fl->data[i];
+
+		if (c < 0x20 || c > 0x7e || c == '\\')
+			return mbs_safe_nwidth(fl->data, fl->len, NULL);
+	}
+	return fl->len;
+}
+
 static char **split_or_error(const char *str, const char *errmsg)
 {
 	char **res = strv_split(str, ",");
@@ -427,16 +607,18 @@ static void modify_table(struct column_control *ctl)
 }
 
 
-static int add_line_to_table(struct column_control *ctl, wchar_t *wcs)
+static int add_line_to_table(struct column_control *ctl, const char *str, size_t len)
 {
-	wchar_t *wcdata, *sv = NULL;
-	size_t n = 0;
+	size_t n, nfields;
 	struct libscols_line *ln = NULL;
 
 	if (!ctl->tab)
 		init_table(ctl);
 
-	while ((wcdata = local_wcstok(wcs, ctl->input_separator, ctl->greedy, &sv))) {
+	nfields = split_line(ctl, str, len);
+
+	for (n = 0; n < nfields; n++) {
+		struct column_field *fl = &ctl->fields[n];
 		char *data;
 
 		if (scols_table_get_ncols(ctl->tab) < n + 1) {
@@ -453,40 +635,234 @@ static int add_line_to_table(struct column_control *ctl, wchar_t *wcs)
 				err(EXIT_FAILURE, _("failed to allocate output line"));
 		}
 
-		data = wcs_to_mbs(wcdata);
-		if (!data)
-			err(EXIT_FAILURE, _("failed to allocate output data"));
+		if (fl->alloc) {
+			data = fl->alloc;
+			fl->alloc = NULL;
+		} else
+			data = xstrndup(fl->data, fl->len);
 		if (scols_line_refer_data(ln, n, data))
 			err(EXIT_FAILURE, _("failed to add output data"));
-		n++;
-		wcs = NULL;
 	}
 
 	return 0;
 }
 
-static int read_input(struct column_control *ctl, FILE *fp)
+/*
+ * --table-stream and --table-two-pass
+ *
+ * The table is not stored in memory, the lines are printed on the fly with
+ * column widths counted from a sample of the input lines (stream) or from
+ * all the input (two-pass). The libsmartcols table is used for column names
+ * and flags only.
+ */
+static void count_widths(struct column_control *ctl)
 {
-	char *buf = NULL;
-	size_t bufsz = 0;
-	size_t maxents = 0;
-	int rc = 0, is_space_sep = 0;
+	size_t i;
+
+	if (ctl->nfields > ctl->nwidths) {
+		ctl->widths = xrealloc(ctl->widths, ctl->nfields * sizeof(size_t));
+		for (i = ctl->nwidths; i < ctl->nfields; i++)
+			ctl->widths[i] = i < ctl->nfixed_widths ?
+						ctl->fixed_widths[i] : 0;
+		ctl->nwidths = ctl->nfields;
+	}
 
-	/* Check if columns separator contains spaces chars */
-	if (ctl->mode == COLUMN_MODE_TABLE && ctl->input_separator_raw) {
-		char *p;
+	for (i = 0; i < ctl->nfields; i++) {
+		size_t len;
 
-		for (p = ctl->input_separator_raw; *p; p++) {
-			if (isspace(*p)) {
-				is_space_sep = 1;
+		if (i < ctl->nfixed_widths && ctl->fixed_widths[i])
+			continue;
+		len = field_width(&ctl->fields[i]);
+		if (len > ctl->widths[i])
+			ctl->widths[i] = len;
+	}
+}
+
+static int get_column_flags(struct column_control *ctl, size_t n)
+{
+	struct libscols_column *cl;
+
+	if (n >= scols_table_get_ncols(ctl->tab))
+		return 0;
+	cl = scols_table_get_column(ctl->tab, n);
+	return cl ? scols_column_get_flags(cl) : 0;
+}
+
+static void print_fields(struct column_control *ctl)
+{
+	size_t i, last, ncols = max(ctl->nwidths, ctl->nfields);
+	int *flags = ctl->colflags;
+
+	/* the last visible column is not padded */
+	for (last = ncols; last > 0; last--) {
+		if (last > ctl->nwidths || !(flags[last - 1] & SCOLS_FL_HIDDEN))
+			break;
+	}
+
+	for (i = 0; i < last; i++) {
+		struct column_field *fl = i < ctl->nfields ? &ctl->fields[i] : NULL;
+		size_t len = fl ? field_width(fl) : 0;
+		size_t width = len;
+		int right = 0;
+
+		if (i < ctl->nwidths) {
+			if (flags[i] & SCOLS_FL_HIDDEN)
+				continue;
+			right = flags[i] & SCOLS_FL_RIGHT;
+			width = max(ctl->widths[i], len);
+		}
+		if (i + 1 == last && !right)
+			width = len;
+
+		if (right)
+			for (; len < width; len++)
+				fputc(' ', stdout);
+		if (fl)
+			fwrite(fl->data, 1, fl->len, stdout);
+		for (; len < width; len++)
+			fputc(' ', stdout);
+		if (i + 1 < last)
+			fputs(ctl->output_separator, stdout);
+	}
+	fputc('\n', stdout);
+}
+
+/* called when the widths are counted, prints header */
+static void prepare_stream(struct column_control *ctl)
+{
+	size_t i, ncols;
+
+	if (!ctl->tab)
+		init_table(ctl);
+
+	for (i = scols_table_get_ncols(ctl->tab); i < ctl->nwidths; i++)
+		scols_table_new_column(ctl->tab, NULL, 0, 0);
+
+	ncols = scols_table_get_ncols(ctl->tab);
+	if (ncols > ctl->nwidths) {
+		reset_fields(ctl);
+		for (i = 0; i < ncols; i++)
+			add_field(ctl, "", 0);
+		count_widths(ctl);
+	}
+
+	/* see count_column_width() in libsmartcols */
+	for (i = 0; i < ncols; i++) {
+		struct libscols_column *cl = scols_table_get_column(ctl->tab, i);
+		const char *name = scols_cell_get_data(scols_column_get_header(cl));
+
+		if (i < ctl->nfixed_widths && ctl->fixed_widths[i])
+			continue;
+		if (name)
+			ctl->widths[i] = max(ctl->widths[i], mbs_safe_width(name));
+		if (!ctl->widths[i])
+			ctl->widths[i] = 1;
+	}
+
+	modify_table(ctl);
+
+	ctl->colflags = xcalloc(ncols, sizeof(int));
+	for (i = 0; i < ncols; i++)
+		ctl->colflags[i] = get_column_flags(ctl, i);
+
+	if (ctl->tab_colnames && !ctl->tab_noheadings) {
+		reset_fields(ctl);
+		for (i = 0; i < ncols; i++) {
+			struct libscols_column *cl = scols_table_get_column(ctl->tab, i);
+			const char *name = scols_cell_get_data(scols_column_get_header(cl));
+
+			add_field(ctl, name ? : "", name ? strlen(name) : 0);
+		}
+		print_fields(ctl);
+	}
+	ctl->stream_ready = 1;
+}
+
+/* count widths from the sampled lines and print them */
+static void flush_stream(struct column_control *ctl)
+{
+	size_t i;
+
+	for (i = 0; i < ctl->nsample; i++) {
+		split_line(ctl, ctl->sample[i], strlen(ctl->sample[i]));
+		count_widths(ctl);
+	}
+
+	prepare_stream(ctl);
+
+	for (i = 0; i < ctl->nsample; i++) {
+		split_line(ctl, ctl->sample[i], strlen(ctl->sample[i]));
+		print_fields(ctl);
+		free(ctl->sample[i]);
+	}
+	free(ctl->sample);
+	ctl->sample = NULL;
+	ctl->nsample = 0;
+}
+
+static int add_line_to_stream(struct column_control *ctl, const char *str, size_t len)
+{
+	if (!ctl->stream_ready && ctl->nsample >= ctl->stream_lines)
+		flush_stream(ctl);
+
+	if (ctl->stream_ready) {
+		split_line(ctl, str, len);
+		print_fields(ctl);
+		return 0;
+	}
+
+	if (!ctl->sample)
+		ctl->sample = xcalloc(ctl->stream_lines, sizeof(char *));
+	ctl->sample[ctl->nsample++] = xstrndup(str, len);
+	return 0;
+}
+
+/*
+ * Returns the begin of the line data and updates @len. The leading white
+ * spaces and the trailing newline are ignored. The @buf does not have to be
+ * terminated.
+ */
+static const char *line_data(struct column_control *ctl, const char *buf, size_t *len)
+{
+	const char *str = buf, *end = buf + *len;
+
+	while (str < end && isspace((unsigned char) *str))
+		str++;
+
+	/* The table columns separator could be a space. In this case
+	 * don't skip the separator if at begin of the line. For example:
+	 *
+	 * echo -e "\tcol1\tcol2\nrow\t1\t2" \
+	 *	| column -t -s "$(echo -e '\t')" --table-columns A,B,C
+	 */
+	if (ctl->input_sep_space && str > buf) {
+		const char *x;
+
+		for (x = buf; x < str; x++) {
+			if (is_input_separator(ctl, *x)) {
+				str = x;
 				break;
 			}
 		}
 	}
 
+	if (end > str && *(end - 1) == '\n')
+		end--;
+
+	*len = end - str;
+	return str;
+}
+
+static int read_input(struct column_control *ctl, FILE *fp)
+{
+	char *buf = NULL;
+	size_t bufsz = 0;
+	size_t maxents = 0;
+	int rc = 0;
+
 	/* Read input */
 	do {
-		char *str, *p;
+		const char *str;
 		wchar_t *wcs = NULL;
 		size_t len;
 
@@ -495,46 +871,17 @@ static int read_input(struct column_control *ctl, FILE *fp)
 				break;
 			err(EXIT_FAILURE, _("read failed"));
 		}
-		str = (char *) skip_space(buf);
-
-		/* The table columns separator could be a space. In this case
-		 * don't skip the separator if at begin of the line. For example:
-		 *
-		 * echo -e "\tcol1\tcol2\nrow\t1\t2" \
-		 *	| column -t -s "$(echo -e '\t')" --table-columns A,B,C
-		 */
-		if (is_space_sep && str > buf) {
-			char *x = strpbrk(buf, ctl->input_separator_raw);
-			if (x && x < str)
-				str = x;
-		}
-
-		if (str) {
-			p = strchr(str, '\n');
-			if (p)
-				*p = '\0';
-		}
-		if (!str || !*str)
+		len = strlen(buf);
+		str = line_data(ctl, buf, &len);
+		if (!len)
 			continue;
 
-		wcs = mbs_to_wcs(str);
-		if (!wcs) {
-			/*
-			 * Convert broken sequences to \x<hex> and continue.
-			 */
-			size_t tmpsz = 0;
-			char *tmp = mbs_invalid_encode(str, &tmpsz);
-
-			if (!tmp)
-				err(EXIT_FAILURE, _("read failed"));
-			wcs = mbs_to_wcs(tmp);
-			free(tmp);
-		}
-
 		switch (ctl->mode) {
 		case COLUMN_MODE_TABLE:
-			rc = add_line_to_table(ctl, wcs);
-			free(wcs);
+			if (ctl->stream)
+				rc = add_line_to_stream(ctl, str, len);
+			else
+				rc = add_line_to_table(ctl, str, len);
 			break;
 
 		case COLUMN_MODE_FILLCOLS:
@@ -544,8 +891,14 @@ static int read_input(struct column_control *ctl, FILE *fp)
 				ctl->ents = xrealloc(ctl->ents,
 						maxents * sizeof(wchar_t *));
 			}
+			if (is_ascii(str, len))
+				wcs = ascii_to_wcs(str, len, &len);
+			else {
+				buf[(str - buf) + len] = '\0';
+				wcs = line_to_wcs(str);
+				len = width(wcs);
+			}
 			ctl->ents[ctl->nents] = wcs;
-			len = width(ctl->ents[ctl->nents]);
 			if (ctl->maxlength < len)
 				ctl->maxlength = len;
 			ctl->nents++;
@@ -553,9 +906,124 @@ static int read_input(struct column_control *ctl, FILE *fp)
 		}
 	} while (rc == 0);
 
+	free(buf);
 	return rc;
 }
 
+/*
+ * --table-two-pass: the input files are mapped to memory, the first pass
+ * counts column widths and the second pass prints the lines.
+ */
+struct column_input {
+	const char	*name;
+	char		*data;
+	size_t		size;
+};
+
+static int map_input(struct column_input *in, int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) != 0) {
+		warn(_("stat of %s failed"), in->name);
+		return -errno;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		warnx(_("%s: --table-two-pass requires a regular file"), in->name);
+		return -EINVAL;
+	}
+	if (!st.st_size)
+		return 0;
+
+	in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (in->data == MAP_FAILED) {
+		in->data = NULL;
+		warn(_("%s: mmap failed"), in->name);
+		return -errno;
+	}
+	in->size = st.st_size;
+	madvise(in->data, in->size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+static size_t scan_input(struct column_control *ctl, struct column_input *in, int print)
+{
+	const char *p = in->data, *end = in->data + in->size;
+	size_t nlines = 0;
+
+	while (p < end) {
+		const char *nl = memchr(p, '\n', end - p);
+		const char *next = nl ? nl + 1 : end;
+		size_t len = next - p;
+		const char *str = line_data(ctl, p, &len);
+
+		p = next;
+		if (!len)
+			continue;
+
+		split_line(ctl, str, len);
+		if (print)
+			print_fields(ctl);
+		else
+			count_widths(ctl);
+		nlines++;
+	}
+	return nlines;
+}
+
+static int read_twopass(struct column_control *ctl, char **files)
+{
+	struct column_input *ins;
+	size_t i, nins = 0, nlines = 0;
+	int rc = 0;
+
+	for (i = 0; files[i]; i++)
+		nins++;
+
+	ins = xcalloc(max(nins, (size_t) 1), sizeof(struct column_input));
+
+	if (!nins) {
+		ins[0].name = "stdin";
+		if (map_input(&ins[0], STDIN_FILENO) != 0)
+			rc++;
+		nins = 1;
+	} else {
+		for (i = 0; i < nins; i++) {
+			int fd;
+
+			ins[i].name = files[i];
+			fd = open(files[i], O_RDONLY | O_CLOEXEC);
+			if (fd < 0) {
+				warn("%s", files[i]);
+				rc++;
+				continue;
+			}
+			if (map_input(&ins[i], fd) != 0)
+				rc++;
+			close(fd);
+		}
+	}
+
+	for (i = 0; i < nins; i++) {
+		if (ins[i].data)
+			nlines += scan_input(ctl, &ins[i], 0);
+	}
+
+	if (nlines) {
+		prepare_stream(ctl);
+		for (i = 0; i < nins; i++) {
+			if (ins[i].data)
+				scan_input(ctl, &ins[i], 1);
+		}
+	}
+
+	for (i = 0; i < nins; i++) {
+		if (ins[i].data)
+			munmap(ins[i].data, ins[i].size);
+	}
+	free(ins);
+	return rc;
+}
 
 static void columnate_fillrows(struct column_control *ctl)
 {
@@ -649,6 +1117,9 @@ static void __attribute__((__noreturn__)) usage(void)
 	fputs(_(" -T, --table-truncate <columns>   truncate text in the columns when necessary\n"), out);
 	fputs(_(" -W, --table-wrap <columns>       wrap text in the columns when necessary\n"), out);
 	fputs(_(" -J, --json                       use JSON output format for table\n"), out);
+	fputs(_("     --table-stream[=<lines>]     print the table on the fly, count widths from the first lines\n"), out);
+	fputs(_("     --table-two-pass             count widths in the first pass over the files, print in the second\n"), out);
+	fputs(_("     --table-widths <list>        comma separated column widths for the streamed table\n"), out);
 
 	fputs(USAGE_SEPARATOR, out);
 	fputs(_(" -r, --tree <column>              column to use tree-like output for the table\n"), out);
@@ -679,6 +1150,13 @@ int main(int argc, char **argv)
 
 	int c;
 	unsigned int eval = 0;		/* exit value */
+	char *p;
+
+	enum {
+		OPT_STREAM = CHAR_MAX + 1,
+		OPT_TWOPASS,
+		OPT_WIDTHS
+	};
 
 	static const struct option longopts[] =
 	{
@@ -700,6 +1178,9 @@ int main(int argc, char **argv)
 		{ "table-truncate",      required_argument, NULL, 'T' },
 		{ "table-wrap",          required_argument, NULL, 'W' },
 		{ "table-header-repeat", no_argument,       NULL, 'e' },
+		{ "table-stream",        optional_argument, NULL, OPT_STREAM },
+		{ "table-two-pass",      no_argument,       NULL, OPT_TWOPASS },
+		{ "table-widths",        required_argument, NULL, OPT_WIDTHS },
 		{ "tree",                required_argument, NULL, 'r' },
 		{ "tree-id",             required_argument, NULL, 'i' },
 		{ "tree-parent",         required_argument, NULL, 'p' },
@@ -709,6 +1190,7 @@ int main(int argc, char **argv)
 	static const ul_excl_t excl[] = {       /* rows and cols in ASCII order */
 		{ 'J','x' },
 		{ 't','x' },
+		{ 'x', OPT_STREAM, OPT_TWOPASS },
 		{ 0 }
 	};
 	int excl_st[ARRAY_SIZE(excl)] = UL_EXCL_STATUS_INIT;
@@ -795,6 +1277,31 @@ int main(int argc, char **argv)
 		case 'x':
 			ctl.mode = COLUMN_MODE_FILLROWS;
 			break;
+		case OPT_STREAM:
+			ctl.stream = 1;
+			ctl.stream_lines = optarg ?
+				strtou32_or_err(optarg, _("invalid --table-stream argument")) :
+				STREAM_SAMPLE_LINES;
+			ctl.mode = COLUMN_MODE_TABLE;
+			break;
+		case OPT_TWOPASS:
+			ctl.twopass = 1;
+			ctl.mode = COLUMN_MODE_TABLE;
+			break;
+		case OPT_WIDTHS:
+		{
+			char **all = split_or_error(optarg, _("failed to parse --table-widths list"));
+			char **one;
+
+			ctl.nfixed_widths = strv_length(all);
+			ctl.fixed_widths = xcalloc(ctl.nfixed_widths, sizeof(size_t));
+			c = 0;
+			STRV_FOREACH(one, all)
+				ctl.fixed_widths[c++] = strtou32_or_err(*one,
+						_("invalid --table-widths argument"));
+			strv_free(all);
+			break;
+		}
 		default:
 			errtryhelp(EXIT_FAILURE);
 		}
@@ -821,7 +1328,34 @@ int main(int argc, char **argv)
 	if (ctl.tab_colnames == NULL && ctl.json)
 		errx(EXIT_FAILURE, _("option --table-columns required for --json"));
 
-	if (!*argv)
+	if ((ctl.stream || ctl.twopass)
+	    && (ctl.json || ctl.tree || ctl.tab_order || ctl.tab_colwrap ||
+		ctl.tab_coltrunc || ctl.tab_colnoextrem || ctl.header_repeat))
+		errx(EXIT_FAILURE, _("options --table-stream and --table-two-pass "
+				     "are incompatible with --json, --tree, --table-order, "
+				     "--table-wrap, --table-truncate, --table-noextreme "
+				     "and --table-header-repeat"));
+
+	if (ctl.fixed_widths && !ctl.stream && !ctl.twopass)
+		errx(EXIT_FAILURE, _("option --table-widths requires --table-stream "
+				     "or --table-two-pass"));
+
+	ctl.input_sep_ascii = is_ascii(ctl.input_separator_raw,
+				       strlen(ctl.input_separator_raw));
+
+	/* Check if columns separator contains spaces chars */
+	if (ctl.mode == COLUMN_MODE_TABLE) {
+		for (p = ctl.input_separator_raw; *p; p++) {
+			if (isspace(*p)) {
+				ctl.input_sep_space = 1;
+				break;
+			}
+		}
+	}
+
+	if (ctl.twopass)
+		eval += read_twopass(&ctl, argv);
+	else if (!*argv)
 		eval += read_input(&ctl, stdin);
 	else
 		for (; *argv; ++argv) {
@@ -845,7 +1379,10 @@ int main(int argc, char **argv)
 
 	switch (ctl.mode) {
 	case COLUMN_MODE_TABLE:
-		if (ctl.tab && scols_table_get_nlines(ctl.tab)) {
+		if (ctl.stream || ctl.twopass) {
+			if (ctl.nsample)
+				flush_stream(&ctl);
+		} else if (ctl.tab && scols_table_get_nlines(ctl.tab)) {
 			modify_table(&ctl);
 			eval = scols_print_table(ctl.tab);
 		}
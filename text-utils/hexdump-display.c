@@ -236,57 +236,215 @@ static void bpad(struct hexdump_pr *pr)
 		;
 }
 
-void display(struct hexdump *hex)
+/*
+ * Fast path for the built-in formats. The lines of the full blocks are
+ * composed from lookup tables and written by one fwrite(); the last partial
+ * block is displayed by the generic format interpreter.
+ */
+static const char hexdigits[] = "0123456789abcdef";
+
+static struct {
+	char ascii[256];		/* %_p */
+	char octal[256][3];		/* %03o */
+	char chr[256][3];		/* %3_c */
+} fast_tab;
+
+static void init_fast_tab(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		fast_tab.ascii[i] = isprint(i) ? i : '.';
+
+		fast_tab.octal[i][0] = '0' + ((i >> 6) & 7);
+		fast_tab.octal[i][1] = '0' + ((i >> 3) & 7);
+		fast_tab.octal[i][2] = '0' + (i & 7);
+
+		/* see conv_c() */
+		memset(fast_tab.chr[i], ' ', 3);
+		switch (i) {
+		case '\0':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = '0'; break;
+		case '\007': fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'a'; break;
+		case '\b':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'b'; break;
+		case '\f':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'f'; break;
+		case '\n':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'n'; break;
+		case '\r':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'r'; break;
+		case '\t':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 't'; break;
+		case '\v':   fast_tab.chr[i][1] = '\\'; fast_tab.chr[i][2] = 'v'; break;
+		default:
+			if (isprint(i))
+				fast_tab.chr[i][2] = i;
+			else
+				memcpy(fast_tab.chr[i], fast_tab.octal[i], 3);
+			break;
+		}
+	}
+}
+
+/* like printf("%0*jx", digits, num) */
+static char *put_hex(char *p, uintmax_t num, int digits)
+{
+	char tmp[sizeof(uintmax_t) * 2];
+	int n = 0;
+
+	do {
+		tmp[n++] = hexdigits[num & 0xf];
+		num >>= 4;
+	} while (num);
+
+	for (; digits > n; digits--)
+		*p++ = '0';
+	while (n)
+		*p++ = tmp[--n];
+	return p;
+}
+
+/* like printf("%0*u", digits, num) and printf("%0*o", digits, num) */
+static char *put_num(char *p, unsigned int num, int digits, unsigned int base)
+{
+	int i;
+
+	for (i = digits - 1; i >= 0; i--) {
+		p[i] = '0' + num % base;
+		num /= base;
+	}
+	return p + digits;
+}
+
+static void display_fast(struct hexdump *hex, unsigned char *bp)
+{
+	char line[128], *p = line;
+	uint16_t val;
+	int i;
+
+	if (hex->format == FMT_CANONICAL) {
+		p = put_hex(p, address, 8);
+		*p++ = ' ';
+		for (i = 0; i < 16; i++) {
+			if (i == 8)
+				*p++ = ' ';
+			*p++ = ' ';
+			*p++ = hexdigits[bp[i] >> 4];
+			*p++ = hexdigits[bp[i] & 0xf];
+		}
+		*p++ = ' ';
+		*p++ = ' ';
+		*p++ = '|';
+		for (i = 0; i < 16; i++)
+			*p++ = fast_tab.ascii[bp[i]];
+		*p++ = '|';
+		*p++ = '\n';
+		fwrite(line, 1, p - line, stdout);
+		return;
+	}
+
+	p = put_hex(p, address, 7);
+
+	switch (hex->format) {
+	case FMT_ONE_OCTAL:
+	case FMT_ONE_CHAR:
+		for (i = 0; i < 16; i++) {
+			*p++ = ' ';
+			memcpy(p, hex->format == FMT_ONE_OCTAL ?
+				  fast_tab.octal[bp[i]] : fast_tab.chr[bp[i]], 3);
+			p += 3;
+		}
+		break;
+	default:
+		for (i = 0; i < 16; i += 2) {
+			memcpy(&val, bp + i, sizeof(val));
+
+			switch (hex->format) {
+			case FMT_DEFAULT:
+				*p++ = ' ';
+				p = put_hex(p, val, 4);
+				break;
+			case FMT_TWO_HEX:
+				memcpy(p, "    ", 4);
+				p = put_hex(p + 4, val, 4);
+				break;
+			case FMT_TWO_DECIMAL:
+				memcpy(p, "   ", 3);
+				p = put_num(p + 3, val, 5, 10);
+				break;
+			case FMT_TWO_OCTAL:
+				memcpy(p, "  ", 2);
+				p = put_num(p + 2, val, 6, 8);
+				break;
+			}
+		}
+		break;
+	}
+	*p++ = '\n';
+	fwrite(line, 1, p - line, stdout);
+}
+
+static void display_block(struct hexdump *hex, unsigned char *bp)
 {
 	register struct list_head *fs;
 	register struct hexdump_fs *fss;
 	register struct hexdump_fu *fu;
 	register struct hexdump_pr *pr;
 	register int cnt;
-	register unsigned char *bp;
 	off_t saveaddress;
 	unsigned char savech = 0, *savebp;
 	struct list_head *p, *q, *r;
 
-	while ((bp = get(hex)) != NULL) {
-		fs = &hex->fshead; savebp = bp; saveaddress = address;
+	fs = &hex->fshead; savebp = bp; saveaddress = address;
 
-		list_for_each(p, fs) {
-			fss = list_entry(p, struct hexdump_fs, fslist);
+	list_for_each(p, fs) {
+		fss = list_entry(p, struct hexdump_fs, fslist);
 
-			list_for_each(q, &fss->fulist) {
-				fu = list_entry(q, struct hexdump_fu, fulist);
+		list_for_each(q, &fss->fulist) {
+			fu = list_entry(q, struct hexdump_fu, fulist);
 
-				if (fu->flags&F_IGNORE)
-					break;
+			if (fu->flags&F_IGNORE)
+				break;
 
-				cnt = fu->reps;
+			cnt = fu->reps;
 
-				while (cnt) {
-					list_for_each(r, &fu->prlist) {
-						pr = list_entry(r, struct hexdump_pr, prlist);
+			while (cnt) {
+				list_for_each(r, &fu->prlist) {
+					pr = list_entry(r, struct hexdump_pr, prlist);
 
-						if (eaddress && address >= eaddress
-						    && !(pr->flags&(F_TEXT|F_BPAD)))
-							bpad(pr);
+					if (eaddress && address >= eaddress
+					    && !(pr->flags&(F_TEXT|F_BPAD)))
+						bpad(pr);
 
-						if (cnt == 1 && pr->nospace) {
-							savech = *pr->nospace;
-							*pr->nospace = '\0';
-							print(pr, bp);
-							*pr->nospace = savech;
-						} else
-							print(pr, bp);
+					if (cnt == 1 && pr->nospace) {
+						savech = *pr->nospace;
+						*pr->nospace = '\0';
+						print(pr, bp);
+						*pr->nospace = savech;
+					} else
+						print(pr, bp);
 
-						address += pr->bcnt;
-						bp += pr->bcnt;
-					}
-					--cnt;
+					address += pr->bcnt;
+					bp += pr->bcnt;
 				}
+				--cnt;
 			}
-			bp = savebp;
-			address = saveaddress;
 		}
+		bp = savebp;
+		address = saveaddress;
+	}
+}
+
+void display(struct hexdump *hex)
+{
+	register struct hexdump_pr *pr;
+	register unsigned char *bp;
+	struct list_head *p;
+	int fast = hex->format != FMT_CUSTOM && hex->blocksize == 16;
+
+	if (fast)
+		init_fast_tab();
+
+	while ((bp = get(hex)) != NULL) {
+		if (fast && !eaddress)
+			display_fast(hex, bp);
+		else
+			display_block(hex, bp);
 	}
 	if (endfu) {
 		/*
@@ -61,6 +61,7 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 {
 	int ch;
 	int colormode = UL_COLORMODE_UNDEF;
+	int nformats = 0;
 	char *hex_offt = "\"%07.7_Ax\n\"";
 
 
@@ -87,25 +88,35 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'b':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%03o \" \"\\n\"", hex);
+			hex->format = FMT_ONE_OCTAL;
+			nformats++;
 			break;
 		case 'c':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 16/1 \"%3_c \" \"\\n\"", hex);
+			hex->format = FMT_ONE_CHAR;
+			nformats++;
 			break;
 		case 'C':
 			add_fmt("\"%08.8_Ax\n\"", hex);
 			add_fmt("\"%08.8_ax  \" 8/1 \"%02x \" \"  \" 8/1 \"%02x \" ", hex);
 			add_fmt("\"  |\" 16/1 \"%_p\" \"|\\n\"", hex);
+			hex->format = FMT_CANONICAL;
+			nformats++;
 			break;
 		case 'd':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"  %05u \" \"\\n\"", hex);
+			hex->format = FMT_TWO_DECIMAL;
+			nformats++;
 			break;
 		case 'e':
 			add_fmt(optarg, hex);
+			nformats += 2;
 			break;
 		case 'f':
 			addfile(optarg, hex);
+			nformats += 2;
 			break;
 		case 'L':
 			colormode = UL_COLORMODE_AUTO;
@@ -119,6 +130,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'o':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \" %06o \" \"\\n\"", hex);
+			hex->format = FMT_TWO_OCTAL;
+			nformats++;
 			break;
 		case 's':
 			hex->skip = strtosize_or_err(optarg, _("failed to parse offset"));
@@ -129,6 +142,8 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 		case 'x':
 			add_fmt(hex_offt, hex);
 			add_fmt("\"%07.7_ax \" 8/2 \"   %04x \" \"\\n\"", hex);
+			hex->format = FMT_TWO_HEX;
+			nformats++;
 			break;
 		case 'h':
 			usage();
@@ -144,7 +159,9 @@ parse_args(int argc, char **argv, struct hexdump *hex)
 	if (list_empty(&hex->fshead)) {
 		add_fmt(hex_offt, hex);
 		add_fmt("\"%07.7_ax \" 8/2 \"%04x \" \"\\n\"", hex);
-	}
+		hex->format = FMT_DEFAULT;
+	} else if (nformats > 1)
+		hex->format = FMT_CUSTOM;
 	colors_init (colormode, "hexdump");
 	return optind;
 }
@@ -83,12 +83,25 @@ struct hexdump_fs {			/* format strings */
 	int bcnt;
 };
 
+/* built-in formats with a fast path in display() */
+enum {
+	FMT_CUSTOM = 0,			/* -e, -f or more formats */
+	FMT_DEFAULT,			/* no format option */
+	FMT_ONE_OCTAL,			/* -b */
+	FMT_ONE_CHAR,			/* -c */
+	FMT_CANONICAL,			/* -C */
+	FMT_TWO_DECIMAL,		/* -d */
+	FMT_TWO_OCTAL,			/* -o */
+	FMT_TWO_HEX			/* -x */
+};
+
 struct hexdump {
   struct list_head fshead;				/* head of format strings */
   ssize_t blocksize;			/* data block size */
   int exitval;				/* final exit value */
   ssize_t length;			/* max bytes to read */
   off_t skip;				/* bytes to skip */
+  int format;				/* FMT_* */
 };
 
 extern struct hexdump_fu *endfu;